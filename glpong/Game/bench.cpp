@@ -0,0 +1,1982 @@
+#include "bench.h"
+#include "chunkstore.h"
+#include "dataset.h"
+#include "drawqueue.h"
+#include "evolve.h"
+#include "experience.h"
+#include "glresources.h"
+#include "hitch.h"
+#include "instancefill.h"
+#include "iowriter.h"
+#include "memstats.h"
+#include "rawinput.h"
+#include "rans.h"
+#include "profiler.h"
+#include "replay.h"
+#include "sim.h"
+#include "slotmap.h"
+#include "statehash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/input.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+    helpers
+*/
+
+// current time in seconds
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// read an unsigned integer argument or return the default
+static unsigned int argOr(int argc, char** argv, int idx, unsigned int def) {
+    return idx < argc ? (unsigned int)strtoul(argv[idx], NULL, 10) : def;
+}
+
+// xorshift random number generator
+static unsigned int nextRandom(unsigned int& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// random float in [lo, hi)
+static float randomRange(unsigned int& state, float lo, float hi) {
+    return lo + (hi - lo) * (nextRandom(state) & 0xffffff) / (float)0x1000000;
+}
+
+// put every match in a different starting state so they diverge
+static void scatterMatches(MatchBatch& batch, const SimParams& params, unsigned int seed) {
+    unsigned int state = seed ? seed : 1;
+    for (unsigned int m = 0; m < batch.count; m++) {
+        resetMatch(batch, params, m);
+        batch.ballX[m] = randomRange(state, params.width * 0.25f, params.width * 0.75f);
+        batch.ballY[m] = randomRange(state, params.height * 0.25f, params.height * 0.75f);
+        batch.ballVX[m] = (nextRandom(state) & 1 ? 1.0f : -1.0f) * randomRange(state, 100.0f, 300.0f);
+        batch.ballVY[m] = randomRange(state, -200.0f, 200.0f);
+        batch.paddleY[0][m] = randomRange(state, params.height * 0.25f, params.height * 0.75f);
+        batch.paddleY[1][m] = randomRange(state, params.height * 0.25f, params.height * 0.75f);
+    }
+}
+
+// spread balls over the whole field so contacts happen at the rate of a running game
+static void spreadBalls(MatchBatch& batch, const SimParams& params, unsigned int seed) {
+    unsigned int state = seed ? seed : 1;
+    for (unsigned int m = 0; m < batch.count; m++) {
+        batch.ballX[m] = randomRange(state, params.ballRadius, params.width - params.ballRadius);
+        batch.ballY[m] = randomRange(state, params.ballRadius, params.height - params.ballRadius);
+    }
+}
+
+/*
+    dTLB miss counter (linux only)
+*/
+
+// open counter for data TLB load misses of this thread, -1 if unavailable
+static int openTLBCounter() {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void startCounter(int fd) {
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// stop counter and return its value
+static long long stopCounter(int fd) {
+    long long value = -1;
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+            value = -1;
+        }
+    }
+#endif
+    return value;
+}
+
+static void closeCounter(int fd) {
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+/*
+    benchmarks
+*/
+
+// step throughput with and without huge pages
+// args: [matches] [ticks]
+static int benchStep(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 1 << 20);
+    unsigned int ticks = argOr(argc, argv, 1, 240);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    float dt = 1.0f / 240.0f;
+
+    std::cout << "step: " << matches << " matches, " << ticks << " ticks" << std::endl;
+
+    unsigned int modes[] = { ALLOC_PREFAULT, ALLOC_PREFAULT | ALLOC_HUGE_PAGES };
+    for (unsigned int flags : modes) {
+        MatchBatch batch;
+        if (!allocMatchBatch(batch, matches, flags)) {
+            std::cout << "Could not allocate batch" << std::endl;
+            return -1;
+        }
+        scatterMatches(batch, params, 1234);
+
+        int counter = openTLBCounter();
+        startCounter(counter);
+        double start = now();
+        for (unsigned int t = 0; t < ticks; t++) {
+            botInputs(batch, params);
+            stepMatches(batch, params, dt);
+        }
+        double elapsed = now() - start;
+        long long tlbMisses = stopCounter(counter);
+        closeCounter(counter);
+
+        double steps = (double)matches * ticks;
+        std::cout << "  " << pageModeName(batch.block.pageMode) << " pages ("
+            << batch.block.size / (1024 * 1024) << " MB): "
+            << steps / elapsed / 1e6 << " M match-steps/s";
+        if (tlbMisses >= 0) {
+            std::cout << ", " << tlbMisses / steps << " dTLB misses/step";
+        }
+        std::cout << std::endl;
+
+        freeMatchBatch(batch);
+    }
+
+    return 0;
+}
+
+// axis-aligned against rotated paddle collisions
+// args: [matches] [ticks]
+static int benchCollide(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 1 << 20);
+    unsigned int ticks = argOr(argc, argv, 1, 240);
+    float dt = 1.0f / 240.0f;
+
+    std::cout << "collide: " << matches << " matches, " << ticks << " ticks" << std::endl;
+
+    const char* names[] = { "AABB", "OBB (untilted)", "OBB (tilted)" };
+    for (int mode = 0; mode < 3; mode++) {
+        SimParams params = defaultSimParams(800.0f, 600.0f);
+        params.rotatedPaddles = mode > 0;
+
+        // every match through the collision tests, the paths this compares
+        params.compactContacts = false;
+
+        MatchBatch batch;
+        if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+            std::cout << "Could not allocate batch" << std::endl;
+            return -1;
+        }
+        scatterMatches(batch, params, 1234);
+        if (mode == 2) {
+            unsigned int state = 5678;
+            for (unsigned int m = 0; m < matches; m++) {
+                batch.paddleAngle[0][m] = randomRange(state, -params.maxTilt, params.maxTilt);
+                batch.paddleAngle[1][m] = randomRange(state, -params.maxTilt, params.maxTilt);
+            }
+        }
+
+        unsigned long long hits = 0;
+        double elapsed = 0.0;
+        for (unsigned int t = 0; t < ticks; t++) {
+            botInputs(batch, params);
+            double start = now();
+            stepMatches(batch, params, dt);
+            elapsed += now() - start;
+            for (unsigned int m = 0; m < matches; m++) {
+                hits += (batch.events[m] & EVENT_PADDLE) ? 1 : 0;
+            }
+        }
+
+        std::cout << "  " << names[mode] << ": "
+            << (double)matches * ticks / elapsed / 1e6 << " M match-steps/s, "
+            << hits << " paddle hits" << std::endl;
+
+        freeMatchBatch(batch);
+    }
+
+    return 0;
+}
+
+/*
+    straight-line step
+    the step as it was before spin and substeps (one pass per tick, axis-aligned
+    paddles, every match through the collision tests), kept as the baseline the
+    spin model is measured against
+*/
+
+static void straightWalls(MatchBatch& batch, const SimParams& params) {
+    float ballRadius = params.ballRadius;
+    for (unsigned int m = 0; m < batch.count; m++) {
+        unsigned char events = 0;
+        unsigned int& framesSinceLastCollision = batch.framesSinceLastCollision[m];
+        if (framesSinceLastCollision != (unsigned int)-1) {
+            framesSinceLastCollision++;
+        }
+
+        float& ballX = batch.ballX[m];
+        float& ballY = batch.ballY[m];
+        if (ballY - ballRadius <= 0 || ballY + ballRadius >= params.height) {
+            batch.ballVY[m] *= -1;
+            events |= EVENT_WALL;
+        }
+
+        unsigned char reset = 0;
+        if (ballX - ballRadius <= 0) {
+            batch.score[1][m]++;
+            reset = 1;
+            events |= EVENT_SCORE_RIGHT;
+        }
+        else if (ballX + ballRadius >= params.width) {
+            batch.score[0][m]++;
+            reset = 2;
+            events |= EVENT_SCORE_LEFT;
+        }
+        if (reset) {
+            ballX = params.width / 2.0f;
+            ballY = params.height / 2.0f;
+            batch.ballVX[m] = reset == 1 ? params.initBallVelocity.x : -params.initBallVelocity.x;
+            batch.ballVY[m] = params.initBallVelocity.y;
+        }
+        batch.events[m] = events;
+    }
+}
+
+static void straightPaddles(MatchBatch& batch, const SimParams& params) {
+    float halfPaddleHeight = params.paddleHeight / 2.0f;
+    float halfPaddleWidth = params.paddleWidth / 2.0f;
+    float ballRadius = params.ballRadius;
+    for (unsigned int m = 0; m < batch.count; m++) {
+        unsigned int& framesSinceLastCollision = batch.framesSinceLastCollision[m];
+        if (framesSinceLastCollision < params.framesThreshold && framesSinceLastCollision != (unsigned int)-1) {
+            continue;
+        }
+
+        float& ballX = batch.ballX[m];
+        float& ballY = batch.ballY[m];
+        float& ballVX = batch.ballVX[m];
+        float& ballVY = batch.ballVY[m];
+        int i = ballX > params.width / 2.0f ? 1 : 0;
+        float padX = paddleX(params, i);
+        vec2 distance = { std::abs(ballX - padX), std::abs(ballY - batch.paddleY[i][m]) };
+        if (distance.x > halfPaddleWidth + ballRadius || distance.y > halfPaddleHeight + ballRadius) {
+            continue;
+        }
+
+        bool collision = false;
+        if (distance.x <= halfPaddleWidth && distance.x >= (halfPaddleWidth - ballRadius)) {
+            collision = true;
+            ballVX *= -1;
+        }
+        else if (distance.y <= halfPaddleHeight && distance.y >= (halfPaddleHeight - ballRadius)) {
+            collision = true;
+            ballVY *= -1;
+        }
+        if ((distance.x - halfPaddleWidth) * (distance.x - halfPaddleWidth) +
+            (distance.y - halfPaddleHeight) * (distance.y - halfPaddleHeight) <= ballRadius * ballRadius &&
+            !collision) {
+            collision = true;
+            float signedDifference = i == 0 ? ballX - padX : padX - ballX;
+            if (distance.y - halfPaddleHeight <= signedDifference - halfPaddleWidth) {
+                ballVX *= -1;
+            }
+            else {
+                ballVY *= -1;
+            }
+        }
+
+        if (collision) {
+            ballVX *= 1.1f;
+            ballVY += 0.5f * batch.paddleV[i][m];
+            framesSinceLastCollision = 0;
+            batch.events[m] |= EVENT_PADDLE;
+        }
+    }
+}
+
+static void straightStep(MatchBatch& batch, const SimParams& params, float dt) {
+    // paddle velocities from the inputs, clamped to the field
+    float paddleBoundary = params.paddleHeight / 2.0f + params.ballRadius;
+    for (unsigned int m = 0; m < batch.count; m++) {
+        for (int i = 0; i < 2; i++) {
+            float& y = batch.paddleY[i][m];
+            float& v = batch.paddleV[i][m];
+            v = 0.0f;
+            if (batch.input[i][m] > 0) {
+                if (y < params.height - paddleBoundary) {
+                    v = params.paddleSpeed;
+                }
+                else {
+                    y = params.height - paddleBoundary;
+                }
+            }
+            else if (batch.input[i][m] < 0) {
+                if (y > paddleBoundary) {
+                    v = -params.paddleSpeed;
+                }
+                else {
+                    y = paddleBoundary;
+                }
+            }
+        }
+    }
+
+    straightWalls(batch, params);
+    straightPaddles(batch, params);
+
+    for (int i = 0; i < 2; i++) {
+        for (unsigned int m = 0; m < batch.count; m++) {
+            batch.paddleY[i][m] += batch.paddleV[i][m] * dt;
+        }
+    }
+    for (unsigned int m = 0; m < batch.count; m++) {
+        batch.ballX[m] += batch.ballVX[m] * dt;
+        batch.ballY[m] += batch.ballVY[m] * dt;
+    }
+}
+
+// spin and substeps against the straight-line step, on balls at game speeds and on
+// fast and hard-spinning balls that need several substeps; both models run every
+// match through the collision tests, as the straight step did
+// args: [matches] [ticks] [tick rate]
+static int benchSpin(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 1 << 20);
+    unsigned int ticks = argOr(argc, argv, 1, 240);
+    unsigned int tickRate = argOr(argc, argv, 2, 240);
+    float dt = 1.0f / tickRate;
+
+    std::cout << "spin: " << matches << " matches, " << ticks << " ticks at " << tickRate << " Hz" << std::endl;
+
+    // ball speed range and spin range (radians per second) of each case
+    struct SpinCase {
+        const char* name;
+        float minSpeed;
+        float maxSpeed;
+        float spin;
+    };
+    const SpinCase cases[] = {
+        { "game speeds", 100.0f, 300.0f, 20.0f },
+        { "fast balls", 1500.0f, 4000.0f, 20.0f },
+        { "hard spin", 100.0f, 300.0f, 1500.0f },
+    };
+
+    for (const SpinCase& spinCase : cases) {
+        std::cout << "  " << spinCase.name << ":" << std::endl;
+        double baseline = 0.0;
+        for (int mode = 0; mode < 2; mode++) {
+            SimParams params = defaultSimParams(800.0f, 600.0f);
+            params.compactContacts = false;
+
+            MatchBatch batch;
+            if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+                std::cout << "Could not allocate batch" << std::endl;
+                return -1;
+            }
+            scatterMatches(batch, params, 1234);
+            unsigned int state = 5678;
+            for (unsigned int m = 0; m < matches; m++) {
+                float speed = randomRange(state, spinCase.minSpeed, spinCase.maxSpeed);
+                float heading = randomRange(state, -0.8f, 0.8f) + (m & 1 ? 3.14159265f : 0.0f);
+                batch.ballVX[m] = speed * std::cos(heading);
+                batch.ballVY[m] = speed * std::sin(heading);
+                batch.ballSpin[m] = mode == 1 ? randomRange(state, -spinCase.spin, spinCase.spin) : 0.0f;
+            }
+
+            unsigned long long substeps = 0;
+            unsigned long long multiStep = 0;
+            double elapsed = 0.0;
+            for (unsigned int t = 0; t < ticks; t++) {
+                botInputs(batch, params);
+                double start = now();
+                if (mode == 0) {
+                    straightStep(batch, params, dt);
+                }
+                else {
+                    stepMatches(batch, params, dt);
+                }
+                elapsed += now() - start;
+                for (unsigned int m = 0; mode == 1 && m < matches; m++) {
+                    substeps += batch.substeps[m];
+                    multiStep += batch.substeps[m] > 1 ? 1 : 0;
+                }
+            }
+
+            double perTick = elapsed / ticks * 1e3;
+            double steps = (double)matches * ticks;
+            if (mode == 0) {
+                baseline = perTick;
+                std::cout << "    straight step: " << perTick << " ms/tick" << std::endl;
+            }
+            else {
+                std::cout << "    spin + substeps: " << perTick << " ms/tick (" << perTick / baseline * 100.0 << "%), "
+                    << substeps / steps << " substeps/match, " << multiStep / steps * 100.0
+                    << "% of match-ticks substepped" << std::endl;
+            }
+
+            freeMatchBatch(batch);
+        }
+    }
+
+    return 0;
+}
+
+// sum of match state, to check that two runs ended the same
+static double batchChecksum(const MatchBatch& batch) {
+    double sum = 0.0;
+    for (unsigned int m = 0; m < batch.count; m++) {
+        sum += batch.ballX[m] + batch.ballY[m] + batch.ballVX[m] + batch.ballVY[m] +
+            batch.score[0][m] + batch.score[1][m];
+    }
+    return sum;
+}
+
+// collision tests on every match against only on near-contact matches
+// args: [matches] [ticks] [field width] [field height]
+static int benchContact(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 1 << 20);
+    unsigned int ticks = argOr(argc, argv, 1, 240);
+    float width = (float)argOr(argc, argv, 2, 800);
+    float height = (float)argOr(argc, argv, 3, 600);
+    float dt = 1.0f / 240.0f;
+
+    std::cout << "contact: " << matches << " matches, " << ticks << " ticks, "
+        << width << "x" << height << " field" << std::endl;
+
+    for (int rotated = 0; rotated < 2; rotated++) {
+        double fullTime = 0.0;
+        double fullChecksum = 0.0;
+        for (int compact = 0; compact < 2; compact++) {
+            SimParams params = defaultSimParams(width, height);
+            params.rotatedPaddles = rotated != 0;
+            params.compactContacts = compact != 0;
+
+            MatchBatch batch;
+            if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+                std::cout << "Could not allocate batch" << std::endl;
+                return -1;
+            }
+            scatterMatches(batch, params, 1234);
+            spreadBalls(batch, params, 5678);
+
+            unsigned long long contacts = 0;
+            double elapsed = 0.0;
+            for (unsigned int t = 0; t < ticks; t++) {
+                botInputs(batch, params);
+                double start = now();
+                stepMatches(batch, params, dt);
+                elapsed += now() - start;
+                contacts += batch.contacts;
+            }
+
+            double checksum = batchChecksum(batch);
+            if (!compact) {
+                fullTime = elapsed;
+                fullChecksum = checksum;
+            }
+            std::cout << "  " << (rotated ? "OBB" : "AABB") << (compact ? " compacted: " : " full: ")
+                << elapsed / ticks * 1e3 << " ms/tick, "
+                << 100.0 * contacts / ((double)matches * ticks) << "% tested";
+            if (compact) {
+                std::cout << ", " << fullTime / elapsed << "x speedup, "
+                    << (checksum == fullChecksum ? "same" : "different") << " outcome";
+            }
+            std::cout << std::endl;
+
+            freeMatchBatch(batch);
+        }
+    }
+
+    return 0;
+}
+
+// incremental state hash against rehashing, and CRC32C throughput
+// args: [matches] [ticks]
+static int benchHash(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 1 << 20);
+    unsigned int ticks = argOr(argc, argv, 1, 240);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    float dt = 1.0f / 240.0f;
+
+    std::cout << "hash: " << matches << " matches, " << ticks << " ticks" << std::endl;
+
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        return -1;
+    }
+    scatterMatches(batch, params, 1234);
+    spreadBalls(batch, params, 5678);
+
+    StateHash* hashes = new StateHash[matches];
+    StateHash* batched = new StateHash[matches];
+    StateHash* fresh = new StateHash[matches];
+    for (unsigned int m = 0; m < matches; m++) {
+        initStateHash(hashes[m], batch, m);
+        batched[m] = hashes[m];
+    }
+
+    double updateTime = 0.0;
+    double batchTime = 0.0;
+    double rehashTime = 0.0;
+    for (unsigned int t = 0; t < ticks; t++) {
+        botInputs(batch, params);
+        stepMatches(batch, params, dt);
+
+        double start = now();
+        for (unsigned int m = 0; m < matches; m++) {
+            updateStateHash(hashes[m], batch, m);
+        }
+        double updated = now();
+        updateStateHashes(batched, batch);
+        double batchUpdated = now();
+        for (unsigned int m = 0; m < matches; m++) {
+            initStateHash(fresh[m], batch, m);
+        }
+        updateTime += updated - start;
+        batchTime += batchUpdated - updated;
+        rehashTime += now() - batchUpdated;
+    }
+
+    // the rolling hashes have to end where a fresh hash does
+    unsigned int mismatches = 0;
+    for (unsigned int m = 0; m < matches; m++) {
+        mismatches += hashes[m].value != fresh[m].value || batched[m].value != fresh[m].value ? 1 : 0;
+    }
+
+    double matchTicks = (double)matches * ticks;
+    std::cout << "  incremental: " << updateTime / matchTicks * 1e9 << " ns/match-tick" << std::endl;
+    std::cout << "  incremental, whole batch: " << batchTime / matchTicks * 1e9 << " ns/match-tick" << std::endl;
+    std::cout << "  rehash: " << rehashTime / matchTicks * 1e9 << " ns/match-tick" << std::endl;
+    std::cout << "  " << mismatches << " mismatches against rehashing" << std::endl;
+
+    // bulk verification of a snapshot of the state arrays
+    size_t bytes = batch.block.size;
+    unsigned int repeats = 8;
+    unsigned int crc = 0;
+    double start = now();
+    for (unsigned int r = 0; r < repeats; r++) {
+        crc = crc32c(batch.block.ptr, bytes, crc);
+    }
+    double hardware = now() - start;
+
+    start = now();
+    for (unsigned int r = 0; r < repeats; r++) {
+        crc = crc32cSoftware(batch.block.ptr, bytes, crc);
+    }
+    double software = now() - start;
+
+    std::cout << "  crc32c (" << (crc32cHardware() ? "sse4.2" : "table") << "): "
+        << bytes * repeats / hardware / 1e9 << " GB/s" << std::endl;
+    std::cout << "  crc32c (table): " << bytes * repeats / software / 1e9 << " GB/s" << std::endl;
+    std::cout << "  snapshot crc " << std::hex << snapshotCRC(batch) << std::dec << std::endl;
+
+    delete[] hashes;
+    delete[] batched;
+    delete[] fresh;
+    freeMatchBatch(batch);
+    return 0;
+}
+
+// replay archive size and decode speed, rANS against the varint baseline
+// args: [matches] [ticks]
+static int benchReplay(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 4096);
+    unsigned int ticks = argOr(argc, argv, 1, 14400);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    float dt = 1.0f / 240.0f;
+
+    std::cout << "replay: " << matches << " matches, " << ticks << " ticks" << std::endl;
+
+    // corpus of bot matches
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        return -1;
+    }
+    scatterMatches(batch, params, 1234);
+
+    ReplayCorpus corpus;
+    initReplayCorpus(corpus, matches, ticks);
+    for (unsigned int t = 0; t < ticks; t++) {
+        botInputs(batch, params);
+        stepMatches(batch, params, dt);
+        recordTick(corpus, batch, t);
+    }
+
+    size_t symbols = 3 * corpus.inputs.size();
+    std::vector<unsigned char> rans, varint;
+    double start = now();
+    writeArchive(corpus, rans);
+    double ransEncodeTime = now() - start;
+    start = now();
+    writeVarintArchive(corpus, varint);
+    double varintEncodeTime = now() - start;
+
+    std::cout << "  raw: " << symbols << " bytes" << std::endl;
+    std::cout << "  varint: " << varint.size() << " bytes, encode " << symbols / varintEncodeTime / 1e9 << " GB/s" << std::endl;
+    std::cout << "  rans: " << rans.size() << " bytes (" << (double)varint.size() / rans.size()
+        << "x smaller), encode " << symbols / ransEncodeTime / 1e9 << " GB/s" << std::endl;
+
+    // decode speed in symbol bytes out per second
+    unsigned int repeats = 4;
+    const char* names[3] = { ransSIMD() ? "rans (avx2)" : "rans", "rans (scalar)", "varint" };
+    for (int codec = 0; codec < 3; codec++) {
+        ReplayCorpus decoded = corpus;
+        bool ok = true;
+        double best = 1e30;
+        for (unsigned int r = 0; r < repeats; r++) {
+            start = now();
+            if (codec == 0) {
+                ok = readArchive(rans.data(), rans.size(), decoded) && ok;
+            }
+            else if (codec == 1) {
+                // same archive through the scalar decoder
+                size_t pos = REPLAY_HEADER_BYTES;
+                std::vector<unsigned char>* streams[3] = { &decoded.inputs, &decoded.tilts, &decoded.events };
+                for (int s = 0; s < 3; s++) {
+                    size_t read = ransDecodeScalar(rans.data() + pos, rans.size() - pos, *streams[s]);
+                    ok = read && ok;
+                    pos += read;
+                }
+            }
+            else {
+                ok = readVarintArchive(varint.data(), varint.size(), decoded) && ok;
+            }
+            double time = now() - start;
+            best = time < best ? time : best;
+        }
+
+        ok = ok && decoded.inputs == corpus.inputs && decoded.tilts == corpus.tilts && decoded.events == corpus.events;
+        std::cout << "  " << names[codec] << " decode: " << symbols / best / 1e9 << " GB/s"
+            << (ok ? "" : " (MISMATCH)") << std::endl;
+    }
+
+    // the archive's CRC32C catches a flipped bit before decoding
+    ReplayCorpus decoded;
+    std::vector<unsigned char> damaged = rans;
+    damaged[damaged.size() / 2] ^= 1;
+    bool rejected = !readArchive(damaged.data(), damaged.size(), decoded);
+
+    // playing the decoded inputs back from the same start ends on the recorded snapshot CRC
+    bool verified = readArchive(rans.data(), rans.size(), decoded);
+    scatterMatches(batch, params, 1234);
+    start = now();
+    verified = verified && verifyReplay(decoded, batch, params, dt);
+    double verifyTime = now() - start;
+    freeMatchBatch(batch);
+
+    std::cout << "  damaged archive " << (rejected ? "rejected" : "ACCEPTED") << std::endl;
+    std::cout << "  replay " << (verified ? "verified" : "MISMATCH") << " against snapshot crc "
+        << std::hex << decoded.stateCRC << std::dec << " in " << verifyTime << " s" << std::endl;
+
+    return rejected && verified ? 0 : -1;
+}
+
+// storage saved by the chunk store on replays that share prefixes, and ingest speed
+// args: [matches] [ticks] [seeds]
+static int benchChunks(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 4096);
+    unsigned int ticks = argOr(argc, argv, 1, 14400);
+    unsigned int seeds = argOr(argc, argv, 2, 64);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    float dt = 1.0f / 240.0f;
+    seeds = seeds ? seeds : 1;
+
+    std::cout << "chunks: " << matches << " matches, " << ticks << " ticks, " << seeds << " seeds" << std::endl;
+
+    // matches start from one of a few seeds and play alike until a random tick,
+    // where a nudge to the ball makes them diverge
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        return -1;
+    }
+    scatterMatches(batch, params, 1234);
+    unsigned int* diverge = new unsigned int[matches];
+    unsigned int state = 99;
+    for (unsigned int m = 0; m < matches; m++) {
+        unsigned int from = m % seeds;
+        batch.ballX[m] = batch.ballX[from];
+        batch.ballY[m] = batch.ballY[from];
+        batch.ballVX[m] = batch.ballVX[from];
+        batch.ballVY[m] = batch.ballVY[from];
+        batch.paddleY[0][m] = batch.paddleY[0][from];
+        batch.paddleY[1][m] = batch.paddleY[1][from];
+        diverge[m] = nextRandom(state) % ticks;
+    }
+
+    ReplayCorpus corpus;
+    initReplayCorpus(corpus, matches, ticks);
+    for (unsigned int t = 0; t < ticks; t++) {
+        for (unsigned int m = 0; m < matches; m++) {
+            batch.ballVY[m] += diverge[m] == t ? 1.0f : 0.0f;
+        }
+        botInputs(batch, params);
+        stepMatches(batch, params, dt);
+        recordTick(corpus, batch, t);
+    }
+    freeMatchBatch(batch);
+    delete[] diverge;
+
+    std::vector<std::vector<unsigned char>> replays(matches);
+    for (unsigned int m = 0; m < matches; m++) {
+        writeMatchReplay(corpus, m, replays[m]);
+    }
+
+    ChunkStore store;
+    initChunkStore(store);
+    ChunkParams chunkParams = defaultChunkParams();
+    std::vector<Manifest> manifests(matches);
+    size_t manifestChunks = 0;
+    bool ok = true;
+
+    double start = now();
+    for (unsigned int m = 0; m < matches; m++) {
+        ok = ingest(store, chunkParams, replays[m].data(), replays[m].size(), manifests[m]) && ok;
+        manifestChunks += manifests[m].chunks.size();
+    }
+    double ingestTime = now() - start;
+
+    // every replay has to come back as it went in
+    std::vector<unsigned char> restored;
+    for (unsigned int m = 0; m < matches; m++) {
+        ok = restore(store, manifests[m], restored) && restored == replays[m] && ok;
+    }
+
+    size_t stored = storedBytes(store, manifestChunks, matches);
+    std::cout << "  replays: " << store.ingestedBytes << " bytes in " << store.ingestedChunks << " chunks" << std::endl;
+    std::cout << "  store: " << stored << " bytes (" << store.pack.size() << " in " << store.index.size()
+        << " distinct chunks), " << 100.0 * (1.0 - (double)stored / store.ingestedBytes) << "% saved" << std::endl;
+    std::cout << "  ingest: " << store.ingestedBytes / ingestTime / 1e6 << " MB/s" << std::endl;
+    std::cout << "  restore " << (ok ? "matches" : "MISMATCH") << std::endl;
+
+    // a flipped bit in the pack fails the CRC32C of the chunk holding it
+    bool rejected = true;
+    if (!store.pack.empty()) {
+        store.pack[store.pack.size() / 2] ^= 1;
+        unsigned int failed = 0;
+        for (unsigned int m = 0; m < matches; m++) {
+            failed += restore(store, manifests[m], restored) ? 0 : 1;
+        }
+        rejected = failed > 0;
+        std::cout << "  damaged pack: " << failed << " of " << matches << " restores rejected" << std::endl;
+    }
+
+    return ok && rejected ? 0 : -1;
+}
+
+// write throughput and enqueue latency of the I/O service under load from several
+// producer threads, each appending to its own file with an fsync every few buffers
+// args: [MB] [buffer KB] [producers] [buffers per sync] [directory]
+static int benchIO(int argc, char** argv) {
+    unsigned int megabytes = argOr(argc, argv, 0, 1024);
+    unsigned int bufferKB = argOr(argc, argv, 1, 64);
+    unsigned int producers = argOr(argc, argv, 2, 3);
+    unsigned int syncEvery = argOr(argc, argv, 3, 64);
+    std::string directory = argc > 4 ? argv[4] : ".";
+    producers = producers < 1 ? 1 : (producers > IO_MAX_FILES ? IO_MAX_FILES : producers);
+    syncEvery = syncEvery ? syncEvery : 1;
+
+    size_t bufferSize = (size_t)bufferKB * 1024;
+    unsigned int perProducer = (unsigned int)((size_t)megabytes * 1024 * 1024 / bufferSize / producers);
+
+    std::cout << "io: " << megabytes << " MB in " << bufferKB << " KB buffers from " << producers
+        << " producers, fsync every " << syncEvery << " buffers" << std::endl;
+
+    IOService service;
+    if (!startIOService(service, 256, bufferSize)) {
+        std::cout << "Could not start I/O service" << std::endl;
+        return -1;
+    }
+    std::vector<std::string> paths;
+    for (unsigned int p = 0; p < producers; p++) {
+        paths.push_back(directory + "/iobench" + std::to_string(p) + ".bin");
+        if (openIOFile(service, paths[p].c_str()) < 0) {
+            std::cout << "Could not open " << paths[p] << std::endl;
+            stopIOService(service);
+            return -1;
+        }
+    }
+
+    // producers fill and queue buffers, spinning only when the pool is empty
+    std::vector<std::vector<float>> latencies(producers);
+    std::vector<unsigned long long> stalls(producers, 0);
+    std::vector<std::thread> threads;
+    double start = now();
+    for (unsigned int p = 0; p < producers; p++) {
+        threads.push_back(std::thread([&, p]() {
+            latencies[p].reserve(perProducer);
+            for (unsigned int i = 0; i < perProducer; i++) {
+                // time from the first try for a buffer, waits on an empty pool
+                // included, to the submit, but not the fill
+                double before = now();
+                IOBuffer* buffer;
+                while (!(buffer = acquireIOBuffer(service))) {
+                    stalls[p]++;
+                    std::this_thread::yield();
+                }
+                double acquired = now();
+                memset(buffer->data, (int)(i & 0xff), bufferSize);
+                buffer->size = bufferSize;
+                buffer->file = p;
+                buffer->sync = (i + 1) % syncEvery == 0;
+                double filled = now();
+                submitIOBuffer(service, buffer);
+                latencies[p].push_back((float)((acquired - before) + (now() - filled)));
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    bool uring = ioUringActive(service);
+    stopIOService(service);
+    double elapsed = now() - start;
+
+    std::vector<float> all;
+    unsigned long long stalled = 0;
+    for (unsigned int p = 0; p < producers; p++) {
+        all.insert(all.end(), latencies[p].begin(), latencies[p].end());
+        stalled += stalls[p];
+    }
+    std::sort(all.begin(), all.end());
+
+    std::cout << "  backend: " << (uring ? "io_uring" : "blocking writes") << std::endl;
+    std::cout << "  " << service.bytesWritten.load() / elapsed / 1e6 << " MB/s, " << service.writes.load()
+        << " writes, " << service.syncs.load() << " fsyncs, " << service.submits.load() << " submits, "
+        << service.errors.load() << " errors" << std::endl;
+    if (!all.empty()) {
+        std::cout << "  enqueue: p50 " << all[all.size() / 2] * 1e9 << " ns, p99 "
+            << all[all.size() * 99 / 100] * 1e9 << " ns, max " << all.back() * 1e9 << " ns" << std::endl;
+    }
+    std::cout << "  " << stalled << " retries on an empty pool" << std::endl;
+
+    // every buffer has to land in order at its offset
+    bool ok = true;
+    std::vector<unsigned char> check(bufferSize);
+    for (const std::string& path : paths) {
+        FILE* file = fopen(path.c_str(), "rb");
+        for (unsigned int i = 0; file && i < perProducer && ok; i++) {
+            ok = fread(check.data(), 1, bufferSize, file) == bufferSize &&
+                check[0] == (i & 0xff) && check[bufferSize - 1] == (i & 0xff);
+        }
+        ok = file && ok && fgetc(file) == EOF;
+        if (file) {
+            fclose(file);
+        }
+        std::remove(path.c_str());
+    }
+    std::cout << "  files " << (ok ? "match" : "MISMATCH") << std::endl;
+    return ok ? 0 : -1;
+}
+
+// export of recorded play as shuffled shards, and minibatch reads from the mapped shards
+// args: [matches] [ticks] [batch size] [directory]
+static int benchDataset(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 1024);
+    unsigned int ticks = argOr(argc, argv, 1, 2400);
+    unsigned int batchSize = argOr(argc, argv, 2, 256);
+    std::string directory = argc > 3 ? argv[3] : "dataset";
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    float dt = 1.0f / 240.0f;
+    batchSize = batchSize ? batchSize : 1;
+
+    std::cout << "dataset: " << matches << " matches, " << ticks << " ticks, batches of " << batchSize << std::endl;
+
+    // bots stand in for human players
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        return -1;
+    }
+    scatterMatches(batch, params, 1234);
+
+    std::vector<TrainingSample> capture((size_t)matches * ticks);
+    for (unsigned int t = 0; t < ticks; t++) {
+        botInputs(batch, params);
+        for (unsigned int m = 0; m < matches; m++) {
+            captureSample(capture[(size_t)t * matches + m], batch, m, dt, t, m);
+        }
+        stepMatches(batch, params, dt);
+    }
+    freeMatchBatch(batch);
+
+    // order-independent check of what went in
+    long long labels = 0;
+    for (const TrainingSample& sample : capture) {
+        labels += sample.input[0] * 3 + sample.input[1] + sample.tick;
+    }
+
+    size_t bytes = capture.size() * sizeof(TrainingSample);
+    double start = now();
+    if (!writeDataset(directory.c_str(), capture.data(), capture.size(), DATASET_SHARD_SAMPLES, 42)) {
+        std::cout << "Could not write dataset to " << directory << std::endl;
+        return -1;
+    }
+    double writeTime = now() - start;
+
+    Dataset dataset;
+    start = now();
+    if (!openDataset(dataset, directory.c_str())) {
+        std::cout << "Could not open dataset in " << directory << std::endl;
+        return -1;
+    }
+    double openTime = now() - start;
+
+    // one pass in order, which also checks the contents
+    start = now();
+    long long loaded = 0;
+    for (unsigned long long i = 0; i < dataset.count; i++) {
+        const TrainingSample& sample = datasetSample(dataset, i);
+        loaded += sample.input[0] * 3 + sample.input[1] + sample.tick;
+    }
+    double scanTime = now() - start;
+
+    // random minibatches, four times the dataset
+    std::vector<TrainingSample> minibatch(batchSize);
+    unsigned int rng = 7;
+    unsigned long long reads = 4 * dataset.count / batchSize;
+    float sink = 0.0f;
+    start = now();
+    for (unsigned long long b = 0; b < reads; b++) {
+        sampleBatch(dataset, rng, batchSize, minibatch.data());
+        sink += minibatch[b % batchSize].ballX;
+    }
+    double batchTime = now() - start;
+
+    std::cout << "  " << dataset.count << " samples in " << dataset.shards.size() << " shards" << std::endl;
+    std::cout << "  write (shuffle included): " << bytes / writeTime / 1e6 << " MB/s" << std::endl;
+    std::cout << "  open: " << openTime * 1e3 << " ms" << std::endl;
+    std::cout << "  sequential: " << bytes / scanTime / 1e9 << " GB/s" << std::endl;
+    std::cout << "  minibatches: " << reads * batchSize * sizeof(TrainingSample) / batchTime / 1e9 << " GB/s, "
+        << reads * batchSize / batchTime / 1e6 << "M samples/s" << (sink == 0.5f ? " " : "") << std::endl;
+    std::cout << "  contents " << (loaded == labels && dataset.count == capture.size() ? "match" : "MISMATCH") << std::endl;
+
+    closeDataset(dataset);
+    return 0;
+}
+
+// prioritized experience replay: add, update and sample rates, concurrent sampling,
+// and whether draws follow the priorities
+// args: [capacity] [batch size] [sampling threads]
+static int benchExperience(int argc, char** argv) {
+    unsigned long long capacity = argOr(argc, argv, 0, 1 << 24);
+    unsigned int batchSize = argOr(argc, argv, 1, 256);
+    unsigned int samplers = argOr(argc, argv, 2, 2);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    float dt = 1.0f / 240.0f;
+    batchSize = batchSize ? batchSize : 1;
+    samplers = samplers ? samplers : 1;
+
+    std::cout << "experience: " << capacity << " transitions, batches of " << batchSize << ", "
+        << samplers << " sampling threads" << std::endl;
+
+    ExperienceReplay replay;
+    if (!createExperienceReplay(replay, "/pong-experience-bench", capacity)) {
+        std::cout << "Could not create shared memory" << std::endl;
+        return -1;
+    }
+    std::cout << "  shared block: " << replay.header->layout.size / (1 << 20) << " MB, "
+        << replay.header->layout.levels << " tree levels" << std::endl;
+
+    // fill from bot play, one transition per paddle per tick
+    unsigned int matches = (unsigned int)(capacity / 2 < (1 << 20) ? capacity / 2 : (1 << 20));
+    matches = matches ? matches : 1;
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, matches, ALLOC_PREFAULT | ALLOC_HUGE_PAGES)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        closeExperienceReplay(replay);
+        return -1;
+    }
+    scatterMatches(batch, params, 1234);
+
+    double addTime = 0.0;
+    std::vector<Transition> pending(2 * (size_t)matches);
+    while (replay.header->cursor.load() < capacity) {
+        botInputs(batch, params);
+        for (unsigned int m = 0; m < matches; m++) {
+            for (int i = 0; i < 2; i++) {
+                Transition& transition = pending[2 * m + i];
+                observe(batch, m, i, transition.state);
+                transition.action = batch.input[i][m];
+            }
+        }
+        stepMatches(batch, params, dt);
+        for (unsigned int m = 0; m < matches; m++) {
+            unsigned char scored = batch.events[m] & (EVENT_SCORE_LEFT | EVENT_SCORE_RIGHT);
+            for (int i = 0; i < 2; i++) {
+                Transition& transition = pending[2 * m + i];
+                observe(batch, m, i, transition.nextState);
+                unsigned char mine = i == 0 ? EVENT_SCORE_LEFT : EVENT_SCORE_RIGHT;
+                transition.reward = scored ? (scored & mine ? 1.0f : -1.0f) : 0.0f;
+                transition.done = scored ? 1 : 0;
+            }
+        }
+
+        double start = now();
+        for (const Transition& transition : pending) {
+            addTransition(replay, transition);
+        }
+        addTime += now() - start;
+    }
+    freeMatchBatch(batch);
+    unsigned long long added = replay.header->cursor.load();
+
+    // random priorities, heavy tailed like TD errors
+    unsigned long long rng = 1;
+    unsigned int state = 3;
+    double start = now();
+    for (unsigned long long i = 0; i < capacity; i++) {
+        float u = randomRange(state, 0.0f, 1.0f);
+        updatePriority(replay, i, replay.versions[i].load(), 0.01f + u * u * u * 10.0f);
+    }
+    double updateTime = now() - start;
+
+    // expected mean priority of a draw is sum(p^2) / sum(p)
+    double sum = 0.0, sumSquares = 0.0;
+    for (unsigned long long i = 0; i < capacity; i++) {
+        double p = replay.leaves[i].load();
+        sum += p;
+        sumSquares += p * p;
+    }
+
+    std::vector<unsigned long long> slots(batchSize);
+    std::vector<unsigned int> versions(batchSize);
+    std::vector<Transition> out(batchSize);
+    std::vector<float> weights(batchSize);
+    unsigned int batches = (unsigned int)(4000000 / batchSize) + 1;
+    double drawn = 0.0;
+    start = now();
+    for (unsigned int b = 0; b < batches; b++) {
+        sampleTransitions(replay, rng, batchSize, 0.4f, slots.data(), versions.data(), out.data(), weights.data());
+        for (unsigned int i = 0; i < batchSize; i++) {
+            drawn += replay.leaves[slots[i]].load();
+        }
+    }
+    double sampleTime = now() - start;
+    double meanDrawn = drawn / ((double)batches * batchSize);
+
+    std::cout << "  add: " << added / addTime / 1e6 << "M transitions/s" << std::endl;
+    std::cout << "  update: " << updateTime / capacity * 1e9 << " ns" << std::endl;
+    std::cout << "  sample: " << (double)batches * batchSize / sampleTime / 1e6 << "M transitions/s" << std::endl;
+    std::cout << "  mean drawn priority " << meanDrawn / sumSquares * sum << " of expected" << std::endl;
+
+    // learners in other processes attach by name; here threads sample through their own
+    // mappings while the main thread keeps updating priorities
+    std::vector<ExperienceReplay> views(samplers);
+    for (unsigned int t = 0; t < samplers; t++) {
+        if (!attachExperienceReplay(views[t], "/pong-experience-bench")) {
+            std::cout << "Could not attach to shared memory" << std::endl;
+            closeExperienceReplay(replay);
+            return -1;
+        }
+    }
+    std::atomic<bool> sampling(true);
+    std::vector<unsigned long long> counts(samplers, 0);
+    std::vector<std::thread> threads;
+    start = now();
+    for (unsigned int t = 0; t < samplers; t++) {
+        threads.push_back(std::thread([&, t]() {
+            std::vector<unsigned long long> s(batchSize);
+            std::vector<unsigned int> v(batchSize);
+            std::vector<Transition> o(batchSize);
+            std::vector<float> w(batchSize);
+            unsigned long long r = t + 100;
+            while (sampling.load(std::memory_order_relaxed)) {
+                counts[t] += sampleTransitions(views[t], r, batchSize, 0.4f, s.data(), v.data(), o.data(), w.data());
+            }
+        }));
+    }
+    unsigned long long updates = 0;
+    while (now() - start < 1.0) {
+        for (unsigned int i = 0; i < 1024; i++, updates++) {
+            float u = randomRange(state, 0.0f, 1.0f);
+            unsigned long long slot = nextRandom(state) % capacity;
+            updatePriority(replay, slot, replay.versions[slot].load(), 0.01f + u * u * u * 10.0f);
+        }
+    }
+    sampling.store(false);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double concurrentTime = now() - start;
+
+    unsigned long long sampled = 0;
+    for (unsigned int t = 0; t < samplers; t++) {
+        sampled += counts[t];
+        closeExperienceReplay(views[t]);
+    }
+
+    // with every update finished the tree has to add up exactly
+    unsigned long long leafSum = 0;
+    for (unsigned long long i = 0; i < capacity; i++) {
+        leafSum += replay.leaves[i].load();
+    }
+
+    std::cout << "  concurrent: " << sampled / concurrentTime / 1e6 << "M transitions/s sampled, "
+        << updates / concurrentTime / 1e6 << "M updates/s" << std::endl;
+    bool addsUp = leafSum == totalPriority(replay);
+    std::cout << "  tree " << (addsUp ? "adds up" : "MISMATCH") << std::endl;
+
+    // an update for a transition that was overwritten since it was sampled is dropped
+    sampleTransitions(replay, rng, 1, 0.4f, slots.data(), versions.data(), out.data(), weights.data());
+    unsigned int before = replay.leaves[slots[0]].load();
+    for (unsigned long long i = 0; i < capacity; i++) {
+        addTransition(replay, out[0]);
+    }
+    unsigned int overwritten = replay.leaves[slots[0]].load();
+    bool dropped = !updatePriority(replay, slots[0], versions[0], 1000.0f) &&
+        replay.leaves[slots[0]].load() == overwritten;
+    std::cout << "  stale update " << (dropped ? "dropped" : "APPLIED") << " (" << before << " -> " << overwritten
+        << " units)" << std::endl;
+
+    bool ok = addsUp && dropped;
+    closeExperienceReplay(replay);
+    return ok ? 0 : -1;
+}
+
+static int benchEvolve(int argc, char** argv) {
+    unsigned int generations = argOr(argc, argv, 0, 20);
+    EvolutionParams config = defaultEvolutionParams();
+    config.members = argOr(argc, argv, 1, config.members);
+    config.matchesPerMember = argOr(argc, argv, 2, config.matchesPerMember);
+    config.threads = argOr(argc, argv, 3, 0);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+
+    double start = now();
+    Trainer trainer;
+    if (!startTrainer(trainer, params, config)) {
+        std::cout << "Could not start trainer" << std::endl;
+        return -1;
+    }
+    double setupTime = now() - start;
+
+    std::cout << "evolve: " << trainer.config.members << " members, " << trainer.config.matchesPerMember
+        << " matches each, " << trainer.config.ticks << " ticks per match, " << trainer.noThreads << " threads" << std::endl;
+    std::cout << "  setup (noise table " << NOISE_TABLE_SIZE * sizeof(float) / (1 << 20) << " MB): "
+        << setupTime << " s" << std::endl;
+
+    // against the bot on starting states the trainer never sees
+    const unsigned int evalMatches = 1024;
+    float before = evaluatePolicy(trainer, trainer.policy, evalMatches, 1);
+
+    double trainTime = 0.0;
+    for (unsigned int g = 0; g < generations; g++) {
+        start = now();
+        trainGeneration(trainer);
+        trainTime += now() - start;
+        if (g % 5 == 4 || g + 1 == generations) {
+            std::cout << "  generation " << trainer.generation << ": mean fitness " << trainer.meanFitness
+                << ", best " << trainer.bestFitness << std::endl;
+        }
+    }
+
+    float after = evaluatePolicy(trainer, trainer.policy, evalMatches, 1);
+
+    double matchTicks = (double)trainer.evaluations * trainer.config.ticks;
+    std::cout << "  " << generations / trainTime * 3600.0 << " generations/hour, "
+        << trainer.evaluations / trainTime << " evaluations/s (" << matchTicks / trainTime / 1e6
+        << "M match-ticks/s)" << std::endl;
+    std::cout << "  fitness against the bot: " << before << " before, " << after << " after" << std::endl;
+
+    stopTrainer(trainer);
+    return 0;
+}
+
+// value below which fraction _p_ of _values_ fall
+static double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+static int benchInput(int argc, char** argv) {
+    unsigned int noChanges = argOr(argc, argv, 0, 500);
+    unsigned int frameRate = argOr(argc, argv, 1, 60);
+    std::string path = argc > 2 ? argv[2] : "pong-input-bench.evdev";
+    frameRate = frameRate ? frameRate : 60;
+
+#ifdef __linux__
+    // without a recording, write one: presses and releases of the paddle keys about
+    // 10 ms apart, each followed by a sync like a real device
+    unsigned int state = 5;
+    if (argc <= 2) {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cout << "Could not write " << path << std::endl;
+            return -1;
+        }
+        const unsigned short codes[4] = { KEY_W, KEY_S, KEY_UP, KEY_DOWN };
+        bool held[4] = {};
+        double time = 1000.0;
+        for (unsigned int i = 0; i < noChanges; i++) {
+            time += 0.002 + randomRange(state, 0.0f, 0.016f);
+            unsigned int k = nextRandom(state) % 4;
+            held[k] = !held[k];
+            input_event evs[2] = {};
+            for (input_event& ev : evs) {
+                ev.input_event_sec = (long)time;
+                ev.input_event_usec = (long)((time - (long)time) * 1e6);
+            }
+            evs[0].type = EV_KEY;
+            evs[0].code = codes[k];
+            evs[0].value = held[k] ? 1 : 0;
+            evs[1].type = EV_SYN;
+            evs[1].code = SYN_REPORT;
+            fwrite(evs, sizeof(input_event), 2, file);
+        }
+        fclose(file);
+    }
+
+    std::cout << "input: replaying " << path << " into a " << frameRate << " Hz frame loop" << std::endl;
+
+    RawInput* input = new RawInput();
+    if (!startInputReplay(*input, path.c_str())) {
+        std::cout << "Could not replay " << path << std::endl;
+        delete input;
+        return -1;
+    }
+
+    // the game's frame loop: wait for the frame, take the changes stamped before it
+    // and split the step at each one
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    MatchBatch batch;
+    allocMatchBatch(batch, 1, 0);
+    resetMatch(batch, params, 0);
+
+    std::vector<double> toQueue, toSim, polledError;
+    double timestampedError = 0.0;
+    double period = 1.0 / frameRate;
+    double simClock = monotonicTime();
+    double nextFrame = simClock;
+    unsigned int keys = 0;
+    InputEvent event;
+    while (input->running.load() || input->head.load() != input->tail.load()) {
+        nextFrame += period;
+        std::this_thread::sleep_for(std::chrono::duration<double>(nextFrame - monotonicTime()));
+        double frameEnd = monotonicTime();
+
+        while (popInputEvent(*input, frameEnd, event)) {
+            double at = std::max(event.time, simClock);
+            stepMatches(batch, params, (float)(at - simClock));
+            simClock = at;
+            keys = event.keys;
+            batch.input[0][0] = keys & (1 << RAW_KEY_W) ? 1 : (keys & (1 << RAW_KEY_S) ? -1 : 0);
+            batch.input[1][0] = keys & (1 << RAW_KEY_UP) ? 1 : (keys & (1 << RAW_KEY_DOWN) ? -1 : 0);
+
+            toQueue.push_back(event.queued - event.time);
+            toSim.push_back(monotonicTime() - event.time);
+            recordInputLatency(*input, event);
+            // a change is late only if it is stamped before a step that already ran
+            timestampedError = std::max(timestampedError, at - event.time);
+            // polling at the start of a frame would apply it only from the frame's end
+            polledError.push_back(frameEnd - event.time);
+        }
+        stepMatches(batch, params, (float)(frameEnd - simClock));
+        simClock = frameEnd;
+    }
+    unsigned long long queued = input->queued.load();
+    unsigned long long dropped = input->dropped.load();
+    stopRawInput(*input);
+    freeMatchBatch(batch);
+
+    double polledMean = 0.0;
+    for (double e : polledError) {
+        polledMean += e;
+    }
+    polledMean /= std::max((size_t)1, polledError.size());
+
+    std::cout << "  " << toSim.size() << " key changes taken of " << queued << " queued, " << dropped << " dropped, "
+        << (keys ? "keys still held" : "all keys released") << std::endl;
+    std::cout << "  thread queueing delay: p50 " << percentile(toQueue, 0.5) * 1e6 << " us, p99 "
+        << percentile(toQueue, 0.99) * 1e6 << " us" << std::endl;
+    std::cout << "  event-to-sim latency: p50 " << percentile(toSim, 0.5) * 1e3 << " ms, p99 "
+        << percentile(toSim, 0.99) * 1e3 << " ms (histogram p99 below "
+        << inputLatencyPercentile(*input, 0.99) * 1e3 << " ms)" << std::endl;
+    std::cout << "  sim-time error of applied input: " << timestampedError * 1e3 << " ms max split at timestamps, "
+        << polledMean * 1e3 << " ms mean / " << percentile(polledError, 1.0) * 1e3 << " ms max polled per frame" << std::endl;
+    delete input;
+    return 0;
+#else
+    std::cout << "input: evdev is linux only" << std::endl;
+    return -1;
+#endif
+}
+
+static int benchHitch(int argc, char** argv) {
+    unsigned int noFrames = argOr(argc, argv, 0, 2000);
+    unsigned int spikeEvery = argOr(argc, argv, 1, 400);
+    std::string directory = argc > 2 ? argv[2] : ".";
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+    spikeEvery = spikeEvery ? spikeEvery : 400;
+
+    std::cout << "hitch: " << noFrames << " frames, a slow one every " << spikeEvery << std::endl;
+
+    // cost of a zone with the profiler on and off
+    const unsigned int zones = 1 << 20;
+    double start = now();
+    for (unsigned int i = 0; i < zones; i++) {
+        PROFILE_ZONE("bench zone");
+    }
+    double onTime = now() - start;
+    profilerEnabled = false;
+    start = now();
+    for (unsigned int i = 0; i < zones; i++) {
+        PROFILE_ZONE("bench zone");
+    }
+    double offTime = now() - start;
+    profilerEnabled = true;
+    std::cout << "  zone: " << onTime / zones * 1e9 << " ns recording, " << offTime / zones * 1e9 << " ns off" << std::endl;
+
+    // frames of simulation work with zones, key changes and a spike now and then
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, 1 << 14, 0)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        return -1;
+    }
+    scatterMatches(batch, params, 99);
+
+    HitchDetector* detector = new HitchDetector();
+    HitchParams hitchParams = defaultHitchParams();
+    hitchParams.cooldown = 0.5f;
+    hitchParams.history = 1.0f;
+    hitchParams.directory = directory.c_str();
+    if (!startHitchDetector(*detector, hitchParams)) {
+        std::cout << "Could not start hitch detector" << std::endl;
+        freeMatchBatch(batch);
+        delete detector;
+        return -1;
+    }
+    profilerThreadName("bench");
+
+    std::vector<double> checks;
+    unsigned int captured = 0;
+    for (unsigned int f = 0; f < noFrames; f++) {
+        unsigned long long frameStart = profilerTime();
+        {
+            PROFILE_ZONE("input");
+            if (f % 7 == 0) {
+                traceInstant(TRACE_INPUT, "keys", f & 3);
+            }
+            botInputs(batch, params);
+        }
+        {
+            PROFILE_ZONE("physics");
+            stepMatches(batch, params, 1.0f / 240.0f);
+        }
+        if (f % spikeEvery == spikeEvery - 1) {
+            PROFILE_GL("glBufferData (large)");
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        }
+        captured += endFrame(*detector, frameStart, profilerTime(), batch, 0, f);
+        checks.push_back(detector->checkTime * 1e-9);
+    }
+    stopHitchDetector(*detector);
+
+    std::cout << "  " << detector->hitches << " hitches, " << captured << " captured, " << detector->dumps
+        << " traces written, " << detector->skipped << " skipped by the rate limit" << std::endl;
+    std::cout << "  render thread per frame: p50 " << percentile(checks, 0.5) * 1e6 << " us, max "
+        << percentile(checks, 1.0) * 1e6 << " us" << std::endl;
+    std::cout << "  writer: " << detector->capture.count << " records in the last trace, written in "
+        << detector->writeTime * 1e3 << " ms" << std::endl;
+
+    freeMatchBatch(batch);
+    delete detector;
+    return 0;
+}
+
+// per-zone counters for a memory-bound, a branch-bound and a streaming loop next to
+// the simulation, and what reading the counters adds to a zone
+// args: [rounds] [megabytes]
+static int benchCounters(int argc, char** argv) {
+    unsigned int rounds = argOr(argc, argv, 0, 20);
+    unsigned int megabytes = argOr(argc, argv, 1, 256);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+
+    std::cout << "counters: " << rounds << " rounds, " << megabytes << " MB table" << std::endl;
+
+    // zone cost with the counters off and on
+    const unsigned int zones = 1 << 18;
+    double start = now();
+    for (unsigned int i = 0; i < zones; i++) {
+        PROFILE_ZONE("bench zone");
+    }
+    double offTime = now() - start;
+    profilerCounters = true;
+    bool available = threadCounters();
+    start = now();
+    for (unsigned int i = 0; i < zones; i++) {
+        PROFILE_ZONE("bench zone");
+    }
+    double onTime = now() - start;
+    std::cout << "  hardware counters " << (available ? "open" : "unavailable") << ", zone: "
+        << offTime / zones * 1e9 << " ns without, " << onTime / zones * 1e9 << " ns with" << std::endl;
+
+    size_t count = std::max((size_t)megabytes << 17, (size_t)1 << 22);
+    std::vector<unsigned long long> table(count);
+    unsigned int seed = 7;
+    for (size_t i = 0; i < count; i++) {
+        table[i] = (unsigned long long)nextRandom(seed) << 32 | nextRandom(seed);
+    }
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, 1 << 16, 0)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        return -1;
+    }
+    scatterMatches(batch, params, 3);
+    resetZoneStats();
+
+    unsigned long long sink = 0;
+    for (unsigned int r = 0; r < rounds; r++) {
+        {
+            // dependent loads all over the table
+            PROFILE_ZONE("gather");
+            size_t i = r;
+            for (unsigned int j = 0; j < (1 << 18); j++) {
+                i = (table[i] ^ j) % count;
+                sink += i;
+            }
+        }
+        {
+            // a coin flip per element
+            PROFILE_ZONE("branches");
+            for (size_t i = 0; i < (1 << 22); i++) {
+                if (table[i] & 1) {
+                    sink += table[i] >> 7;
+                }
+                else {
+                    sink ^= table[i];
+                }
+            }
+        }
+        {
+            PROFILE_ZONE("stream");
+            for (size_t i = 0; i < (1 << 22); i++) {
+                sink += table[i];
+            }
+        }
+        {
+            PROFILE_ZONE("step");
+            botInputs(batch, params);
+            stepMatches(batch, params, 1.0f / 240.0f);
+        }
+    }
+    std::cout << "  (" << sink % 10 << ")" << std::endl;
+    printZoneStats(stdout);
+    profilerCounters = false;
+
+    freeMatchBatch(batch);
+    return 0;
+}
+
+// bytes per match of a batch at a few sizes and what the trainer holds, with the
+// high-water marks afterwards
+// args: [largest batch]
+static int benchMemory(int argc, char** argv) {
+    unsigned int largest = argOr(argc, argv, 0, 1 << 20);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+
+    std::cout << "memory: batches up to " << largest << " matches" << std::endl;
+    for (unsigned int matches = 1; matches <= largest; matches *= 16) {
+        MatchBatch batch;
+        if (!allocMatchBatch(batch, matches, 0)) {
+            std::cout << "Could not allocate batch" << std::endl;
+            return -1;
+        }
+        std::cout << "  " << matches << " matches: " << batch.block.size / (double)matches << " bytes per match, "
+            << memoryStats(MEMORY_SIM).bytes / 1048576.0 << " MB" << std::endl;
+        freeMatchBatch(batch);
+    }
+
+    Trainer trainer;
+    EvolutionParams config = defaultEvolutionParams();
+    if (!startTrainer(trainer, params, config)) {
+        std::cout << "Could not start trainer" << std::endl;
+        return -1;
+    }
+    std::cout << "  trainer with " << trainer.noThreads << " workers:" << std::endl;
+    std::cout.flush();
+    printMemoryStats(stdout);
+    stopTrainer(trainer);
+
+    std::cout << "  after release:" << std::endl;
+    std::cout.flush();
+    printMemoryStats(stdout);
+    return 0;
+}
+
+// reallocations of an instance buffer over a count that wanders and bursts (balls
+// coming and going, particle bursts that decay): reallocating on every change,
+// doubling without shrinking, and doubling with the shrink hysteresis
+// args: [frames] [burst size]
+static int benchInstances(int argc, char** argv) {
+    unsigned int frames = argOr(argc, argv, 0, 36000);
+    unsigned int burst = argOr(argc, argv, 1, 100000);
+
+    std::cout << "instances: " << frames << " frames, bursts of " << burst << std::endl;
+
+    std::vector<unsigned int> counts(frames);
+    unsigned int seed = 5;
+    float steady = 1000.0f;
+    float particles = 0.0f;
+    for (unsigned int f = 0; f < frames; f++) {
+        steady = std::max(0.0f, steady + randomRange(seed, -8.0f, 8.0f));
+        if (nextRandom(seed) % 600 == 0) {
+            particles += (float)burst;
+        }
+        particles *= 0.97f;
+        counts[f] = (unsigned int)(steady + particles);
+    }
+
+    const char* names[] = { "on every change", "doubling", "doubling + shrink" };
+    for (int mode = 0; mode < 3; mode++) {
+        InstanceBuffer instances;
+        initInstanceBuffer(instances, sizeof(vec2));
+        unsigned long long reallocations = 0;
+        double slack = 0.0;
+        unsigned int peak = 0;
+        for (unsigned int f = 0; f < frames; f++) {
+            unsigned int count = counts[f];
+            unsigned int capacity = instances.capacity;
+            if (mode == 0) {
+                capacity = count;
+            }
+            else {
+                capacity = instanceCapacity(instances, count);
+                if (mode == 1) {
+                    capacity = std::max(capacity, instances.capacity);
+                }
+            }
+            reallocations += capacity != instances.capacity;
+            instances.capacity = capacity;
+            peak = std::max(peak, capacity);
+            slack += capacity - count;
+        }
+        std::cout << "  " << names[mode] << ": " << reallocations << " reallocations, " << slack / frames * sizeof(vec2) / 1024.0
+            << " KB unused on average, " << peak * sizeof(vec2) / 1024.0 << " KB peak" << std::endl;
+    }
+    return 0;
+}
+
+// instance fill of a large batch: gathered into an array and copied to the
+// destination like a buffer upload, then written in place by 1, 2, 4... workers, with
+// the workers' output checked against the serial fill
+// args: [matches] [max threads] [frames]
+static int benchFill(int argc, char** argv) {
+    unsigned int matches = argOr(argc, argv, 0, 1 << 18);
+    unsigned int maxThreads = argOr(argc, argv, 1, std::max(1u, std::thread::hardware_concurrency()));
+    unsigned int frames = argOr(argc, argv, 2, 200);
+    SimParams params = defaultSimParams(800.0f, 600.0f);
+
+    std::cout << "fill: " << matches << " matches, " << frames << " frames, up to " << maxThreads << " threads" << std::endl;
+
+    MatchBatch batch;
+    if (!allocMatchBatch(batch, matches, 0)) {
+        std::cout << "Could not allocate batch" << std::endl;
+        return -1;
+    }
+    scatterMatches(batch, params, 99);
+    TileLayout layout = tileLayout(params, matches);
+
+    // stands in for the mapped region: paddles, then balls from the next cache line
+    size_t bytes = spectatorRegionBytes(matches);
+    size_t paddleBytes = paddleRegionBytes(matches);
+    std::vector<unsigned char> staging(bytes);
+    std::vector<unsigned char> expected(bytes);
+    LargeBlock block;
+    if (!allocLarge(block, bytes, 0)) {
+        std::cout << "Could not allocate destination" << std::endl;
+        freeMatchBatch(batch);
+        return -1;
+    }
+    unsigned char* region = (unsigned char*)block.ptr;
+    fillInstances(batch, params, layout, 0, matches,
+        (SpectatorInstance*)expected.data(), (SpectatorInstance*)(expected.data() + paddleBytes));
+
+    double start = now();
+    for (unsigned int f = 0; f < frames; f++) {
+        fillInstances(batch, params, layout, 0, matches,
+            (SpectatorInstance*)staging.data(), (SpectatorInstance*)(staging.data() + paddleBytes));
+        memcpy(region, staging.data(), bytes);
+    }
+    double copied = (now() - start) / frames;
+    std::cout << "  gather + copy: " << copied * 1e3 << " ms per frame" << std::endl;
+
+    int result = 0;
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+        InstanceFiller filler;
+        startInstanceFiller(filler, threads);
+        memset(region, 0, bytes);
+        start = now();
+        for (unsigned int f = 0; f < frames; f++) {
+            fillParallel(filler, batch, params, layout,
+                (SpectatorInstance*)region, (SpectatorInstance*)(region + paddleBytes));
+        }
+        double filled = (now() - start) / frames;
+        stopInstanceFiller(filler);
+
+        bool same = memcmp(region, expected.data(), bytes) == 0;
+        result = same ? result : -1;
+        std::cout << "  in place, " << threads << " threads: " << filled * 1e3 << " ms per frame, "
+            << bytes / filled / 1e9 << " GB/s, " << copied / filled << "x" << (same ? "" : " (MISMATCH)") << std::endl;
+    }
+
+    freeLarge(block);
+    freeMatchBatch(batch);
+    return result;
+}
+
+// draw keys of a scene with a few programs, meshes and materials in submission
+// order: building and radix sorting them against std::stable_sort on the same pairs,
+// and the draws and state changes before and after merging runs
+// args: [renderables] [frames]
+static int benchDrawKeys(int argc, char** argv) {
+    unsigned int renderables = argOr(argc, argv, 0, 100000);
+    unsigned int frames = argOr(argc, argv, 1, 100);
+
+    std::cout << "drawkeys: " << renderables << " renderables, " << frames << " frames" << std::endl;
+
+    // 4 programs, 16 meshes, 64 materials, a tenth blended
+    struct Renderable {
+        RenderPass pass;
+        unsigned int program;
+        unsigned int mesh;
+        unsigned int material;
+        float depth;
+    };
+    std::vector<Renderable> scene(renderables);
+    unsigned int seed = 17;
+    for (Renderable& r : scene) {
+        r.pass = nextRandom(seed) % 10 == 0 ? PASS_BLENDED : PASS_OPAQUE;
+        r.program = nextRandom(seed) % 4;
+        r.mesh = nextRandom(seed) % 16;
+        r.material = nextRandom(seed) % 64;
+        r.depth = randomRange(seed, 0.0f, 1.0f);
+    }
+
+    DrawQueue queue;
+    std::vector<std::pair<unsigned long long, unsigned int>> pairs;
+    std::vector<DrawBatch> batches;
+    double buildTime = 0.0;
+    double radixTime = 0.0;
+    double stdTime = 0.0;
+    unsigned int submitted = 0;
+    bool same = true;
+    for (unsigned int f = 0; f < frames; f++) {
+        // everything moves a little every frame
+        for (Renderable& r : scene) {
+            r.depth = std::min(std::max(r.depth + randomRange(seed, -0.01f, 0.01f), 0.0f), 1.0f);
+        }
+
+        double start = now();
+        clearDrawQueue(queue);
+        for (unsigned int i = 0; i < renderables; i++) {
+            const Renderable& r = scene[i];
+            pushDraw(queue, drawKey(r.pass, r.program, r.mesh, r.material, r.depth), i);
+        }
+        buildTime += now() - start;
+
+        // draws in submission order: a new one wherever the state changes
+        submitted = renderables ? 1 : 0;
+        for (unsigned int i = 1; i < renderables; i++) {
+            submitted += !sameDrawState(queue.keys[i - 1], queue.keys[i]);
+        }
+
+        pairs.resize(renderables);
+        for (unsigned int i = 0; i < renderables; i++) {
+            pairs[i] = std::make_pair(queue.keys[i], queue.items[i]);
+        }
+        start = now();
+        std::stable_sort(pairs.begin(), pairs.end(),
+            [](const std::pair<unsigned long long, unsigned int>& a, const std::pair<unsigned long long, unsigned int>& b) {
+                return a.first < b.first;
+            });
+        stdTime += now() - start;
+
+        start = now();
+        sortDrawQueue(queue);
+        radixTime += now() - start;
+
+        for (unsigned int i = 0; i < renderables && same; i++) {
+            same = pairs[i].first == queue.keys[i] && pairs[i].second == queue.items[i];
+        }
+    }
+
+    unsigned int draws = mergeDraws(queue, batches);
+    unsigned int programChanges = 0;
+    unsigned int meshChanges = 0;
+    for (unsigned int b = 1; b < draws; b++) {
+        programChanges += drawProgram(batches[b].key) != drawProgram(batches[b - 1].key);
+        meshChanges += drawMesh(batches[b].key) != drawMesh(batches[b - 1].key);
+    }
+
+    std::cout << "  build keys: " << buildTime / frames * 1e3 << " ms per frame" << std::endl;
+    std::cout << "  radix sort: " << radixTime / frames * 1e3 << " ms per frame (" << queue.digitPasses
+        << " of 8 byte passes), std::stable_sort: " << stdTime / frames * 1e3 << " ms per frame"
+        << (same ? "" : " (MISMATCH)") << std::endl;
+    std::cout << "  draws: " << submitted << " in submission order, " << draws << " merged ("
+        << (double)submitted / std::max(draws, 1u) << "x fewer), " << programChanges << " program and "
+        << meshChanges << " mesh changes" << std::endl;
+    return same ? 0 : -1;
+}
+
+// dynamic objects that spawn and despawn every frame: a slot map against an
+// unordered_map keyed by id and a vector of slots with a free list and alive flags,
+// timing the churn, a pass updating every object and lookups by handle, with a check
+// that erased handles find nothing
+// args: [objects] [frames] [percent replaced per frame]
+static int benchSlotMap(int argc, char** argv) {
+    unsigned int objects = argOr(argc, argv, 0, 100000);
+    unsigned int frames = argOr(argc, argv, 1, 200);
+    unsigned int churn = std::max(1u, objects * argOr(argc, argv, 2, 5) / 100);
+    const float dt = 1.0f / 60.0f;
+
+    std::cout << "slotmap: " << objects << " objects, " << frames << " frames, " << churn << " replaced per frame" << std::endl;
+
+    // a particle
+    struct Object {
+        vec2 position;
+        vec2 velocity;
+        float life;
+    };
+    auto spawn = [](unsigned int& seed) {
+        Object object;
+        object.position = { randomRange(seed, 0.0f, 800.0f), randomRange(seed, 0.0f, 600.0f) };
+        object.velocity = { randomRange(seed, -100.0f, 100.0f), randomRange(seed, -100.0f, 100.0f) };
+        object.life = randomRange(seed, 1.0f, 5.0f);
+        return object;
+    };
+    auto update = [dt](Object& object) {
+        object.position.x += object.velocity.x * dt;
+        object.position.y += object.velocity.y * dt;
+        object.life -= dt;
+    };
+
+    // the same objects come and go in every container
+    const char* names[] = { "slot map", "unordered_map", "vector + free list" };
+    bool stale = true;
+    for (int mode = 0; mode < 3; mode++) {
+        unsigned int seed = 23;
+        double churnTime = 0.0;
+        double iterateTime = 0.0;
+        double lookupTime = 0.0;
+        float checksum = 0.0f;
+
+        SlotMap<Object> slots;
+        std::vector<SlotHandle> handles;
+        std::unordered_map<unsigned int, Object> byId;
+        unsigned int nextId = 0;
+        std::vector<unsigned int> ids;
+        struct Entry {
+            Object object;
+            bool alive;
+        };
+        std::vector<Entry> entries;
+        std::vector<unsigned int> freeEntries;
+
+        reserveSlots(slots, objects);
+        byId.reserve(objects);
+        entries.reserve(objects);
+        for (unsigned int i = 0; i < objects; i++) {
+            Object object = spawn(seed);
+            if (mode == 0) {
+                handles.push_back(insertSlot(slots, object));
+            }
+            else if (mode == 1) {
+                byId[nextId] = object;
+                ids.push_back(nextId++);
+            }
+            else {
+                entries.push_back({ object, true });
+                ids.push_back(i);
+            }
+        }
+
+        for (unsigned int f = 0; f < frames; f++) {
+            // random objects despawn, as many spawn
+            double start = now();
+            for (unsigned int c = 0; c < churn; c++) {
+                unsigned int victim = nextRandom(seed) % objects;
+                Object object = spawn(seed);
+                if (mode == 0) {
+                    SlotHandle old = handles[victim];
+                    eraseSlot(slots, old);
+                    handles[victim] = insertSlot(slots, object);
+                    stale = stale && getSlot(slots, old) == NULL;
+                }
+                else if (mode == 1) {
+                    byId.erase(ids[victim]);
+                    byId[nextId] = object;
+                    ids[victim] = nextId++;
+                }
+                else {
+                    entries[ids[victim]].alive = false;
+                    freeEntries.push_back(ids[victim]);
+                    unsigned int e = freeEntries.back();
+                    freeEntries.pop_back();
+                    entries[e] = { object, true };
+                    ids[victim] = e;
+                }
+            }
+            churnTime += now() - start;
+
+            start = now();
+            if (mode == 0) {
+                for (Object& object : slots.values) {
+                    update(object);
+                }
+            }
+            else if (mode == 1) {
+                for (auto& entry : byId) {
+                    update(entry.second);
+                }
+            }
+            else {
+                for (Entry& entry : entries) {
+                    if (entry.alive) {
+                        update(entry.object);
+                    }
+                }
+            }
+            iterateTime += now() - start;
+
+            // follow a tenth of the handles, in the order they were handed out
+            start = now();
+            for (unsigned int i = f % 10; i < objects; i += 10) {
+                if (mode == 0) {
+                    checksum += getSlot(slots, handles[i])->life;
+                }
+                else if (mode == 1) {
+                    checksum += byId.find(ids[i])->second.life;
+                }
+                else {
+                    checksum += entries[ids[i]].object.life;
+                }
+            }
+            lookupTime += now() - start;
+        }
+
+        std::cout << "  " << names[mode] << ": churn " << churnTime / frames * 1e3 << " ms, iterate "
+            << iterateTime / frames * 1e3 << " ms, lookups " << lookupTime / frames * 1e3 << " ms per frame (checksum "
+            << checksum << ")" << std::endl;
+    }
+
+    std::cout << "  erased handles " << (stale ? "found nothing" : "STILL FOUND VALUES") << std::endl;
+    return stale ? 0 : -1;
+}
+
+int runBenchmarks(int argc, char** argv) {
+    if (argc < 1) {
+        std::cout << "Usage: Game --bench <step|collide|spin|contact|hash|replay|chunks|io|dataset|experience|evolve|input|hitch|counters|memory|instances|fill|drawkeys|slotmap> [args]" << std::endl;
+        return -1;
+    }
+
+    std::string name = argv[0];
+    if (name == "step") {
+        return benchStep(argc - 1, argv + 1);
+    }
+    if (name == "collide") {
+        return benchCollide(argc - 1, argv + 1);
+    }
+    if (name == "spin") {
+        return benchSpin(argc - 1, argv + 1);
+    }
+    if (name == "contact") {
+        return benchContact(argc - 1, argv + 1);
+    }
+    if (name == "hash") {
+        return benchHash(argc - 1, argv + 1);
+    }
+    if (name == "replay") {
+        return benchReplay(argc - 1, argv + 1);
+    }
+    if (name == "chunks") {
+        return benchChunks(argc - 1, argv + 1);
+    }
+    if (name == "io") {
+        return benchIO(argc - 1, argv + 1);
+    }
+    if (name == "dataset") {
+        return benchDataset(argc - 1, argv + 1);
+    }
+    if (name == "experience") {
+        return benchExperience(argc - 1, argv + 1);
+    }
+    if (name == "evolve") {
+        return benchEvolve(argc - 1, argv + 1);
+    }
+    if (name == "input") {
+        return benchInput(argc - 1, argv + 1);
+    }
+    if (name == "hitch") {
+        return benchHitch(argc - 1, argv + 1);
+    }
+    if (name == "counters") {
+        return benchCounters(argc - 1, argv + 1);
+    }
+    if (name == "memory") {
+        return benchMemory(argc - 1, argv + 1);
+    }
+    if (name == "instances") {
+        return benchInstances(argc - 1, argv + 1);
+    }
+    if (name == "fill") {
+        return benchFill(argc - 1, argv + 1);
+    }
+    if (name == "drawkeys") {
+        return benchDrawKeys(argc - 1, argv + 1);
+    }
+    if (name == "slotmap") {
+        return benchSlotMap(argc - 1, argv + 1);
+    }
+
+    std::cout << "Unknown benchmark " << name << std::endl;
+    return -1;
+}
@@ -0,0 +1,12 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+    headless benchmarks
+    run with: Game --bench <name> [args]
+*/
+
+// run the benchmark named by argv[0], returns the process exit code
+int runBenchmarks(int argc, char** argv);
+
+#endif
@@ -0,0 +1,180 @@
+#include "chunkstore.h"
+#include "statehash.h"
+
+#include <cstring>
+
+/*
+    tables
+*/
+
+// random value per byte for the gear hash
+static unsigned long long gearTable[256];
+
+// fixed seed so chunk boundaries match across runs and machines
+static bool initGear() {
+    unsigned long long state = 0x5851f42d4c957f2dull;
+    for (int b = 0; b < 256; b++) {
+        unsigned long long z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        gearTable[b] = z ^ (z >> 31);
+    }
+    return true;
+}
+
+static bool gearReady = initGear();
+
+/*
+    chunking
+*/
+
+ChunkParams defaultChunkParams() {
+    ChunkParams params;
+    params.minSize = 256;
+    params.avgSize = 1024;
+    params.maxSize = 8192;
+    return params;
+}
+
+// mask of the top _bits_ bits (the gear hash mixes the newest bytes into the low
+// bits, the top bits cover the last 64 bytes)
+static inline unsigned long long topBits(unsigned int bits) {
+    return bits ? ~0ull << (64 - bits) : 0;
+}
+
+static inline unsigned int log2u(unsigned int v) {
+    unsigned int bits = 0;
+    while (v >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+size_t nextChunk(const unsigned char* data, size_t size, const ChunkParams& params) {
+    if (size <= params.minSize) {
+        return size;
+    }
+
+    // normalized chunking: a stricter pattern before the average size and a looser
+    // one after it pulls chunk sizes toward the average
+    unsigned int bits = log2u(params.avgSize);
+    unsigned long long strict = topBits(bits + 2);
+    unsigned long long loose = topBits(bits > 2 ? bits - 2 : 0);
+    size_t normal = size < params.avgSize ? size : params.avgSize;
+    size_t end = size < params.maxSize ? size : params.maxSize;
+
+    unsigned long long h = 0;
+    size_t i = params.minSize;
+    for (; i < normal; i++) {
+        h = (h << 1) + gearTable[data[i]];
+        if (!(h & strict)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; i++) {
+        h = (h << 1) + gearTable[data[i]];
+        if (!(h & loose)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+static inline unsigned long long mix(unsigned long long h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 33);
+}
+
+unsigned long long chunkHash(const unsigned char* data, size_t size) {
+    // 8 bytes at a time through a multiply, finished with a murmur3 mix
+    const unsigned long long k = 0x9e3779b97f4a7c15ull;
+    unsigned long long h = size * k;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        unsigned long long v;
+        memcpy(&v, data + i, 8);
+        h = (h ^ mix(v)) * k;
+        h = (h << 27) | (h >> 37);
+    }
+    unsigned long long tail = 0;
+    memcpy(&tail, data + i, size - i);
+    return mix(h ^ mix(tail ^ (size - i)));
+}
+
+/*
+    store
+*/
+
+void initChunkStore(ChunkStore& store) {
+    store.pack.clear();
+    store.index.clear();
+    store.ingestedBytes = 0;
+    store.ingestedChunks = 0;
+}
+
+bool ingest(ChunkStore& store, const ChunkParams& params, const unsigned char* data, size_t size, Manifest& manifest) {
+    manifest.size = size;
+    manifest.crc = crc32c(data, size);
+    manifest.chunks.clear();
+
+    size_t pos = 0;
+    while (pos < size) {
+        size_t length = nextChunk(data + pos, size - pos, params);
+        unsigned long long hash = chunkHash(data + pos, length);
+
+        auto found = store.index.find(hash);
+        if (found == store.index.end()) {
+            ChunkEntry entry;
+            entry.offset = store.pack.size();
+            entry.size = (unsigned int)length;
+            entry.refs = 1;
+            entry.crc = crc32c(data + pos, length);
+            store.pack.insert(store.pack.end(), data + pos, data + pos + length);
+            store.index.emplace(hash, entry);
+        }
+        else {
+            // same hash must mean same bytes
+            const ChunkEntry& entry = found->second;
+            if (entry.size != length || memcmp(store.pack.data() + entry.offset, data + pos, length)) {
+                return false;
+            }
+            found->second.refs++;
+        }
+
+        manifest.chunks.push_back(hash);
+        pos += length;
+    }
+
+    store.ingestedBytes += size;
+    store.ingestedChunks += manifest.chunks.size();
+    return true;
+}
+
+bool restore(const ChunkStore& store, const Manifest& manifest, std::vector<unsigned char>& out) {
+    out.clear();
+    out.reserve(manifest.size);
+    unsigned int crc = 0;
+    for (unsigned long long hash : manifest.chunks) {
+        auto found = store.index.find(hash);
+        if (found == store.index.end()) {
+            return false;
+        }
+        const ChunkEntry& entry = found->second;
+        const unsigned char* chunk = store.pack.data() + entry.offset;
+        if (crc32c(chunk, entry.size) != entry.crc) {
+            return false;
+        }
+        crc = crc32c(chunk, entry.size, crc);
+        out.insert(out.end(), chunk, chunk + entry.size);
+    }
+    return out.size() == manifest.size && crc == manifest.crc;
+}
+
+size_t storedBytes(const ChunkStore& store, size_t manifestChunks, size_t noManifests) {
+    // index entry: hash, offset, size, crc; manifest: size and crc plus a hash per chunk
+    size_t indexBytes = store.index.size() * (8 + 8 + 4 + 4);
+    return store.pack.size() + indexBytes + manifestChunks * 8 + noManifests * (8 + 4);
+}
@@ -0,0 +1,69 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/*
+    content-addressed chunk store for replay and telemetry archives
+    archives are cut into chunks where a rolling gear hash of the content hits a
+    boundary pattern, so an insert or change only moves the boundaries next to it;
+    each distinct chunk is stored once under its hash and an archive is kept as a
+    manifest listing its chunks
+    every chunk and every manifest keeps a CRC32C of its bytes, and restore checks
+    both, so a damaged pack is found rather than handed out
+*/
+
+// chunk size limits in bytes
+struct ChunkParams {
+    unsigned int minSize;
+    unsigned int avgSize;   // power of 2
+    unsigned int maxSize;
+};
+
+// limits sized for single-match replays (a few KB each)
+ChunkParams defaultChunkParams();
+
+// stored chunk
+struct ChunkEntry {
+    size_t offset;          // into the pack
+    unsigned int size;
+    unsigned int refs;      // manifests using the chunk
+    unsigned int crc;       // CRC32C of the chunk
+};
+
+struct ChunkStore {
+    std::vector<unsigned char> pack;    // distinct chunks back to back
+    std::unordered_map<unsigned long long, ChunkEntry> index;
+    size_t ingestedBytes;   // bytes given to ingest
+    size_t ingestedChunks;
+};
+
+// archive as the list of its chunks
+struct Manifest {
+    size_t size;
+    unsigned int crc;       // CRC32C of the archive
+    std::vector<unsigned long long> chunks;
+};
+
+// empty store
+void initChunkStore(ChunkStore& store);
+
+// length of the chunk starting at _data_ (at most _size_)
+size_t nextChunk(const unsigned char* data, size_t size, const ChunkParams& params);
+
+// 64-bit hash identifying a chunk
+unsigned long long chunkHash(const unsigned char* data, size_t size);
+
+// add an archive to the store and describe it in _manifest_
+// returns false on a hash collision (chunk bytes differ from the stored chunk)
+bool ingest(ChunkStore& store, const ChunkParams& params, const unsigned char* data, size_t size, Manifest& manifest);
+
+// rebuild an archive from its manifest, false if a chunk is missing or damaged
+bool restore(const ChunkStore& store, const Manifest& manifest, std::vector<unsigned char>& out);
+
+// bytes the store keeps: distinct chunks, index entries and manifests of _noManifests_ archives
+size_t storedBytes(const ChunkStore& store, size_t manifestChunks, size_t noManifests);
+
+#endif
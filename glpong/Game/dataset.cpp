@@ -0,0 +1,309 @@
+#include "dataset.h"
+#include "memstats.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define PREFETCH(p)
+#endif
+
+static_assert(sizeof(TrainingSample) == 64, "samples are one cache line");
+
+const unsigned int datasetVersion = 1;
+
+// first bytes of a shard
+struct ShardHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int sampleSize;
+    unsigned int shard;
+    unsigned int count;         // samples in use, the rest of the shard is zero
+    unsigned int capacity;
+};
+
+// first bytes of index.bin, followed by the sample count of every shard
+struct IndexHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int sampleSize;
+    unsigned int shardSamples;
+    unsigned int noShards;
+    unsigned long long count;
+};
+
+static const char shardMagic[8] = { 'P', 'O', 'N', 'G', 'S', 'H', 'R', 'D' };
+static const char indexMagic[8] = { 'P', 'O', 'N', 'G', 'I', 'D', 'X', '0' };
+
+static std::string shardPath(const char* directory, unsigned int shard) {
+    char name[32];
+    snprintf(name, sizeof(name), "/shard%05u.bin", shard);
+    return std::string(directory) + name;
+}
+
+/*
+    capture
+*/
+
+void captureSample(TrainingSample& sample, const MatchBatch& batch, unsigned int m, float dt, unsigned int tick, unsigned int session) {
+    memset(&sample, 0, sizeof(sample));
+    sample.ballX = batch.ballX[m];
+    sample.ballY = batch.ballY[m];
+    sample.ballVX = batch.ballVX[m];
+    sample.ballVY = batch.ballVY[m];
+    sample.ballSpin = batch.ballSpin[m];
+    for (int i = 0; i < 2; i++) {
+        sample.paddleY[i] = batch.paddleY[i][m];
+        sample.paddleV[i] = batch.paddleV[i][m];
+        sample.paddleAngle[i] = batch.paddleAngle[i][m];
+        sample.input[i] = batch.input[i][m];
+        sample.tiltInput[i] = batch.tiltInput[i][m];
+    }
+    sample.dt = dt;
+    sample.tick = tick;
+    sample.session = session;
+}
+
+/*
+    writing
+*/
+
+static unsigned int nextRandom(unsigned int& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// uniform 64-bit random index below _n_
+static unsigned long long randomBelow(unsigned int& state, unsigned long long n) {
+    // two statements, the order of the operands of | is unspecified
+    unsigned long long high = nextRandom(state);
+    unsigned long long r = high << 32 | nextRandom(state);
+    return r % n;
+}
+
+bool writeDataset(const char* directory, TrainingSample* samples, size_t count, unsigned int shardSamples, unsigned int seed) {
+#ifdef _WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+
+    // Fisher-Yates over the whole capture, so every shard mixes every session
+    unsigned int state = seed ? seed : 1;
+    for (size_t i = count; i > 1; i--) {
+        size_t j = (size_t)randomBelow(state, i);
+        TrainingSample tmp = samples[i - 1];
+        samples[i - 1] = samples[j];
+        samples[j] = tmp;
+    }
+
+    unsigned int noShards = (unsigned int)((count + shardSamples - 1) / shardSamples);
+    std::vector<unsigned int> shardCounts(noShards);
+    std::vector<unsigned char> header(DATASET_HEADER_SIZE);
+    std::vector<TrainingSample> zeros(shardSamples);
+    memset(zeros.data(), 0, shardSamples * sizeof(TrainingSample));
+
+    for (unsigned int s = 0; s < noShards; s++) {
+        size_t first = (size_t)s * shardSamples;
+        unsigned int n = (unsigned int)(count - first < shardSamples ? count - first : shardSamples);
+        shardCounts[s] = n;
+
+        ShardHeader shard;
+        memset(&shard, 0, sizeof(shard));
+        memcpy(shard.magic, shardMagic, sizeof(shard.magic));
+        shard.version = datasetVersion;
+        shard.sampleSize = sizeof(TrainingSample);
+        shard.shard = s;
+        shard.count = n;
+        shard.capacity = shardSamples;
+        memset(header.data(), 0, header.size());
+        memcpy(header.data(), &shard, sizeof(shard));
+
+        FILE* file = fopen(shardPath(directory, s).c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        // every shard has the same size, the last one is padded with zeros
+        bool ok = fwrite(header.data(), 1, header.size(), file) == header.size() &&
+            fwrite(samples + first, sizeof(TrainingSample), n, file) == n &&
+            fwrite(zeros.data(), sizeof(TrainingSample), shardSamples - n, file) == shardSamples - n;
+        ok = fclose(file) == 0 && ok;
+        if (!ok) {
+            return false;
+        }
+    }
+
+    IndexHeader index;
+    memset(&index, 0, sizeof(index));
+    memcpy(index.magic, indexMagic, sizeof(index.magic));
+    index.version = datasetVersion;
+    index.sampleSize = sizeof(TrainingSample);
+    index.shardSamples = shardSamples;
+    index.noShards = noShards;
+    index.count = count;
+
+    FILE* file = fopen((std::string(directory) + "/index.bin").c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(&index, sizeof(index), 1, file) == 1 &&
+        fwrite(shardCounts.data(), sizeof(unsigned int), noShards, file) == noShards;
+    return fclose(file) == 0 && ok;
+}
+
+/*
+    mapping
+*/
+
+#ifdef _WIN32
+
+static bool mapFile(MappedFile& mapped, const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = GetFileSizeEx(file, &size) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+    mapped.ptr = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mapped.ptr) {
+        CloseHandle(mapping);
+        return false;
+    }
+    mapped.size = (size_t)size.QuadPart;
+    mapped.handle = mapping;
+    return true;
+}
+
+static void unmapFile(MappedFile& mapped) {
+    UnmapViewOfFile(mapped.ptr);
+    CloseHandle((HANDLE)mapped.handle);
+    mapped.ptr = NULL;
+}
+
+#else
+
+static bool mapFile(MappedFile& mapped, const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !st.st_size) {
+        close(fd);
+        return false;
+    }
+    void* ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    // minibatches jump around, so read the whole shard in rather than page by page
+    madvise(ptr, (size_t)st.st_size, MADV_WILLNEED);
+    mapped.ptr = (const unsigned char*)ptr;
+    mapped.size = (size_t)st.st_size;
+    mapped.handle = NULL;
+    return true;
+}
+
+static void unmapFile(MappedFile& mapped) {
+    munmap((void*)mapped.ptr, mapped.size);
+    mapped.ptr = NULL;
+}
+
+#endif
+
+bool openDataset(Dataset& dataset, const char* directory) {
+    dataset.shards.clear();
+    dataset.count = 0;
+
+    FILE* file = fopen((std::string(directory) + "/index.bin").c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    IndexHeader index;
+    bool ok = fread(&index, sizeof(index), 1, file) == 1 &&
+        !memcmp(index.magic, indexMagic, sizeof(index.magic)) &&
+        index.version == datasetVersion && index.sampleSize == sizeof(TrainingSample) && index.shardSamples &&
+        index.count && index.noShards == (index.count + index.shardSamples - 1) / index.shardSamples;
+    std::vector<unsigned int> shardCounts(ok ? index.noShards : 0);
+    ok = ok && fread(shardCounts.data(), sizeof(unsigned int), index.noShards, file) == index.noShards;
+    fclose(file);
+
+    // an empty dataset has nothing to sample, and the shards have to hold the count
+    unsigned long long total = 0;
+    for (unsigned int s = 0; ok && s < index.noShards; s++) {
+        ok = shardCounts[s] && shardCounts[s] <= index.shardSamples;
+        total += shardCounts[s];
+    }
+    if (!ok || total != index.count) {
+        return false;
+    }
+
+    // all shards but the last are full, so a sample's shard is its index / shardSamples
+    size_t shardSize = DATASET_HEADER_SIZE + (size_t)index.shardSamples * sizeof(TrainingSample);
+    for (unsigned int s = 0; s < index.noShards; s++) {
+        MappedFile mapped;
+        if (!mapFile(mapped, shardPath(directory, s))) {
+            closeDataset(dataset);
+            return false;
+        }
+        dataset.shards.push_back(mapped);
+        chargeMemory(MEMORY_DATASET, (long long)mapped.size);
+
+        const ShardHeader* shard = (const ShardHeader*)mapped.ptr;
+        bool full = s + 1 == index.noShards || shardCounts[s] == index.shardSamples;
+        if (mapped.size != shardSize || memcmp(shard->magic, shardMagic, sizeof(shard->magic)) ||
+            shard->shard != s || shard->count != shardCounts[s] || !full) {
+            closeDataset(dataset);
+            return false;
+        }
+    }
+
+    dataset.shardSamples = index.shardSamples;
+    dataset.count = index.count;
+    return true;
+}
+
+void closeDataset(Dataset& dataset) {
+    for (MappedFile& mapped : dataset.shards) {
+        chargeMemory(MEMORY_DATASET, -(long long)mapped.size);
+        unmapFile(mapped);
+    }
+    dataset.shards.clear();
+    dataset.count = 0;
+}
+
+void sampleBatch(const Dataset& dataset, unsigned int& rng, unsigned int n, TrainingSample* out) {
+    // pick every index first and prefetch ahead, so the cache misses overlap
+    const unsigned int ahead = 16;
+    const TrainingSample* picks[ahead];
+    for (unsigned int i = 0; i < n + ahead; i++) {
+        if (i >= ahead) {
+            out[i - ahead] = *picks[i % ahead];
+        }
+        if (i < n) {
+            const TrainingSample* sample = &datasetSample(dataset, randomBelow(rng, dataset.count));
+            PREFETCH(sample);
+            picks[i % ahead] = sample;
+        }
+    }
+}
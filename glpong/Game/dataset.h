@@ -0,0 +1,83 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+
+/*
+    imitation learning dataset
+    every tick of human play becomes one fixed-size sample: the match state before
+    the step and the keys processInput read for it
+    samples are shuffled and written as shards of a fixed number of samples after a
+    page-sized header, with an index file listing the shards; the loader maps the
+    shards and hands out samples in place, so reading needs no parsing
+*/
+
+// one tick (64 bytes, so samples never straddle cache lines)
+struct TrainingSample {
+    // state
+    float ballX;
+    float ballY;
+    float ballVX;
+    float ballVY;
+    float ballSpin;
+    float paddleY[2];
+    float paddleV[2];
+    float paddleAngle[2];
+    float dt;
+    unsigned int tick;
+    unsigned int session;
+
+    // labels
+    signed char input[2];
+    signed char tiltInput[2];
+
+    unsigned char pad[4];
+};
+
+// samples per shard (4MB of samples)
+const unsigned int DATASET_SHARD_SAMPLES = 1 << 16;
+
+// bytes before the first sample of a shard
+const size_t DATASET_HEADER_SIZE = 4096;
+
+// fill _sample_ from match _m_ before it steps _dt_ seconds
+void captureSample(TrainingSample& sample, const MatchBatch& batch, unsigned int m, float dt, unsigned int tick, unsigned int session);
+
+// shuffle _samples_ (in place) and write them to _directory_ as shards plus index.bin
+bool writeDataset(const char* directory, TrainingSample* samples, size_t count, unsigned int shardSamples, unsigned int seed);
+
+// read-only file mapping
+struct MappedFile {
+    const unsigned char* ptr;
+    size_t size;
+    void* handle;   // mapping object (windows)
+};
+
+// shards of a dataset mapped into memory
+struct Dataset {
+    unsigned int shardSamples;
+    unsigned long long count;
+    std::vector<MappedFile> shards;
+};
+
+// map every shard listed by the index in _directory_, false if missing, malformed or
+// empty
+bool openDataset(Dataset& dataset, const char* directory);
+
+// unmap the shards
+void closeDataset(Dataset& dataset);
+
+// sample _i_ of the dataset
+inline const TrainingSample& datasetSample(const Dataset& dataset, unsigned long long i) {
+    const MappedFile& shard = dataset.shards[i / dataset.shardSamples];
+    return ((const TrainingSample*)(shard.ptr + DATASET_HEADER_SIZE))[i % dataset.shardSamples];
+}
+
+// copy _n_ samples drawn at random (with replacement) into _out_
+void sampleBatch(const Dataset& dataset, unsigned int& rng, unsigned int n, TrainingSample* out);
+
+#endif
@@ -0,0 +1,96 @@
+#include "drawqueue.h"
+
+#include <algorithm>
+
+static_assert(DRAW_PASS_BITS + DRAW_PROGRAM_BITS + DRAW_MESH_BITS + DRAW_MATERIAL_BITS + DRAW_DEPTH_BITS == 64,
+    "key fields fill 64 bits");
+
+unsigned long long drawKey(RenderPass pass, unsigned int program, unsigned int mesh, unsigned int material, float depth) {
+    // blended renderables are drawn far to near
+    float d = std::min(std::max(depth, 0.0f), 1.0f);
+    if (pass == PASS_BLENDED) {
+        d = 1.0f - d;
+    }
+    unsigned long long quantized = (unsigned long long)(d * ((1u << DRAW_DEPTH_BITS) - 1) + 0.5f);
+
+    unsigned long long key = (unsigned long long)pass & ((1u << DRAW_PASS_BITS) - 1);
+    key = key << DRAW_PROGRAM_BITS | (program & ((1u << DRAW_PROGRAM_BITS) - 1));
+    key = key << DRAW_MESH_BITS | (mesh & ((1u << DRAW_MESH_BITS) - 1));
+    key = key << DRAW_MATERIAL_BITS | (material & ((1u << DRAW_MATERIAL_BITS) - 1));
+    return key << DRAW_DEPTH_BITS | quantized;
+}
+
+void clearDrawQueue(DrawQueue& queue) {
+    queue.keys.clear();
+    queue.items.clear();
+}
+
+void sortDrawQueue(DrawQueue& queue) {
+    size_t n = queue.keys.size();
+    queue.digitPasses = 0;
+    if (n < 2) {
+        return;
+    }
+    queue.scratchKeys.resize(n);
+    queue.scratchItems.resize(n);
+
+    // histograms of all eight bytes in one read of the keys
+    unsigned int counts[8][256] = {};
+    const unsigned long long* keys = queue.keys.data();
+    for (size_t i = 0; i < n; i++) {
+        unsigned long long key = keys[i];
+        for (int b = 0; b < 8; b++) {
+            counts[b][(key >> (8 * b)) & 255]++;
+        }
+    }
+
+    unsigned long long* srcKeys = queue.keys.data();
+    unsigned int* srcItems = queue.items.data();
+    unsigned long long* dstKeys = queue.scratchKeys.data();
+    unsigned int* dstItems = queue.scratchItems.data();
+    for (int b = 0; b < 8; b++) {
+        // a byte every key shares leaves the order as it is (program and pass
+        // bytes usually, with few programs)
+        unsigned int shift = 8 * b;
+        if (counts[b][(srcKeys[0] >> shift) & 255] == n) {
+            continue;
+        }
+
+        unsigned int offsets[256];
+        unsigned int sum = 0;
+        for (int d = 0; d < 256; d++) {
+            offsets[d] = sum;
+            sum += counts[b][d];
+        }
+        for (size_t i = 0; i < n; i++) {
+            unsigned int d = (srcKeys[i] >> shift) & 255;
+            unsigned int to = offsets[d]++;
+            dstKeys[to] = srcKeys[i];
+            dstItems[to] = srcItems[i];
+        }
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcItems, dstItems);
+        queue.digitPasses++;
+    }
+
+    // an odd number of passes left the result in the scratch buffers
+    if (srcKeys != queue.keys.data()) {
+        queue.keys.swap(queue.scratchKeys);
+        queue.items.swap(queue.scratchItems);
+    }
+}
+
+unsigned int mergeDraws(const DrawQueue& queue, std::vector<DrawBatch>& batches) {
+    batches.clear();
+    unsigned int n = (unsigned int)queue.keys.size();
+    for (unsigned int i = 0; i < n;) {
+        DrawBatch batch;
+        batch.key = queue.keys[i];
+        batch.first = i;
+        while (++i < n && sameDrawState(queue.keys[i], batch.key)) {
+        }
+        batch.count = i - batch.first;
+        batches.push_back(batch);
+    }
+    return (unsigned int)batches.size();
+}
@@ -0,0 +1,89 @@
+#ifndef DRAWQUEUE_H
+#define DRAWQUEUE_H
+
+#include <vector>
+
+/*
+    draw queue
+    every renderable of a frame is pushed as a 64-bit sort key and an item (the
+    caller's index of its instance data); the keys are sorted with an LSD radix sort
+    and neighbours sharing pass, program, mesh and material become one instanced draw
+    key, from the top bit down:
+        pass      4 bits    opaque before blended before overlay
+        program   8 bits    fewest program changes, then
+        mesh     12 bits    vertex array changes, then
+        material 16 bits    palette or uniform changes
+        depth    24 bits    front to back, back to front in blended passes
+    depth is last, so it orders the instances of a draw and never splits one
+    a run is drawn once, from the vertex array of its first renderable with the
+    instance counts of all of them, so renderables sharing a mesh keep their instances
+    one after another in its buffers, in key order (push order among equal keys, the
+    sort is stable)
+*/
+
+enum RenderPass {
+    PASS_OPAQUE,
+    PASS_BLENDED,
+    PASS_OVERLAY
+};
+
+const unsigned int DRAW_DEPTH_BITS = 24;
+const unsigned int DRAW_MATERIAL_BITS = 16;
+const unsigned int DRAW_MESH_BITS = 12;
+const unsigned int DRAW_PROGRAM_BITS = 8;
+const unsigned int DRAW_PASS_BITS = 4;
+
+// _depth_ in [0, 1], 0 nearest; fields wider than their bits are cut
+unsigned long long drawKey(RenderPass pass, unsigned int program, unsigned int mesh, unsigned int material, float depth);
+
+inline RenderPass drawPass(unsigned long long key) {
+    return (RenderPass)(key >> (64 - DRAW_PASS_BITS));
+}
+inline unsigned int drawProgram(unsigned long long key) {
+    return (unsigned int)(key >> (DRAW_DEPTH_BITS + DRAW_MATERIAL_BITS + DRAW_MESH_BITS)) & ((1u << DRAW_PROGRAM_BITS) - 1);
+}
+inline unsigned int drawMesh(unsigned long long key) {
+    return (unsigned int)(key >> (DRAW_DEPTH_BITS + DRAW_MATERIAL_BITS)) & ((1u << DRAW_MESH_BITS) - 1);
+}
+inline unsigned int drawMaterial(unsigned long long key) {
+    return (unsigned int)(key >> DRAW_DEPTH_BITS) & ((1u << DRAW_MATERIAL_BITS) - 1);
+}
+
+// renderables that can share an instanced draw
+inline bool sameDrawState(unsigned long long a, unsigned long long b) {
+    return (a ^ b) >> DRAW_DEPTH_BITS == 0;
+}
+
+struct DrawQueue {
+    std::vector<unsigned long long> keys;
+    std::vector<unsigned int> items;
+
+    // the sort's other buffers, kept between frames
+    std::vector<unsigned long long> scratchKeys;
+    std::vector<unsigned int> scratchItems;
+    unsigned int digitPasses;   // scatter passes of the last sort (digits all keys share are skipped)
+};
+
+// one instanced draw: items[first, first + count) of the sorted queue, whose instances
+// follow each other
+struct DrawBatch {
+    unsigned long long key;     // of the first renderable
+    unsigned int first;
+    unsigned int count;
+};
+
+// empty the queue, keeping its memory
+void clearDrawQueue(DrawQueue& queue);
+
+inline void pushDraw(DrawQueue& queue, unsigned long long key, unsigned int item) {
+    queue.keys.push_back(key);
+    queue.items.push_back(item);
+}
+
+// sort by key, stable, with the items following their keys
+void sortDrawQueue(DrawQueue& queue);
+
+// runs of a sorted queue sharing their draw state, returns the number of draws
+unsigned int mergeDraws(const DrawQueue& queue, std::vector<DrawBatch>& batches);
+
+#endif
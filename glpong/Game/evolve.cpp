@@ -0,0 +1,435 @@
+#include "evolve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+const unsigned int policyVersion = 1;
+
+// first bytes of a policy file
+struct PolicyHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int inputs;
+    unsigned int hidden;
+    unsigned int params;
+};
+
+// policy layout
+const unsigned int HIDDEN_WEIGHTS = 0;                                      // [hidden][inputs]
+const unsigned int HIDDEN_BIASES = POLICY_HIDDEN * POLICY_INPUTS;           // [hidden]
+const unsigned int OUTPUT_WEIGHTS = HIDDEN_BIASES + POLICY_HIDDEN;          // [hidden]
+const unsigned int OUTPUT_BIAS = OUTPUT_WEIGHTS + POLICY_HIDDEN;
+
+/*
+    counter-based random numbers
+*/
+
+// 64 bit finalizer (splitmix64), a different output for every input
+static inline unsigned long long mix64(unsigned long long x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// random number named by three counters
+static inline unsigned long long counterRandom(unsigned long long a, unsigned long long b, unsigned long long c) {
+    return mix64(mix64(mix64(a) ^ b) ^ c);
+}
+
+// uniform float in (0, 1] from the top bits
+static inline float unitFloat(unsigned long long x) {
+    return ((x >> 40) + 1) * (1.0f / 16777216.0f);
+}
+
+// entries [first, last) of the noise table: entry pair i is a Box-Muller draw from counter i
+static void fillNoise(float* noise, unsigned int seed, size_t first, size_t last) {
+    for (size_t i = first; i < last; i += 2) {
+        unsigned long long r = counterRandom(seed, 0x6e6f697365ull, i / 2);
+        float radius = sqrtf(-2.0f * logf(unitFloat(r)));
+        float angle = 6.28318531f * unitFloat(r << 24);
+        noise[i] = radius * cosf(angle);
+        noise[i + 1] = radius * sinf(angle);
+    }
+}
+
+/*
+    policy
+*/
+
+void policyInputs(MatchBatch& batch, const SimParams& params, const float* policies,
+    unsigned int matchesPerPolicy, int side) {
+    // observation of the paddle's own side, mirrored for the right paddle so one
+    // policy plays either side
+    float mirror = side == 0 ? 1.0f : -1.0f;
+    float originX = side == 0 ? 0.0f : params.width;
+    float invWidth = 1.0f / params.width;
+    float invHeight = 1.0f / params.height;
+    float invPaddle = 1.0f / params.paddleHeight;
+    float invSpeed = 1.0f / fabsf(params.initBallVelocity.x);
+
+    const float* ballX = batch.ballX;
+    const float* ballY = batch.ballY;
+    const float* ballVX = batch.ballVX;
+    const float* ballVY = batch.ballVY;
+    const float* ownY = batch.paddleY[side];
+    const float* otherY = batch.paddleY[1 - side];
+    const float* angle = batch.paddleAngle[side];
+    signed char* input = batch.input[side];
+
+    for (unsigned int first = 0; first < batch.count; first += matchesPerPolicy) {
+        unsigned int last = std::min(first + matchesPerPolicy, batch.count);
+
+        // local copy of the weights, the input stores could alias the policy otherwise
+        // and keep the loop across matches from vectorizing
+        float policy[POLICY_PARAMS];
+        memcpy(policy, policies + (size_t)(first / matchesPerPolicy) * POLICY_PARAMS, sizeof(policy));
+
+        for (unsigned int m = first; m < last; m++) {
+            float x[POLICY_INPUTS] = {
+                mirror * (ballX[m] - originX) * invWidth - 0.5f,
+                (ballY[m] - ownY[m]) * invPaddle,
+                mirror * ballVX[m] * invSpeed,
+                ballVY[m] * invSpeed,
+                ownY[m] * invHeight - 0.5f,
+                otherY[m] * invHeight - 0.5f,
+                mirror * angle[m]
+            };
+
+            float out = policy[OUTPUT_BIAS];
+            for (unsigned int h = 0; h < POLICY_HIDDEN; h++) {
+                float a = policy[HIDDEN_BIASES + h];
+                for (unsigned int j = 0; j < POLICY_INPUTS; j++) {
+                    a += policy[HIDDEN_WEIGHTS + h * POLICY_INPUTS + j] * x[j];
+                }
+                // softsign, no library call so the loop vectorizes
+                out += policy[OUTPUT_WEIGHTS + h] * (a / (1.0f + fabsf(a)));
+            }
+            input[m] = out > POLICY_DEAD_ZONE ? 1 : (out < -POLICY_DEAD_ZONE ? -1 : 0);
+        }
+    }
+}
+
+bool savePolicy(const char* path, const float* policy) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    PolicyHeader header = {};
+    memcpy(header.magic, "PONGPOL", 8);
+    header.version = policyVersion;
+    header.inputs = POLICY_INPUTS;
+    header.hidden = POLICY_HIDDEN;
+    header.params = POLICY_PARAMS;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(policy, sizeof(float), POLICY_PARAMS, file) == POLICY_PARAMS;
+    return fclose(file) == 0 && ok;
+}
+
+bool loadPolicy(const char* path, float* policy) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    PolicyHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, "PONGPOL", 8) == 0 &&
+        header.version == policyVersion &&
+        header.inputs == POLICY_INPUTS &&
+        header.hidden == POLICY_HIDDEN &&
+        header.params == POLICY_PARAMS &&
+        fread(policy, sizeof(float), POLICY_PARAMS, file) == POLICY_PARAMS;
+    fclose(file);
+    return ok;
+}
+
+/*
+    evaluation
+*/
+
+EvolutionParams defaultEvolutionParams() {
+    EvolutionParams config;
+    config.members = 64;
+    config.matchesPerMember = 16;
+    config.ticks = 1800;
+    config.dt = 1.0f / 60.0f;
+    config.sigma = 0.05f;
+    config.learningRate = 0.03f;
+    config.weightDecay = 0.005f;
+    config.hitReward = 0.1f;
+    config.seed = 1;
+    config.threads = 0;
+    return config;
+}
+
+// matches one task plays
+static unsigned int matchesPerTask(const Trainer& trainer) {
+    return 2 * trainer.pairsPerTask * trainer.config.matchesPerMember;
+}
+
+// starting state _k_ of a round, the same for every member
+static void startMatch(MatchBatch& batch, const SimParams& sim, unsigned int m, unsigned long long seed, unsigned int k) {
+    resetMatch(batch, sim, m);
+    unsigned long long r = counterRandom(seed, 0x7374617274ull, k);
+    float margin = sim.paddleHeight / 2.0f;
+    batch.ballY[m] = sim.height * (0.2f + 0.6f * unitFloat(r));
+    batch.ballVX[m] = (r & 1 ? 1.0f : -1.0f) * fabsf(sim.initBallVelocity.x);
+    batch.ballVY[m] = (r & 2 ? 1.0f : -1.0f) * fabsf(sim.initBallVelocity.y);
+    for (int i = 0; i < 2; i++) {
+        batch.paddleY[i][m] = margin + (sim.height - 2.0f * margin) * unitFloat(r << (12 * (i + 1)));
+    }
+}
+
+// play one task on worker _w_'s batch
+static void evaluateTask(void* context, unsigned int w, unsigned int task) {
+    Trainer& trainer = *(Trainer*)context;
+    const EvolutionParams& config = trainer.config;
+    MatchBatch& batch = trainer.batches[w];
+    unsigned int capacity = batch.count;
+    unsigned int k = config.matchesPerMember;
+
+    // population: a few pairs, every member on the same k starting states
+    // single policy: a run of distinct starting states
+    const float* policies;
+    unsigned int matchesPerPolicy;
+    unsigned int count;
+    unsigned long long seed;
+    if (trainer.evalPolicy) {
+        policies = trainer.evalPolicy;
+        count = capacity;
+        matchesPerPolicy = count;
+        seed = counterRandom(config.seed, 0x6576616cull, trainer.evalSeed);
+    }
+    else {
+        unsigned int pairs = config.members / 2;
+        unsigned int firstPair = task * trainer.pairsPerTask;
+        unsigned int noPairs = std::min(trainer.pairsPerTask, pairs - firstPair);
+        policies = trainer.population + (size_t)2 * firstPair * POLICY_PARAMS;
+        count = 2 * noPairs * k;
+        matchesPerPolicy = k;
+        seed = counterRandom(config.seed, 0x67656eull, trainer.generation);
+    }
+    batch.count = count;
+
+    for (unsigned int m = 0; m < count; m++) {
+        unsigned int state = trainer.evalPolicy ? task * capacity + m : m % k;
+        startMatch(batch, trainer.sim, m, seed, state);
+    }
+
+    // hits by the left paddle
+    unsigned int* hits = trainer.hits + (size_t)w * capacity;
+    memset(hits, 0, count * sizeof(unsigned int));
+
+    float half = trainer.sim.width / 2.0f;
+    for (unsigned int t = 0; t < config.ticks; t++) {
+        botInputs(batch, trainer.sim);
+        policyInputs(batch, trainer.sim, policies, matchesPerPolicy, 0);
+        stepMatches(batch, trainer.sim, config.dt);
+        for (unsigned int m = 0; m < count; m++) {
+            hits[m] += (batch.events[m] & EVENT_PADDLE) && batch.ballX[m] < half;
+        }
+    }
+
+    // fitness: point difference plus a little for each hit
+    for (unsigned int first = 0; first < count; first += matchesPerPolicy) {
+        float sum = 0.0f;
+        for (unsigned int m = first; m < first + matchesPerPolicy; m++) {
+            sum += (float)batch.score[0][m] - (float)batch.score[1][m] + config.hitReward * hits[m];
+        }
+        unsigned int slot = trainer.evalPolicy ? task : task * 2 * trainer.pairsPerTask + first / matchesPerPolicy;
+        trainer.fitness[slot] = sum / matchesPerPolicy;
+    }
+
+    batch.count = capacity;
+}
+
+// run _noTasks_ tasks on every worker, the calling thread included
+static void runRound(Trainer& trainer, unsigned int noTasks) {
+    runTasks(trainer.pool, noTasks, evaluateTask, &trainer);
+}
+
+/*
+    trainer
+*/
+
+bool startTrainer(Trainer& trainer, const SimParams& sim, const EvolutionParams& config) {
+    trainer.config = config;
+    trainer.config.members = std::max(2u, (config.members + 1) & ~1u);
+    trainer.config.matchesPerMember = std::max(1u, config.matchesPerMember);
+    trainer.sim = sim;
+    trainer.noThreads = config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    // a few tasks per worker so uneven ones balance out
+    unsigned int pairs = trainer.config.members / 2;
+    trainer.pairsPerTask = std::max(1u, pairs / (trainer.noThreads * 4));
+    unsigned int taskMatches = matchesPerTask(trainer);
+
+    unsigned int members = trainer.config.members;
+    size_t size =
+        NOISE_TABLE_SIZE * sizeof(float) +
+        (4 + (size_t)members) * POLICY_PARAMS * sizeof(float) +     // policy, moments, gradient, population
+        pairs * sizeof(unsigned int) +
+        members * (sizeof(float) + sizeof(unsigned int)) +
+        (size_t)trainer.noThreads * taskMatches * sizeof(unsigned int);
+    if (!allocLarge(trainer.block, size, ALLOC_HUGE_PAGES, MEMORY_TRAINER)) {
+        return false;
+    }
+    float* cursor = (float*)trainer.block.ptr;
+    trainer.noise = cursor;
+    cursor += NOISE_TABLE_SIZE;
+    trainer.policy = cursor;
+    cursor += POLICY_PARAMS;
+    trainer.moment[0] = cursor;
+    cursor += POLICY_PARAMS;
+    trainer.moment[1] = cursor;
+    cursor += POLICY_PARAMS;
+    trainer.gradient = cursor;
+    cursor += POLICY_PARAMS;
+    trainer.population = cursor;
+    cursor += (size_t)members * POLICY_PARAMS;
+    trainer.fitness = cursor;
+    cursor += members;
+    trainer.offsets = (unsigned int*)cursor;
+    trainer.order = trainer.offsets + pairs;
+    trainer.hits = trainer.order + members;
+
+    // noise table, in parallel since it is large
+    // chunks round up, then up to even (fillNoise makes values in pairs), so they cover it
+    std::vector<std::thread> fill;
+    size_t chunk = ((NOISE_TABLE_SIZE + trainer.noThreads - 1) / trainer.noThreads + 1) & ~(size_t)1;
+    for (unsigned int t = 0; t < trainer.noThreads; t++) {
+        size_t first = std::min(NOISE_TABLE_SIZE, t * chunk);
+        size_t last = std::min(NOISE_TABLE_SIZE, first + chunk);
+        fill.push_back(std::thread(fillNoise, trainer.noise, config.seed, first, last));
+    }
+    for (std::thread& thread : fill) {
+        thread.join();
+    }
+
+    // hidden weights start from the table, the output at zero (paddle idle)
+    unsigned long long start = counterRandom(config.seed, 0x696e6974ull, 0) % (NOISE_TABLE_SIZE - POLICY_PARAMS);
+    for (unsigned int p = 0; p < OUTPUT_WEIGHTS; p++) {
+        trainer.policy[p] = 0.5f * trainer.noise[start + p];
+    }
+
+    trainer.batches = new MatchBatch[trainer.noThreads];
+    for (unsigned int w = 0; w < trainer.noThreads; w++) {
+        if (!allocMatchBatch(trainer.batches[w], taskMatches, ALLOC_PREFAULT)) {
+            for (unsigned int i = 0; i < w; i++) {
+                freeMatchBatch(trainer.batches[i]);
+            }
+            delete[] trainer.batches;
+            freeLarge(trainer.block);
+            return false;
+        }
+    }
+
+    trainer.evalPolicy = NULL;
+    trainer.evalSeed = 0;
+    trainer.generation = 0;
+    trainer.evaluations = 0;
+    trainer.meanFitness = 0.0f;
+    trainer.bestFitness = 0.0f;
+
+    startTaskPool(trainer.pool, trainer.noThreads);
+    return true;
+}
+
+void stopTrainer(Trainer& trainer) {
+    stopTaskPool(trainer.pool);
+
+    for (unsigned int w = 0; w < trainer.noThreads; w++) {
+        freeMatchBatch(trainer.batches[w]);
+    }
+    delete[] trainer.batches;
+    freeLarge(trainer.block);
+}
+
+void trainGeneration(Trainer& trainer) {
+    const EvolutionParams& config = trainer.config;
+    unsigned int members = config.members;
+    unsigned int pairs = members / 2;
+
+    // antithetic pairs around the policy
+    for (unsigned int j = 0; j < pairs; j++) {
+        unsigned int offset = (unsigned int)(counterRandom(config.seed, trainer.generation, j) %
+            (NOISE_TABLE_SIZE - POLICY_PARAMS));
+        trainer.offsets[j] = offset;
+        const float* eps = trainer.noise + offset;
+        float* plus = trainer.population + (size_t)2 * j * POLICY_PARAMS;
+        float* minus = plus + POLICY_PARAMS;
+        for (unsigned int p = 0; p < POLICY_PARAMS; p++) {
+            plus[p] = trainer.policy[p] + config.sigma * eps[p];
+            minus[p] = trainer.policy[p] - config.sigma * eps[p];
+        }
+    }
+
+    trainer.evalPolicy = NULL;
+    runRound(trainer, (pairs + trainer.pairsPerTask - 1) / trainer.pairsPerTask);
+
+    // centered ranks in [-0.5, 0.5], so the step ignores the scale of the fitness
+    float* fitness = trainer.fitness;
+    unsigned int* order = trainer.order;
+    for (unsigned int i = 0; i < members; i++) {
+        order[i] = i;
+    }
+    std::sort(order, order + members, [fitness](unsigned int a, unsigned int b) { return fitness[a] < fitness[b]; });
+
+    float sum = 0.0f;
+    float best = fitness[order[members - 1]];
+    for (unsigned int i = 0; i < members; i++) {
+        sum += fitness[i];
+    }
+
+    memset(trainer.gradient, 0, POLICY_PARAMS * sizeof(float));
+    for (unsigned int r = 0; r < members; r++) {
+        unsigned int member = order[r];
+        float rank = (float)r / (float)(members - 1) - 0.5f;
+        float weight = member & 1 ? -rank : rank;
+        const float* eps = trainer.noise + trainer.offsets[member / 2];
+        for (unsigned int p = 0; p < POLICY_PARAMS; p++) {
+            trainer.gradient[p] += weight * eps[p];
+        }
+    }
+
+    // Adam ascent with weight decay
+    const float beta1 = 0.9f, beta2 = 0.999f;
+    float step = (float)(trainer.generation + 1);
+    float correction1 = 1.0f - powf(beta1, step);
+    float correction2 = 1.0f - powf(beta2, step);
+    float scale = 1.0f / (members * config.sigma);
+    for (unsigned int p = 0; p < POLICY_PARAMS; p++) {
+        float g = trainer.gradient[p] * scale - config.weightDecay * trainer.policy[p];
+        trainer.moment[0][p] = beta1 * trainer.moment[0][p] + (1.0f - beta1) * g;
+        trainer.moment[1][p] = beta2 * trainer.moment[1][p] + (1.0f - beta2) * g * g;
+        float m = trainer.moment[0][p] / correction1;
+        float v = trainer.moment[1][p] / correction2;
+        trainer.policy[p] += config.learningRate * m / (sqrtf(v) + 1e-8f);
+    }
+
+    trainer.generation++;
+    trainer.evaluations += (unsigned long long)members * config.matchesPerMember;
+    trainer.meanFitness = sum / members;
+    trainer.bestFitness = best;
+}
+
+float evaluatePolicy(Trainer& trainer, const float* policy, unsigned int matches, unsigned int seed) {
+    // tasks write their fitness in the population's slots, so at most one per member
+    unsigned int taskMatches = matchesPerTask(trainer);
+    unsigned int noTasks = std::min(trainer.config.members, std::max(1u, (matches + taskMatches - 1) / taskMatches));
+
+    trainer.evalPolicy = policy;
+    trainer.evalSeed = seed;
+    runRound(trainer, noTasks);
+    trainer.evalPolicy = NULL;
+
+    float sum = 0.0f;
+    for (unsigned int t = 0; t < noTasks; t++) {
+        sum += trainer.fitness[t];
+    }
+    return sum / noTasks;
+}
@@ -0,0 +1,101 @@
+#ifndef EVOLVE_H
+#define EVOLVE_H
+
+#include <cstddef>
+
+#include "largealloc.h"
+#include "sim.h"
+#include "taskpool.h"
+
+/*
+    evolution strategies trainer for paddle policies
+    a policy is a small network from an observation of its own side to paddle input
+    each generation perturbs the policy in antithetic pairs with slices of a shared
+    noise table, plays every perturbation against the built-in bot across many
+    headless matches on all cores, and steps along the centered-rank weighted sum of
+    the perturbations (Adam)
+    the noise table is generated from a counter, and a member's slice from the seed,
+    generation and pair, so a perturbation is named by a few integers
+    everything is allocated when the trainer starts, a generation allocates nothing
+*/
+
+const unsigned int POLICY_INPUTS = 7;
+const unsigned int POLICY_HIDDEN = 8;
+const unsigned int POLICY_PARAMS = POLICY_HIDDEN * (POLICY_INPUTS + 1) + POLICY_HIDDEN + 1;
+
+// output beyond which the paddle moves
+const float POLICY_DEAD_ZONE = 0.25f;
+
+// floats in the noise table
+const size_t NOISE_TABLE_SIZE = 1 << 24;
+
+struct EvolutionParams {
+    unsigned int members;           // perturbations per generation (rounded up to even)
+    unsigned int matchesPerMember;  // each member plays the same starting states
+    unsigned int ticks;             // length of a match
+    float dt;                       // seconds per tick
+    float sigma;                    // noise scale
+    float learningRate;
+    float weightDecay;
+    float hitReward;                // fitness per paddle hit on top of the point difference
+    unsigned int seed;
+    unsigned int threads;           // 0 = one per core
+};
+
+// settings used by the trainer and the bench
+EvolutionParams defaultEvolutionParams();
+
+struct Trainer {
+    EvolutionParams config;
+    SimParams sim;
+
+    // one block for the noise table, the policy, optimizer state and the population
+    LargeBlock block;
+    float* noise;
+    float* policy;          // POLICY_PARAMS
+    float* moment[2];       // Adam first and second moments
+    float* gradient;
+    float* population;      // members * POLICY_PARAMS
+    unsigned int* offsets;  // noise offset of each pair
+    float* fitness;         // members
+    unsigned int* order;    // members sorted by fitness
+    unsigned int* hits;     // left paddle hits in each worker's matches
+
+    // workers, each with its own batch for a task of a few pairs
+    unsigned int noThreads;
+    unsigned int pairsPerTask;
+    MatchBatch* batches;
+    TaskPool pool;
+    const float* evalPolicy;    // NULL to evaluate the population
+    unsigned int evalSeed;      // starting states of evalPolicy's matches
+
+    // progress
+    unsigned int generation;
+    unsigned long long evaluations;     // matches played
+    float meanFitness;                  // per match, last generation
+    float bestFitness;
+};
+
+// allocate everything, fill the noise table and start the workers
+bool startTrainer(Trainer& trainer, const SimParams& sim, const EvolutionParams& config);
+
+// stop the workers and free everything
+void stopTrainer(Trainer& trainer);
+
+// perturb, evaluate and update once
+void trainGeneration(Trainer& trainer);
+
+// mean fitness per match of _policy_ over _matches_ starting states (rounded up to
+// whole tasks), using the workers
+float evaluatePolicy(Trainer& trainer, const float* policy, unsigned int matches, unsigned int seed);
+
+// set the input of paddle _side_ for every match, match m driven by
+// policies[m / matchesPerPolicy]
+void policyInputs(MatchBatch& batch, const SimParams& params, const float* policies,
+    unsigned int matchesPerPolicy, int side);
+
+// policy file, POLICY_PARAMS floats after a small header
+bool savePolicy(const char* path, const float* policy);
+bool loadPolicy(const char* path, float* policy);
+
+#endif
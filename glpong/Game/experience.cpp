@@ -0,0 +1,427 @@
+#include "experience.h"
+#include "memstats.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define PREFETCH(p)
+#endif
+
+static_assert(sizeof(Transition) == 64, "transitions are one cache line");
+
+static const char experienceMagic[8] = { 'P', 'O', 'N', 'G', 'P', 'E', 'R', '1' };
+
+static size_t alignLine(size_t offset) {
+    return (offset + 63) & ~(size_t)63;
+}
+
+// splitmix64
+static unsigned long long nextRandom64(unsigned long long& state) {
+    unsigned long long z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/*
+    shared memory
+*/
+
+#ifdef _WIN32
+
+static void* createShared(ExperienceReplay& replay, size_t size) {
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        (DWORD)((unsigned long long)size >> 32), (DWORD)size, replay.name.c_str());
+    if (!mapping) {
+        return NULL;
+    }
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!ptr) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+    replay.handle = mapping;
+    return ptr;
+}
+
+static void* attachShared(ExperienceReplay& replay) {
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, replay.name.c_str());
+    if (!mapping) {
+        return NULL;
+    }
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!ptr) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+    replay.handle = mapping;
+    return ptr;
+}
+
+static void closeShared(ExperienceReplay& replay) {
+    // the block goes away with its last handle
+    UnmapViewOfFile(replay.header);
+    CloseHandle((HANDLE)replay.handle);
+}
+
+#else
+
+static void* createShared(ExperienceReplay& replay, size_t size) {
+    int fd = shm_open(replay.name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(replay.name.c_str());
+        return NULL;
+    }
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        shm_unlink(replay.name.c_str());
+        return NULL;
+    }
+    replay.handle = NULL;
+    return ptr;
+}
+
+static void* attachShared(ExperienceReplay& replay) {
+    int fd = shm_open(replay.name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ExperienceHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void* ptr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    replay.handle = NULL;
+    return ptr;
+}
+
+static void closeShared(ExperienceReplay& replay) {
+    munmap(replay.header, replay.header->layout.size);
+    if (replay.owner) {
+        shm_unlink(replay.name.c_str());
+    }
+}
+
+#endif
+
+// set the pointers of a view from the offsets in the header
+static void bindViews(ExperienceReplay& replay) {
+    unsigned char* base = (unsigned char*)replay.header;
+    const ExperienceLayout& layout = replay.header->layout;
+    replay.transitions = (Transition*)(base + layout.transitionsOffset);
+    replay.versions = (std::atomic<unsigned int>*)(base + layout.versionsOffset);
+    replay.leaves = (std::atomic<unsigned int>*)(base + layout.levelOffset[0]);
+    replay.sums[0] = NULL;
+    for (unsigned int l = 1; l < layout.levels; l++) {
+        replay.sums[l] = (std::atomic<unsigned long long>*)(base + layout.levelOffset[l]);
+    }
+}
+
+bool createExperienceReplay(ExperienceReplay& replay, const char* name, unsigned long long capacity) {
+    if (!capacity) {
+        return false;
+    }
+
+    // lay out the ring, then the tree levels from the leaves up to the root
+    ExperienceLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    memcpy(layout.magic, experienceMagic, sizeof(layout.magic));
+    layout.capacity = capacity;
+
+    size_t offset = alignLine(sizeof(ExperienceHeader));
+    layout.transitionsOffset = offset;
+    offset = alignLine(offset + capacity * sizeof(Transition));
+    layout.versionsOffset = offset;
+    offset = alignLine(offset + capacity * sizeof(unsigned int));
+
+    layout.levelOffset[0] = offset;
+    layout.levelCount[0] = capacity;
+    offset = alignLine(offset + capacity * sizeof(unsigned int));
+    unsigned long long count = capacity;
+    unsigned int levels = 1;
+    do {
+        if (levels == EXPERIENCE_MAX_LEVELS) {
+            return false;
+        }
+        count = (count + EXPERIENCE_FANOUT - 1) / EXPERIENCE_FANOUT;
+        layout.levelOffset[levels] = offset;
+        layout.levelCount[levels] = count;
+        offset = alignLine(offset + count * sizeof(unsigned long long));
+        levels++;
+    } while (count > 1);
+    layout.levels = levels;
+    layout.size = offset;
+
+    replay.name = name;
+    replay.owner = true;
+    void* ptr = createShared(replay, offset);
+    if (!ptr) {
+        return false;
+    }
+
+    // the block starts zeroed: empty ring, zero priorities
+    replay.header = (ExperienceHeader*)ptr;
+    replay.header->layout = layout;
+    replay.header->cursor.store(0);
+    replay.header->maxPriority.store((unsigned int)EXPERIENCE_PRIORITY_SCALE);
+    bindViews(replay);
+    chargeMemory(MEMORY_EXPERIENCE, (long long)layout.size);
+    return true;
+}
+
+bool attachExperienceReplay(ExperienceReplay& replay, const char* name) {
+    replay.name = name;
+    replay.owner = false;
+    void* ptr = attachShared(replay);
+    if (!ptr) {
+        return false;
+    }
+    replay.header = (ExperienceHeader*)ptr;
+    if (memcmp(replay.header->layout.magic, experienceMagic, sizeof(experienceMagic))) {
+        closeShared(replay);
+        return false;
+    }
+    bindViews(replay);
+    chargeMemory(MEMORY_EXPERIENCE, (long long)replay.header->layout.size);
+    return true;
+}
+
+void closeExperienceReplay(ExperienceReplay& replay) {
+    if (replay.header) {
+        chargeMemory(MEMORY_EXPERIENCE, -(long long)replay.header->layout.size);
+        closeShared(replay);
+    }
+    replay.header = NULL;
+}
+
+/*
+    priorities
+*/
+
+unsigned long long experienceSize(const ExperienceReplay& replay) {
+    unsigned long long added = replay.header->cursor.load(std::memory_order_acquire);
+    return added < replay.header->layout.capacity ? added : replay.header->layout.capacity;
+}
+
+unsigned long long totalPriority(const ExperienceReplay& replay) {
+    return replay.sums[replay.header->layout.levels - 1][0].load(std::memory_order_acquire);
+}
+
+// priority in units, at least 1 so every stored transition can be drawn
+static unsigned int toUnits(float priority) {
+    float units = priority * EXPERIENCE_PRIORITY_SCALE + 0.5f;
+    if (!(units >= 1.0f)) {
+        return 1;
+    }
+    return units < 4294967040.0f ? (unsigned int)units : 4294967040u;
+}
+
+// add the change of a leaf from _old_ to _units_ on the path to the root
+static void addUnits(ExperienceReplay& replay, unsigned long long slot, unsigned int old, unsigned int units) {
+    unsigned long long delta = (unsigned long long)units - (unsigned long long)old;  // wraps when lower
+    if (!delta) {
+        return;
+    }
+    unsigned long long node = slot;
+    for (unsigned int l = 1; l < replay.header->layout.levels; l++) {
+        node /= EXPERIENCE_FANOUT;
+        replay.sums[l][node].fetch_add(delta, std::memory_order_acq_rel);
+    }
+}
+
+bool updatePriority(ExperienceReplay& replay, unsigned long long slot, unsigned int version, float priority) {
+    unsigned int units = toUnits(priority);
+
+    // the writer makes the version odd before it swaps the leaf, so a leaf read before
+    // a version that still matches is the sampled transition's; the swap fails if the
+    // writer got in between, and the version no longer matches on the next round
+    std::atomic<unsigned int>& leaf = replay.leaves[slot];
+    unsigned int old = leaf.load();
+    for (;;) {
+        if (replay.versions[slot].load() != version) {
+            return false;
+        }
+        if (leaf.compare_exchange_weak(old, units)) {
+            break;
+        }
+    }
+    addUnits(replay, slot, old, units);
+
+    // track the highest priority for new transitions
+    unsigned int seen = replay.header->maxPriority.load(std::memory_order_relaxed);
+    while (units > seen && !replay.header->maxPriority.compare_exchange_weak(seen, units, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+unsigned long long addTransition(ExperienceReplay& replay, const Transition& transition) {
+    unsigned long long slot = replay.header->cursor.fetch_add(1, std::memory_order_acq_rel) % replay.header->layout.capacity;
+
+    // odd version while the slot changes, samplers retry if they overlap it and late
+    // priority updates see it changed; the leaf is set before the slot is published
+    std::atomic<unsigned int>& version = replay.versions[slot];
+    version.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_release);
+    replay.transitions[slot] = transition;
+    unsigned int units = replay.header->maxPriority.load(std::memory_order_relaxed);
+    addUnits(replay, slot, replay.leaves[slot].exchange(units), units);
+    version.fetch_add(1, std::memory_order_release);
+    return slot;
+}
+
+/*
+    sampling
+*/
+
+// child of _node_ (on level _l_) that holds _target_ units into the node, with
+// _target_ made relative to that child
+static inline unsigned long long descend(const ExperienceReplay& replay, unsigned int l, unsigned long long node,
+    unsigned long long& target) {
+    const ExperienceLayout& layout = replay.header->layout;
+    unsigned long long first = node * EXPERIENCE_FANOUT;
+    unsigned long long end = first + EXPERIENCE_FANOUT;
+    end = end < layout.levelCount[l - 1] ? end : layout.levelCount[l - 1];
+
+    // updates in flight can leave a parent out of step with its children, so fall
+    // back to the last child with any weight
+    unsigned long long lastNonZero = first;
+    for (unsigned long long c = first; c < end; c++) {
+        unsigned long long v = l > 1 ?
+            replay.sums[l - 1][c].load(std::memory_order_relaxed) :
+            replay.leaves[c].load(std::memory_order_relaxed);
+        if (target < v) {
+            return c;
+        }
+        lastNonZero = v ? c : lastNonZero;
+        target -= v;
+    }
+    target = 0;
+    return lastNonZero;
+}
+
+// fetch the children of _node_ on the level below _l_
+static inline void prefetchChildren(const ExperienceReplay& replay, unsigned int l, unsigned long long node) {
+    const void* children = l > 1 ?
+        (const void*)(replay.sums[l - 1] + node * EXPERIENCE_FANOUT) :
+        (const void*)(replay.leaves + node * EXPERIENCE_FANOUT);
+    PREFETCH(children);
+    PREFETCH((const char*)children + 64);
+}
+
+// copy out slot _slot_ if it is not being written, false to draw again
+static inline bool readSlot(const ExperienceReplay& replay, unsigned long long slot, unsigned long long size,
+    Transition& out, unsigned int& units, unsigned int& before) {
+    const std::atomic<unsigned int>& version = replay.versions[slot];
+    before = version.load(std::memory_order_acquire);
+    units = replay.leaves[slot].load(std::memory_order_relaxed);
+    if ((before & 1) || !units || slot >= size) {
+        return false;
+    }
+    out = replay.transitions[slot];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version.load(std::memory_order_relaxed) == before;
+}
+
+unsigned int sampleTransitions(const ExperienceReplay& replay, unsigned long long& rng, unsigned int n, float beta,
+    unsigned long long* slots, unsigned int* versions, Transition* out, float* weights) {
+    unsigned long long size = experienceSize(replay);
+    if (!size || !n) {
+        return 0;
+    }
+
+    // descents run a level at a time for a group of draws, prefetching every draw's
+    // children before reading any, so their cache misses overlap
+    const unsigned int group = 32;
+    unsigned int levels = replay.header->layout.levels;
+    float maxWeight = 0.0f;
+
+    for (unsigned int g = 0; g < n; g += group) {
+        unsigned int count = n - g < group ? n - g : group;
+        unsigned long long node[group];
+        unsigned long long target[group];
+
+        // one draw from each of _n_ equal slices of the total
+        unsigned long long total = totalPriority(replay);
+        unsigned long long slice = total / n;
+        for (unsigned int j = 0; j < count; j++) {
+            node[j] = 0;
+            target[j] = slice * (g + j) + (slice ? nextRandom64(rng) % slice : 0);
+        }
+
+        for (unsigned int l = levels - 1; l > 0; l--) {
+            for (unsigned int j = 0; j < count; j++) {
+                prefetchChildren(replay, l, node[j]);
+            }
+            for (unsigned int j = 0; j < count; j++) {
+                node[j] = descend(replay, l, node[j], target[j]);
+            }
+        }
+        for (unsigned int j = 0; j < count; j++) {
+            PREFETCH(replay.transitions + node[j]);
+            PREFETCH(replay.versions + node[j]);
+        }
+
+        for (unsigned int j = 0; j < count; j++) {
+            unsigned int i = g + j;
+            unsigned long long slot = node[j];
+            unsigned int units;
+            while (!readSlot(replay, slot, size, out[i], units, versions[i])) {
+                // slot mid-write, draw again from the same slice
+                total = totalPriority(replay);
+                slice = total / n;
+                unsigned long long t = slice * i + (slice ? nextRandom64(rng) % slice : 0);
+                slot = 0;
+                for (unsigned int l = levels - 1; l > 0; l--) {
+                    slot = descend(replay, l, slot, t);
+                }
+            }
+
+            slots[i] = slot;
+            weights[i] = powf((float)size * (float)units / (float)total, -beta);
+            maxWeight = weights[i] > maxWeight ? weights[i] : maxWeight;
+        }
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        weights[i] /= maxWeight;
+    }
+    return n;
+}
+
+/*
+    observations
+*/
+
+void observe(const MatchBatch& batch, unsigned int m, int i, float* observation) {
+    // own paddle before the opponent's
+    observation[0] = batch.ballX[m];
+    observation[1] = batch.ballY[m];
+    observation[2] = batch.ballVX[m];
+    observation[3] = batch.ballVY[m];
+    observation[4] = batch.paddleY[i][m];
+    observation[5] = batch.paddleY[1 - i][m];
+    observation[6] = batch.paddleAngle[i][m];
+}
@@ -0,0 +1,108 @@
+#ifndef EXPERIENCE_H
+#define EXPERIENCE_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#include "sim.h"
+
+/*
+    prioritized experience replay in shared memory
+    a ring of transitions plus a sum tree over their priorities, all in one named
+    shared memory block so learner processes attach and sample concurrently
+    priorities are fixed point, so every tree node is an integer sum: an update swaps
+    the leaf and adds the difference to each ancestor with fetch_add, and any number of
+    updates and samples run at once without locks
+    the tree has 16 children per node, so a sample reads one or two cache lines per
+    level (7 levels for 100M transitions)
+    a transition being overwritten is caught with a per-slot sequence number: samplers
+    retry a slot mid-write, and a priority update for a transition that has since been
+    overwritten is dropped
+*/
+
+// floats in an observation
+const unsigned int OBSERVATION_SIZE = 7;
+
+// one step of one paddle (64 bytes)
+struct Transition {
+    float state[OBSERVATION_SIZE];
+    float nextState[OBSERVATION_SIZE];
+    float reward;
+    signed char action;     // input: 1 = up, -1 = down, 0 = idle
+    unsigned char done;     // match ended with this step
+    unsigned char pad[2];
+};
+
+const unsigned int EXPERIENCE_FANOUT = 16;
+const unsigned int EXPERIENCE_MAX_LEVELS = 12;
+
+// priorities are stored in units of 1 / EXPERIENCE_PRIORITY_SCALE
+const float EXPERIENCE_PRIORITY_SCALE = 65536.0f;
+
+// where everything is in the shared block
+struct ExperienceLayout {
+    char magic[8];
+    unsigned long long capacity;
+    unsigned int levels;    // level 0 is the leaves
+    unsigned int pad;
+    unsigned long long levelOffset[EXPERIENCE_MAX_LEVELS];  // bytes from the start of the block
+    unsigned long long levelCount[EXPERIENCE_MAX_LEVELS];
+    unsigned long long transitionsOffset;
+    unsigned long long versionsOffset;
+    size_t size;            // bytes of the block
+};
+
+// start of the shared block
+struct ExperienceHeader {
+    ExperienceLayout layout;
+    std::atomic<unsigned long long> cursor;     // transitions ever added
+    std::atomic<unsigned int> maxPriority;      // new transitions get the highest priority seen
+};
+
+// view of a shared block from one process
+struct ExperienceReplay {
+    ExperienceHeader* header;
+    Transition* transitions;
+    std::atomic<unsigned int>* versions;        // odd while a slot is written
+    std::atomic<unsigned int>* leaves;          // priority of each slot
+    std::atomic<unsigned long long>* sums[EXPERIENCE_MAX_LEVELS];   // levels above the leaves
+    void* handle;           // mapping object (windows)
+    bool owner;
+    std::string name;
+};
+
+// create the shared block _name_ for _capacity_ transitions
+bool createExperienceReplay(ExperienceReplay& replay, const char* name, unsigned long long capacity);
+
+// attach to a block created by another process
+bool attachExperienceReplay(ExperienceReplay& replay, const char* name);
+
+// detach, and remove the block if this process created it
+void closeExperienceReplay(ExperienceReplay& replay);
+
+// transitions held (at most the capacity)
+unsigned long long experienceSize(const ExperienceReplay& replay);
+
+// add a transition at the highest priority seen so far, overwriting the oldest when full
+// returns its slot
+unsigned long long addTransition(ExperienceReplay& replay, const Transition& transition);
+
+// set the priority of the transition drawn from _slot_ at _version_ (both from
+// sampleTransitions), false and nothing changed if the slot was overwritten since
+bool updatePriority(ExperienceReplay& replay, unsigned long long slot, unsigned int version, float priority);
+
+// draw _n_ slots in proportion to their priorities (one per equal slice of the total)
+// and copy them out with their versions and importance weights (N * P(i))^-beta,
+// scaled so the largest is 1
+// returns the number drawn (fewer if the buffer is empty)
+unsigned int sampleTransitions(const ExperienceReplay& replay, unsigned long long& rng, unsigned int n, float beta,
+    unsigned long long* slots, unsigned int* versions, Transition* out, float* weights);
+
+// sum of every priority in units
+unsigned long long totalPriority(const ExperienceReplay& replay);
+
+// observation of paddle _i_ of match _m_
+void observe(const MatchBatch& batch, unsigned int m, int i, float* observation);
+
+#endif
@@ -0,0 +1,381 @@
+#include "glresources.h"
+#include "memstats.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+// size class of a buffer, GL_POOL_CLASSES when too large to pool
+static unsigned int sizeClass(size_t size) {
+    unsigned int c = 0;
+    while (((size_t)1 << (c + GL_POOL_MIN_CLASS)) < size && c < GL_POOL_CLASSES) {
+        c++;
+    }
+    return c;
+}
+
+// bytes a buffer of _size_ gets: its size class, or the size itself past the largest
+static size_t bufferCapacity(size_t size) {
+    unsigned int c = sizeClass(size);
+    return c < GL_POOL_CLASSES ? (size_t)1 << (c + GL_POOL_MIN_CLASS) : size;
+}
+
+static void deleteObject(GLResources& resources, const RetiredObject& object) {
+    switch (object.kind) {
+    case GL_OBJECT_BUFFER:
+        trackGLObject(MEMORY_GL_BUFFERS, object.name, 0);
+        glDeleteBuffers(1, &object.name);
+        break;
+    case GL_OBJECT_VERTEX_ARRAY:
+        glDeleteVertexArrays(1, &object.name);
+        break;
+    case GL_OBJECT_PROGRAM:
+        glDeleteProgram(object.name);
+        break;
+    case GL_OBJECT_FRAMEBUFFER:
+        glDeleteFramebuffers(1, &object.name);
+        break;
+    }
+    resources.deleted++;
+}
+
+// the GPU is done with _object_: pool it if it is a buffer with room in its class
+// and in the budget
+static void freeObject(GLResources& resources, const RetiredObject& object) {
+    if (object.kind == GL_OBJECT_BUFFER) {
+        unsigned int c = sizeClass(object.capacity);
+        if (c < GL_POOL_CLASSES && ((size_t)1 << (c + GL_POOL_MIN_CLASS)) == object.capacity &&
+            resources.pool[c].size() < GL_POOL_BUFFERS &&
+            resources.pooledBytes + object.capacity <= resources.poolBudget) {
+            resources.pool[c].push_back({ object.name, resources.frame });
+            resources.pooledBytes += object.capacity;
+            resources.pooled++;
+            return;
+        }
+    }
+    deleteObject(resources, object);
+}
+
+// delete the pooled buffers of every class that have not been reused for a while
+// (each class is oldest first, so only its front is looked at)
+static void trimPool(GLResources& resources) {
+    for (unsigned int c = 0; c < GL_POOL_CLASSES; c++) {
+        std::deque<PooledBuffer>& pool = resources.pool[c];
+        size_t capacity = (size_t)1 << (c + GL_POOL_MIN_CLASS);
+        while (!pool.empty() && resources.frame - pool.front().frame > GL_POOL_IDLE_FRAMES) {
+            deleteObject(resources, { GL_OBJECT_BUFFER, pool.front().name, capacity });
+            pool.pop_front();
+            resources.pooledBytes -= capacity;
+            resources.trimmed++;
+        }
+    }
+}
+
+void initGLResources(GLResources& resources) {
+    resources.active = true;
+    resources.frame = 0;
+    resources.releasing.clear();
+    resources.retired.clear();
+    for (unsigned int c = 0; c < GL_POOL_CLASSES; c++) {
+        resources.pool[c].clear();
+    }
+    resources.pooledBytes = 0;
+    resources.poolBudget = GL_POOL_BUDGET;
+    resources.created = 0;
+    resources.reused = 0;
+    resources.pooled = 0;
+    resources.trimmed = 0;
+    resources.deleted = 0;
+    resources.waits = 0;
+}
+
+void destroyGLResources(GLResources& resources) {
+    if (!resources.active) {
+        return;
+    }
+    glFinish();
+    for (GLsync fence : resources.frameFences) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(fence);
+    }
+    for (RetiredFrame& retired : resources.retired) {
+        for (GLsync fence : retired.fences) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fence);
+        }
+        for (const RetiredObject& object : retired.objects) {
+            deleteObject(resources, object);
+        }
+    }
+    for (const RetiredObject& object : resources.releasing) {
+        deleteObject(resources, object);
+    }
+    for (unsigned int c = 0; c < GL_POOL_CLASSES; c++) {
+        for (const PooledBuffer& pooled : resources.pool[c]) {
+            deleteObject(resources, { GL_OBJECT_BUFFER, pooled.name, (size_t)1 << (c + GL_POOL_MIN_CLASS) });
+        }
+        resources.pool[c].clear();
+    }
+    resources.pooledBytes = 0;
+    resources.frameFences.clear();
+    resources.retired.clear();
+    resources.releasing.clear();
+    resources.active = false;
+}
+
+// true once every fence of _retired_ has passed; without waiting unless _wait_
+static bool fencesPassed(RetiredFrame& retired, bool wait) {
+    while (!retired.fences.empty()) {
+        GLsync fence = retired.fences.back();
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            if (!wait) {
+                return false;
+            }
+            // the other contexts flushed their fences, this flushes ours
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        glDeleteSync(fence);
+        retired.fences.pop_back();
+    }
+    return true;
+}
+
+void fenceGLFrame(GLResources& resources) {
+    resources.frameFences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+    // a fence waited on from another context has to have reached the GPU
+    glFlush();
+}
+
+void endGLFrame(GLResources& resources) {
+    if (!resources.releasing.empty()) {
+        RetiredFrame retired;
+        retired.objects.swap(resources.releasing);
+        retired.fences.swap(resources.frameFences);
+        retired.fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        retired.frame = resources.frame;
+        resources.retired.push_back(std::move(retired));
+    }
+    else {
+        // nothing to guard this frame
+        for (GLsync fence : resources.frameFences) {
+            glDeleteSync(fence);
+        }
+        resources.frameFences.clear();
+    }
+    resources.frame++;
+
+    while (!resources.retired.empty()) {
+        RetiredFrame& oldest = resources.retired.front();
+        if (resources.frame - oldest.frame < GL_RETIRE_FRAMES) {
+            break;
+        }
+
+        // zero timeout: ask, and only wait when the GPU is far behind
+        if (!fencesPassed(oldest, false)) {
+            if (resources.retired.size() < GL_MAX_RETIRED_FRAMES) {
+                break;
+            }
+            fencesPassed(oldest, true);
+            resources.waits++;
+        }
+
+        for (const RetiredObject& object : oldest.objects) {
+            freeObject(resources, object);
+        }
+        resources.retired.pop_front();
+    }
+
+    trimPool(resources);
+}
+
+void releaseObject(GLResources& resources, GLObjectKind kind, GLuint name, size_t capacity) {
+    // after destroyGLResources the context is gone or about to be, and the object with it
+    if (resources.active) {
+        resources.releasing.push_back({ kind, name, capacity });
+    }
+}
+
+BufferHandle createBuffer(GLResources& resources, GLenum target, size_t size, const void* data, GLenum usage) {
+    unsigned int c = sizeClass(size);
+    GLuint name = 0;
+    size_t capacity = bufferCapacity(size);
+    if (c < GL_POOL_CLASSES) {
+        // usage is only a hint, so an idle buffer of the class serves any request;
+        // the newest, so the ones left idle age out
+        if (!resources.pool[c].empty()) {
+            name = resources.pool[c].back().name;
+            resources.pool[c].pop_back();
+            resources.pooledBytes -= capacity;
+            resources.reused++;
+        }
+    }
+
+    if (name) {
+        glBindBuffer(target, name);
+    }
+    else {
+        glGenBuffers(1, &name);
+        glBindBuffer(target, name);
+        glBufferData(target, capacity, NULL, usage);
+        trackGLObject(MEMORY_GL_BUFFERS, name, capacity);
+        resources.created++;
+    }
+    if (data && size) {
+        glBufferSubData(target, 0, size, data);
+    }
+    return BufferHandle(&resources, name, capacity);
+}
+
+VertexArrayHandle createVertexArray(GLResources& resources) {
+    GLuint name;
+    glGenVertexArrays(1, &name);
+    resources.created++;
+    return VertexArrayHandle(&resources, name);
+}
+
+FramebufferHandle createFramebuffer(GLResources& resources) {
+    GLuint name;
+    glGenFramebuffers(1, &name);
+    resources.created++;
+    return FramebufferHandle(&resources, name);
+}
+
+ProgramHandle adoptProgram(GLResources& resources, GLuint program) {
+    resources.created++;
+    return ProgramHandle(&resources, program);
+}
+
+/*
+    instance buffers
+*/
+
+void initInstanceBuffer(InstanceBuffer& instances, size_t elementSize) {
+    instances.buffer.reset();
+    instances.elementSize = elementSize;
+    instances.capacity = 0;
+    instances.count = 0;
+    instances.lowFrames = 0;
+    instances.generation = 0;
+    instances.reallocations = 0;
+}
+
+// elements a buffer for _count_ of them holds once rounded to its size class
+static unsigned int roundCapacity(const InstanceBuffer& instances, unsigned int count) {
+    count = std::max(count, INSTANCE_MIN_CAPACITY);
+    return (unsigned int)(bufferCapacity(count * instances.elementSize) / instances.elementSize);
+}
+
+unsigned int instanceCapacity(InstanceBuffer& instances, unsigned int count) {
+    unsigned int capacity = instances.capacity;
+    if (count > capacity) {
+        instances.lowFrames = 0;
+        return roundCapacity(instances, std::max(count, capacity * 2));
+    }
+
+    // shrink to twice the count, so it can grow again before the next reallocation
+    if (count < capacity / 4) {
+        unsigned int smaller = roundCapacity(instances, count * 2);
+        if (smaller < capacity && ++instances.lowFrames >= INSTANCE_SHRINK_FRAMES) {
+            instances.lowFrames = 0;
+            return smaller;
+        }
+    }
+    else {
+        instances.lowFrames = 0;
+    }
+    return capacity;
+}
+
+bool updateInstances(GLResources& resources, InstanceBuffer& instances, const void* data, unsigned int count, GLenum usage) {
+    unsigned int capacity = instanceCapacity(instances, count);
+    bool reallocated = capacity != instances.capacity;
+    if (reallocated) {
+        instances.buffer = createBuffer(resources, GL_ARRAY_BUFFER, capacity * instances.elementSize, NULL, usage);
+        instances.capacity = (unsigned int)(instances.buffer.capacity / instances.elementSize);
+        instances.generation++;
+        instances.reallocations++;
+    }
+    instances.count = count;
+
+    if (count) {
+        PROFILE_GL("glBufferSubData");
+        glBindBuffer(GL_ARRAY_BUFFER, instances.buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * instances.elementSize, data);
+    }
+    return reallocated;
+}
+
+/*
+    stream buffers
+*/
+
+void initStreamBuffer(GLResources& resources, StreamBuffer& stream, size_t regionSize) {
+    // regions start on 256 bytes, so attribute offsets stay aligned
+    stream.regionSize = (regionSize + 255) & ~(size_t)255;
+    stream.buffer = createBuffer(resources, GL_ARRAY_BUFFER, STREAM_REGIONS * stream.regionSize, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stream.region = STREAM_REGIONS - 1;
+    for (unsigned int r = 0; r < STREAM_REGIONS; r++) {
+        stream.fences[r] = 0;
+    }
+    stream.mapped = NULL;
+    stream.waits = 0;
+}
+
+void destroyStreamBuffer(StreamBuffer& stream) {
+    if (stream.mapped) {
+        unmapStreamRegion(stream);
+    }
+    for (unsigned int r = 0; r < STREAM_REGIONS; r++) {
+        if (stream.fences[r]) {
+            glDeleteSync(stream.fences[r]);
+            stream.fences[r] = 0;
+        }
+    }
+    stream.buffer.reset();
+}
+
+void* mapStreamRegion(StreamBuffer& stream) {
+    // everything so far, the draws of the last region included
+    GLsync& last = stream.fences[stream.region];
+    if (last) {
+        glDeleteSync(last);
+    }
+    last = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    stream.region = (stream.region + 1) % STREAM_REGIONS;
+    GLsync& fence = stream.fences[stream.region];
+    if (fence) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            PROFILE_GL("stream region wait");
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            stream.waits++;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // the fence replaces the driver's own synchronization, and nothing is read back
+    glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    stream.mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, streamRegionOffset(stream, stream.region),
+        stream.regionSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return stream.mapped;
+}
+
+void flushStreamRange(StreamBuffer& stream, size_t offset, size_t size) {
+    if (size) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, offset, size);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+bool unmapStreamRegion(StreamBuffer& stream) {
+    glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    bool ok = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stream.mapped = NULL;
+    return ok;
+}
@@ -0,0 +1,226 @@
+#ifndef GLRESOURCES_H
+#define GLRESOURCES_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+/*
+    GL object lifetimes
+    objects are held by typed handles that give them back to their GLResources when
+    they go out of scope or are replaced; nothing is deleted right away, a frame's
+    released objects are fenced and deleted a few frames later, once the GPU is done
+    with them, so a delete never waits on the driver mid-frame
+    released buffers go to a pool by power-of-two size class instead of being deleted,
+    and new buffers are taken from it first, so objects that come and go (balls,
+    particles, HUD) reuse storage rather than allocate; the pool holds at most
+    poolBudget bytes, and a buffer left in it for GL_POOL_IDLE_FRAMES is deleted
+    buffers and programs are shared between contexts and can live in one GLResources;
+    vertex arrays and framebuffers are not, each context needs its own
+    a fence only covers the commands of the context it was placed in, so every other
+    context drawing with shared objects fences its frame with fenceGLFrame, and the
+    objects released that frame wait for all of those fences
+*/
+
+enum GLObjectKind {
+    GL_OBJECT_BUFFER,
+    GL_OBJECT_VERTEX_ARRAY,
+    GL_OBJECT_PROGRAM,
+    GL_OBJECT_FRAMEBUFFER
+};
+
+const unsigned int GL_RETIRE_FRAMES = 3;        // frames a released object waits at least
+const unsigned int GL_MAX_RETIRED_FRAMES = 16;  // frames waiting before the oldest is waited for
+const unsigned int GL_POOL_MIN_CLASS = 8;       // smallest buffer is 256 bytes
+const unsigned int GL_POOL_CLASSES = 20;        // up to 128 MB, larger ones are not pooled
+const unsigned int GL_POOL_BUFFERS = 16;        // buffers kept per class
+const size_t GL_POOL_BUDGET = (size_t)32 << 20; // default bytes kept in the pool
+const unsigned int GL_POOL_IDLE_FRAMES = 300;   // frames a pooled buffer waits to be reused
+
+struct RetiredObject {
+    GLObjectKind kind;
+    GLuint name;
+    size_t capacity;    // bytes of a buffer
+};
+
+struct RetiredFrame {
+    std::vector<RetiredObject> objects;
+    std::vector<GLsync> fences;     // one per context that drew this frame
+    unsigned long long frame;
+};
+
+struct PooledBuffer {
+    GLuint name;
+    unsigned long long frame;   // pooled in
+};
+
+struct GLResources {
+    bool active;
+    unsigned long long frame;
+    std::vector<RetiredObject> releasing;       // released this frame
+    std::vector<GLsync> frameFences;            // of the other contexts this frame
+    std::deque<RetiredFrame> retired;           // fenced, oldest first
+    std::deque<PooledBuffer> pool[GL_POOL_CLASSES];  // idle buffers per size class, oldest first
+    size_t pooledBytes;
+    size_t poolBudget;
+
+    // counters
+    unsigned long long created;     // objects made by GL
+    unsigned long long reused;      // buffers taken from the pool
+    unsigned long long pooled;      // buffers given to the pool
+    unsigned long long trimmed;     // pooled buffers deleted after idling
+    unsigned long long deleted;     // objects deleted
+    unsigned long long waits;       // times the GPU was so far behind that a fence was waited on
+};
+
+void initGLResources(GLResources& resources);
+
+// wait for the GPU and delete everything released or pooled (the context must be
+// current); handles released afterwards are dropped
+void destroyGLResources(GLResources& resources);
+
+// fence the commands of the current context, which used the objects of _resources_
+// this frame (call after its draws, in every context but the one that ends the frame)
+void fenceGLFrame(GLResources& resources);
+
+// fence what was released this frame, delete or pool what has passed its fences
+// (this context's and those of fenceGLFrame) and delete pooled buffers that idled too long
+void endGLFrame(GLResources& resources);
+
+// hand an object back; used by the handles
+void releaseObject(GLResources& resources, GLObjectKind kind, GLuint name, size_t capacity);
+
+// owner of one GL object, converts to its name
+template<GLObjectKind kind>
+struct GLHandle {
+    GLuint name;
+    size_t capacity;
+    GLResources* owner;
+
+    GLHandle() : name(0), capacity(0), owner(NULL) {}
+    GLHandle(GLResources* owner, GLuint name, size_t capacity = 0) : name(name), capacity(capacity), owner(owner) {}
+    GLHandle(GLHandle&& other) : name(other.name), capacity(other.capacity), owner(other.owner) {
+        other.name = 0;
+    }
+    GLHandle& operator=(GLHandle&& other) {
+        if (this != &other) {
+            reset();
+            name = other.name;
+            capacity = other.capacity;
+            owner = other.owner;
+            other.name = 0;
+        }
+        return *this;
+    }
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+    ~GLHandle() {
+        reset();
+    }
+
+    void reset() {
+        if (name && owner) {
+            releaseObject(*owner, kind, name, capacity);
+        }
+        name = 0;
+    }
+
+    operator GLuint() const {
+        return name;
+    }
+};
+
+typedef GLHandle<GL_OBJECT_BUFFER> BufferHandle;
+typedef GLHandle<GL_OBJECT_VERTEX_ARRAY> VertexArrayHandle;
+typedef GLHandle<GL_OBJECT_PROGRAM> ProgramHandle;
+typedef GLHandle<GL_OBJECT_FRAMEBUFFER> FramebufferHandle;
+
+// buffer of at least _size_ bytes bound to _target_, from the pool when one of its
+// size class is idle; _data_ (may be NULL) is copied to the start
+BufferHandle createBuffer(GLResources& resources, GLenum target, size_t size, const void* data, GLenum usage);
+
+VertexArrayHandle createVertexArray(GLResources& resources);
+
+FramebufferHandle createFramebuffer(GLResources& resources);
+
+// take ownership of a linked program
+ProgramHandle adoptProgram(GLResources& resources, GLuint program);
+
+/*
+    instance buffers
+    per-instance attributes whose count changes from frame to frame: the capacity
+    doubles when the count outgrows it and halves only after the count has stayed
+    under a quarter of it for a while, so a count going back and forth does not
+    reallocate; a reallocation takes a new buffer (the old one is released like any
+    other) and bumps the generation, and only then do vertex arrays reading the
+    buffer need their attribute pointers set again
+*/
+
+const unsigned int INSTANCE_MIN_CAPACITY = 16;      // elements
+const unsigned int INSTANCE_SHRINK_FRAMES = 120;    // frames under a quarter before halving
+
+struct InstanceBuffer {
+    BufferHandle buffer;
+    size_t elementSize;
+    unsigned int capacity;          // elements the buffer holds
+    unsigned int count;             // elements written last
+    unsigned int lowFrames;         // frames in a row under a quarter of the capacity
+    unsigned int generation;        // bumped on every reallocation
+    unsigned long long reallocations;
+};
+
+void initInstanceBuffer(InstanceBuffer& instances, size_t elementSize);
+
+// capacity wanted for _count_ elements this frame, the current one unless the buffer
+// has to grow or has been oversized for long enough (updates the shrink countdown)
+unsigned int instanceCapacity(InstanceBuffer& instances, unsigned int count);
+
+// write _count_ elements from the start, reallocating first if instanceCapacity asks
+// for it; returns true if the buffer was replaced
+bool updateInstances(GLResources& resources, InstanceBuffer& instances, const void* data, unsigned int count,
+    GLenum usage = GL_DYNAMIC_DRAW);
+
+/*
+    stream buffers
+    a buffer of a few regions written in turn, one per frame; a region is mapped
+    unsynchronized once the fence placed when it was last handed to GL has passed, so
+    mapping never waits on draws still reading the other regions
+    the pointer can be written by any thread; the render thread flushes what was
+    written and unmaps before drawing from the region
+    the fence covers commands of the context that maps, so every draw reading the
+    buffer must be made in that context
+*/
+
+const unsigned int STREAM_REGIONS = 3;
+
+struct StreamBuffer {
+    BufferHandle buffer;
+    size_t regionSize;
+    unsigned int region;                // mapped, or last written
+    GLsync fences[STREAM_REGIONS];      // after the draws of each region
+    unsigned char* mapped;              // NULL when not mapped
+    unsigned long long waits;           // maps that found the GPU still reading the region
+};
+
+void initStreamBuffer(GLResources& resources, StreamBuffer& stream, size_t regionSize);
+
+void destroyStreamBuffer(StreamBuffer& stream);
+
+// fence the draws of the region written last and map the next one for writing,
+// NULL if GL refused
+void* mapStreamRegion(StreamBuffer& stream);
+
+// make _size_ bytes at _offset_ of the mapped region visible to GL
+void flushStreamRange(StreamBuffer& stream, size_t offset, size_t size);
+
+// unmap, false if the data was lost (draw nothing from the region then)
+bool unmapStreamRegion(StreamBuffer& stream);
+
+// byte offset of region _r_ in the buffer
+inline size_t streamRegionOffset(const StreamBuffer& stream, unsigned int r) {
+    return r * stream.regionSize;
+}
+
+#endif
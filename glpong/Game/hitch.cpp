@@ -0,0 +1,173 @@
+#include "hitch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// records kept for a dump (8 MB)
+const size_t hitchCaptureRecords = 1 << 18;
+
+HitchParams defaultHitchParams() {
+    HitchParams params;
+    params.factor = 2.5f;
+    params.minFrame = 0.008f;
+    params.history = 3.0f;
+    params.cooldown = 10.0f;
+    params.medianFrames = 121;
+    params.directory = ".";
+    return params;
+}
+
+/*
+    writer thread
+*/
+
+static void writeHitch(HitchDetector& detector) {
+    double start = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // the rings hold far more than the history, so copying now (not on the render
+    // thread at the hitch) still has everything before it, plus what came after
+    unsigned long long history = (unsigned long long)(detector.params.history * 1e9);
+    captureTrace(detector.capture, detector.hitchStart - std::min(detector.hitchStart, history));
+
+    const SimSnapshot& s = detector.snapshot;
+    char otherData[1024];
+    snprintf(otherData, sizeof(otherData),
+        "\"hitch_frame\":%llu,\"frame_ms\":%.3f,\"median_ms\":%.3f,"
+        "\"sim\":{\"ball\":[%.9g,%.9g],\"ball_velocity\":[%.9g,%.9g],\"ball_spin\":%.9g,"
+        "\"paddle_y\":[%.9g,%.9g],\"paddle_v\":[%.9g,%.9g],\"paddle_angle\":[%.9g,%.9g],"
+        "\"input\":[%d,%d],\"tilt_input\":[%d,%d],\"score\":[%u,%u],"
+        "\"frames_since_last_collision\":%u,\"state_hash\":\"%016llx\"}",
+        detector.hitchFrame, (detector.hitchEnd - detector.hitchStart) * 1e-6, detector.median * 1e3,
+        s.ballX, s.ballY, s.ballVX, s.ballVY, s.ballSpin,
+        s.paddleY[0], s.paddleY[1], s.paddleV[0], s.paddleV[1], s.paddleAngle[0], s.paddleAngle[1],
+        s.input[0], s.input[1], s.tiltInput[0], s.tiltInput[1], s.score[0], s.score[1],
+        s.framesSinceLastCollision, s.stateHash);
+
+    std::string path = std::string(detector.params.directory) + "/hitch-" + std::to_string(detector.dumps) + ".json";
+    if (writeChromeTrace(path.c_str(), detector.capture, otherData)) {
+        detector.dumps++;
+    }
+    detector.writeTime = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count() - start;
+}
+
+static void writerLoop(HitchDetector& detector) {
+    profilerThreadName("hitch writer");
+    std::unique_lock<std::mutex> guard(detector.lock);
+    for (;;) {
+        detector.wake.wait(guard, [&]() { return detector.stopping || detector.pending; });
+        if (detector.pending) {
+            guard.unlock();
+            writeHitch(detector);
+            guard.lock();
+            detector.pending = false;
+            detector.wake.notify_all();
+        }
+        else {
+            return;
+        }
+    }
+}
+
+/*
+    render thread
+*/
+
+bool startHitchDetector(HitchDetector& detector, const HitchParams& params) {
+    detector.params = params;
+    detector.params.medianFrames = std::max(3u, std::min(params.medianFrames, HITCH_MAX_MEDIAN_FRAMES));
+    if (!allocLarge(detector.block, hitchCaptureRecords * sizeof(TraceRecord), 0, MEMORY_PROFILER)) {
+        return false;
+    }
+    detector.capture.records = (TraceRecord*)detector.block.ptr;
+    detector.capture.capacity = hitchCaptureRecords;
+    detector.capture.count = 0;
+    detector.capture.noThreads = 0;
+
+    detector.noFrames = 0;
+    detector.frames = 0;
+    detector.lastDump = 0;
+    detector.pending = false;
+    detector.stopping = false;
+    detector.hitches = 0;
+    detector.dumps = 0;
+    detector.skipped = 0;
+    detector.checkTime = 0;
+    detector.writeTime = 0.0;
+    detector.writer = std::thread(writerLoop, std::ref(detector));
+    return true;
+}
+
+void stopHitchDetector(HitchDetector& detector) {
+    {
+        std::unique_lock<std::mutex> guard(detector.lock);
+        detector.wake.wait(guard, [&]() { return !detector.pending; });
+        detector.stopping = true;
+    }
+    detector.wake.notify_all();
+    detector.writer.join();
+    freeLarge(detector.block);
+}
+
+bool endFrame(HitchDetector& detector, unsigned long long start, unsigned long long end,
+    const MatchBatch& batch, unsigned int m, unsigned long long stateHash) {
+    const HitchParams& params = detector.params;
+    traceRecord(TRACE_FRAME, "frame", start, end - start, (unsigned int)detector.frames);
+
+    // median of the frames before this one
+    float frameTime = (end - start) * 1e-9f;
+    unsigned int n = detector.noFrames;
+    float median = 0.0f;
+    if (n >= params.medianFrames / 2) {
+        std::copy(detector.frameTimes, detector.frameTimes + n, detector.sorted);
+        std::nth_element(detector.sorted, detector.sorted + n / 2, detector.sorted + n);
+        median = detector.sorted[n / 2];
+    }
+    detector.frameTimes[detector.frames % params.medianFrames] = frameTime;
+    detector.noFrames = std::min(n + 1, params.medianFrames);
+    detector.frames++;
+
+    bool hitch = median > 0.0f && frameTime > params.factor * median && frameTime > params.minFrame;
+    if (!hitch) {
+        detector.checkTime = profilerTime() - end;
+        return false;
+    }
+    detector.hitches++;
+
+    // rate limit, and never wait for the writer
+    bool cooling = detector.lastDump && end - detector.lastDump < (unsigned long long)(params.cooldown * 1e9);
+    std::unique_lock<std::mutex> guard(detector.lock, std::try_to_lock);
+    if (cooling || !guard.owns_lock() || detector.pending) {
+        detector.skipped++;
+        return false;
+    }
+
+    SimSnapshot& s = detector.snapshot;
+    s.ballX = batch.ballX[m];
+    s.ballY = batch.ballY[m];
+    s.ballVX = batch.ballVX[m];
+    s.ballVY = batch.ballVY[m];
+    s.ballSpin = batch.ballSpin[m];
+    for (int i = 0; i < 2; i++) {
+        s.paddleY[i] = batch.paddleY[i][m];
+        s.paddleV[i] = batch.paddleV[i][m];
+        s.paddleAngle[i] = batch.paddleAngle[i][m];
+        s.input[i] = batch.input[i][m];
+        s.tiltInput[i] = batch.tiltInput[i][m];
+        s.score[i] = batch.score[i][m];
+    }
+    s.framesSinceLastCollision = batch.framesSinceLastCollision[m];
+    s.stateHash = stateHash;
+    detector.hitchStart = start;
+    detector.hitchEnd = end;
+    detector.hitchFrame = detector.frames - 1;
+    detector.median = median;
+    detector.lastDump = end;
+    detector.pending = true;
+    guard.unlock();
+    detector.wake.notify_all();
+
+    detector.checkTime = profilerTime() - end;
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef HITCH_H
+#define HITCH_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "largealloc.h"
+#include "profiler.h"
+#include "sim.h"
+
+/*
+    hitch detector
+    every frame is compared with the median of the frames before it; a frame well
+    above it freezes the match state and wakes a writer thread, which copies the
+    profiler rings around the frame and writes them as a Chrome trace with the match
+    state attached
+    the render thread only sorts a small window and copies one match, dumps are rate
+    limited, and a hitch while a dump is still being written is counted and skipped
+*/
+
+const unsigned int HITCH_MAX_MEDIAN_FRAMES = 255;
+
+struct HitchParams {
+    float factor;               // hitch above factor * rolling median
+    float minFrame;             // and above this many seconds
+    float history;              // seconds of trace before the hitch that are written
+    float cooldown;             // seconds between dumps
+    unsigned int medianFrames;  // frames in the rolling median
+    const char* directory;      // where hitch-<n>.json files go
+};
+
+// 2.5x the median of the last 121 frames and at least 8 ms, 3 s of history, a dump
+// at most every 10 s
+HitchParams defaultHitchParams();
+
+// one match at the end of the slow frame
+struct SimSnapshot {
+    float ballX;
+    float ballY;
+    float ballVX;
+    float ballVY;
+    float ballSpin;
+    float paddleY[2];
+    float paddleV[2];
+    float paddleAngle[2];
+    signed char input[2];
+    signed char tiltInput[2];
+    unsigned int score[2];
+    unsigned int framesSinceLastCollision;
+    unsigned long long stateHash;
+};
+
+struct HitchDetector {
+    HitchParams params;
+
+    // frame times (render thread)
+    float frameTimes[HITCH_MAX_MEDIAN_FRAMES];  // ring of the latest frames
+    float sorted[HITCH_MAX_MEDIAN_FRAMES];
+    unsigned int noFrames;
+    unsigned long long frames;
+    unsigned long long lastDump;    // profiler time of the last captured hitch
+
+    // hitch handed to the writer
+    SimSnapshot snapshot;
+    unsigned long long hitchStart;
+    unsigned long long hitchEnd;
+    unsigned long long hitchFrame;
+    float median;
+
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool pending;
+    bool stopping;
+    LargeBlock block;
+    TraceCapture capture;   // writer thread
+
+    // counters
+    unsigned int hitches;           // frames over the threshold
+    unsigned int dumps;             // traces written
+    unsigned int skipped;           // hitches in the cooldown or while writing
+    unsigned long long checkTime;   // ns the render thread spent in the last endFrame
+    double writeTime;               // seconds spent on the last dump
+};
+
+bool startHitchDetector(HitchDetector& detector, const HitchParams& params);
+
+// wait for a dump in progress and stop the writer
+void stopHitchDetector(HitchDetector& detector);
+
+// end of a frame that ran from _start_ to _end_ (profiler time): records the frame
+// and captures a hitch with match _m_'s state, returns true if one was captured
+bool endFrame(HitchDetector& detector, unsigned long long start, unsigned long long end,
+    const MatchBatch& batch, unsigned int m, unsigned long long stateHash);
+
+#endif
@@ -0,0 +1,111 @@
+#include "instancefill.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static_assert(sizeof(SpectatorInstance) == 12, "instances are interleaved attributes");
+static_assert(FILL_CHUNK * sizeof(SpectatorInstance) % 64 == 0, "chunks start on cache lines");
+
+TileLayout tileLayout(const SimParams& params, unsigned int matches) {
+    TileLayout layout;
+    matches = std::max(matches, 1u);
+    layout.columns = std::max(1u, (unsigned int)std::ceil(std::sqrt((float)matches)));
+    unsigned int rows = (matches + layout.columns - 1) / layout.columns;
+    layout.scale = 1.0f / std::max(layout.columns, rows);
+    layout.tileWidth = params.width * layout.scale;
+    layout.tileHeight = params.height * layout.scale;
+    layout.paddleSize = { params.paddleWidth * layout.scale, params.paddleHeight * layout.scale };
+    layout.ballSize = { 2.0f * params.ballRadius * layout.scale, 2.0f * params.ballRadius * layout.scale };
+    layout.paddlePalette[0] = 0;
+    layout.paddlePalette[1] = 1;
+    layout.flashPalette[0] = 3;
+    layout.flashPalette[1] = 4;
+    layout.ballPalette = 2;
+    layout.flashFrames = 24;
+    return layout;
+}
+
+// nearest half float of a tilt (at most pi, so never past the half range; tilts too
+// small for a normal half become 0)
+static unsigned short halfAngle(float angle) {
+    unsigned int bits;
+    memcpy(&bits, &angle, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    if (exponent <= 0) {
+        return (unsigned short)sign;
+    }
+    unsigned int mantissa = bits & 0x7fffff;
+    unsigned int half = sign | (unsigned int)exponent << 10 | mantissa >> 13;
+
+    // round half up, a carry out of the mantissa correctly bumps the exponent
+    return (unsigned short)(half + ((mantissa >> 12) & 1));
+}
+
+void fillInstances(const MatchBatch& batch, const SimParams& params, const TileLayout& layout,
+    unsigned int first, unsigned int end, SpectatorInstance* paddles, SpectatorInstance* balls) {
+    float scale = layout.scale;
+    float paddleXs[2] = { paddleX(params, 0) * scale, paddleX(params, 1) * scale };
+
+    for (unsigned int m = first; m < end; m++) {
+        float tileX = (m % layout.columns) * layout.tileWidth;
+        float tileY = (m / layout.columns) * layout.tileHeight;
+
+        // the paddle the ball moves away from hit it
+        bool flash = batch.framesSinceLastCollision[m] < layout.flashFrames;
+        int hitter = batch.ballVX[m] > 0.0f ? 0 : 1;
+
+        for (int i = 0; i < 2; i++) {
+            SpectatorInstance& paddle = paddles[2 * m + i];
+            paddle.offset = { tileX + paddleXs[i], tileY + batch.paddleY[i][m] * scale };
+            paddle.angle = halfAngle(batch.paddleAngle[i][m]);
+            paddle.palette = flash && hitter == i ? layout.flashPalette[i] : layout.paddlePalette[i];
+            paddle.pad = 0;
+        }
+
+        SpectatorInstance& ball = balls[m];
+        ball.offset = { tileX + batch.ballX[m] * scale, tileY + batch.ballY[m] * scale };
+        ball.angle = 0;
+        ball.palette = layout.ballPalette;
+        ball.pad = 0;
+    }
+}
+
+/*
+    workers
+*/
+
+static void fillChunk(void* context, unsigned int worker, unsigned int chunk) {
+    InstanceFiller& filler = *(InstanceFiller*)context;
+    unsigned int first = chunk * FILL_CHUNK;
+    unsigned int end = std::min(first + FILL_CHUNK, filler.batch->count);
+    fillInstances(*filler.batch, *filler.params, *filler.layout, first, end, filler.paddles, filler.balls);
+}
+
+void startInstanceFiller(InstanceFiller& filler, unsigned int threads) {
+    startTaskPool(filler.pool, threads);
+}
+
+void stopInstanceFiller(InstanceFiller& filler) {
+    stopTaskPool(filler.pool);
+}
+
+void fillParallel(InstanceFiller& filler, const MatchBatch& batch, const SimParams& params, const TileLayout& layout,
+    SpectatorInstance* paddles, SpectatorInstance* balls) {
+    unsigned int noChunks = (batch.count + FILL_CHUNK - 1) / FILL_CHUNK;
+
+    // a single chunk is not worth waking anyone for
+    if (filler.pool.noThreads == 1 || noChunks == 1) {
+        fillInstances(batch, params, layout, 0, batch.count, paddles, balls);
+        return;
+    }
+
+    // the pool's lock publishes the job to the workers
+    filler.batch = &batch;
+    filler.params = &params;
+    filler.layout = &layout;
+    filler.paddles = paddles;
+    filler.balls = balls;
+    runTasks(filler.pool, noChunks, fillChunk, &filler);
+}
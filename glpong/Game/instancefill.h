@@ -0,0 +1,87 @@
+#ifndef INSTANCEFILL_H
+#define INSTANCEFILL_H
+
+#include "sim.h"
+#include "taskpool.h"
+
+/*
+    instance data from simulation state
+    every match of a batch becomes two paddle instances and a ball instance, placed in
+    a tile of a grid over the field; the instances go straight into the buffer the GPU
+    reads (a mapped range), so nothing is gathered into an array and copied later
+    a task pool fills it: matches are split into chunks, each chunk lands in its
+    own range of the paddle and ball arrays, so the writers never share a cache line
+    and the render thread only flushes the ranges and draws
+    an instance carries only what differs between tiles: the sizes are the same for
+    every paddle and every ball and go to the draw as constant attributes, and the
+    angle is a half float, so an instance is 12 bytes and a tile 36
+*/
+
+// one instance, the per-instance attributes of the shader interleaved (12 bytes)
+struct SpectatorInstance {
+    vec2 offset;            // field position of the center
+    unsigned short angle;   // half float
+    unsigned char palette;  // palette entry
+    unsigned char pad;
+};
+
+// where the tiles go and which palette entries they use (the game's palette order
+// unless changed)
+struct TileLayout {
+    unsigned int columns;
+    float tileWidth;
+    float tileHeight;
+    float scale;                    // tile size over field size
+    vec2 paddleSize;                // of every paddle instance
+    vec2 ballSize;                  // of every ball instance
+    unsigned char paddlePalette[2];
+    unsigned char flashPalette[2];  // a paddle that just hit the ball
+    unsigned char ballPalette;
+    unsigned int flashFrames;       // ticks a hit flashes for
+};
+
+// square-ish grid of _matches_ tiles over the field
+TileLayout tileLayout(const SimParams& params, unsigned int matches);
+
+// bytes of the paddle instances of _matches_ matches, rounded up to a cache line so
+// the balls after them start on one
+inline size_t paddleRegionBytes(unsigned int matches) {
+    return (2 * (size_t)matches * sizeof(SpectatorInstance) + 63) & ~(size_t)63;
+}
+
+// paddles, then balls
+inline size_t spectatorRegionBytes(unsigned int matches) {
+    return paddleRegionBytes(matches) + (size_t)matches * sizeof(SpectatorInstance);
+}
+
+// instances of matches [first, end): paddles of match m at paddles[2m], 2m + 1, its
+// ball at balls[m]
+void fillInstances(const MatchBatch& batch, const SimParams& params, const TileLayout& layout,
+    unsigned int first, unsigned int end, SpectatorInstance* paddles, SpectatorInstance* balls);
+
+// matches per chunk, a multiple of 16 so chunk boundaries fall on cache lines (16
+// balls of 12 bytes are 3 lines, and a chunk's paddles twice that)
+const unsigned int FILL_CHUNK = 2048;
+
+struct InstanceFiller {
+    TaskPool pool;
+
+    // current job
+    const MatchBatch* batch;
+    const SimParams* params;
+    const TileLayout* layout;
+    SpectatorInstance* paddles;
+    SpectatorInstance* balls;
+};
+
+// start _threads_ - 1 workers (0 = one per core)
+void startInstanceFiller(InstanceFiller& filler, unsigned int threads);
+
+void stopInstanceFiller(InstanceFiller& filler);
+
+// fill every match of _batch_ with the workers and the calling thread, returns once
+// all of it is written
+void fillParallel(InstanceFiller& filler, const MatchBatch& batch, const SimParams& params, const TileLayout& layout,
+    SpectatorInstance* paddles, SpectatorInstance* balls);
+
+#endif
@@ -0,0 +1,609 @@
+#include "iowriter.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#define IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// most buffers gathered into one submission
+const unsigned int maxBatch = 64;
+
+// ring size (completions get twice as many entries)
+const unsigned int ringEntries = 256;
+
+// user data of completions that are not buffer writes
+const unsigned long long syncTag = 1ull << 32;
+const unsigned long long wakeTag = 2ull << 32;
+
+/*
+    index queue
+    bounded queue with a sequence number per cell (Vyukov)
+*/
+
+static bool initQueue(IndexQueue& queue, unsigned int capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    queue.cells = new IndexQueue::Cell[size];
+    for (size_t i = 0; i < size; i++) {
+        queue.cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    queue.mask = size - 1;
+    queue.head.store(0, std::memory_order_relaxed);
+    queue.tail.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+static void freeQueue(IndexQueue& queue) {
+    delete[] queue.cells;
+    queue.cells = NULL;
+}
+
+static bool pushQueue(IndexQueue& queue, unsigned int value) {
+    size_t pos = queue.tail.load(std::memory_order_relaxed);
+    for (;;) {
+        IndexQueue::Cell& cell = queue.cells[pos & queue.mask];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        long long diff = (long long)seq - (long long)pos;
+        if (diff == 0) {
+            if (queue.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.value = value;
+                cell.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            // full
+            return false;
+        }
+        else {
+            pos = queue.tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+static bool popQueue(IndexQueue& queue, unsigned int& value) {
+    size_t pos = queue.head.load(std::memory_order_relaxed);
+    for (;;) {
+        IndexQueue::Cell& cell = queue.cells[pos & queue.mask];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        long long diff = (long long)seq - (long long)(pos + 1);
+        if (diff == 0) {
+            if (queue.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                value = cell.value;
+                cell.seq.store(pos + queue.mask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            // empty
+            return false;
+        }
+        else {
+            pos = queue.head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/*
+    blocking file calls (used when io_uring is not available)
+*/
+
+#ifdef _WIN32
+
+static int openFile(const char* path) {
+    return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+
+static bool writeAt(int fd, const void* data, size_t size, unsigned long long offset) {
+    return _lseeki64(fd, (long long)offset, SEEK_SET) >= 0 && _write(fd, data, (unsigned int)size) == (int)size;
+}
+
+static bool syncFile(int fd) {
+    return _commit(fd) == 0;
+}
+
+static void closeFile(int fd) {
+    _close(fd);
+}
+
+#else
+
+static int openFile(const char* path) {
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+static bool writeAt(int fd, const void* data, size_t size, unsigned long long offset) {
+    return pwrite(fd, data, size, (off_t)offset) == (ssize_t)size;
+}
+
+static bool syncFile(int fd) {
+#ifdef __APPLE__
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+static void closeFile(int fd) {
+    close(fd);
+}
+
+#endif
+
+/*
+    io_uring
+*/
+
+#ifdef IO_URING
+
+static int ringSetup(unsigned int entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ringEnter(int ring, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int ringRegister(int ring, unsigned int opcode, const void* arg, unsigned int count) {
+    return (int)syscall(__NR_io_uring_register, ring, opcode, arg, count);
+}
+
+// map the rings of a new io_uring and register the buffer pool, false if unavailable
+static bool openRing(IOService& service) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * ringEntries;
+
+    int ring = ringSetup(ringEntries, &params);
+    if (ring < 0) {
+        return false;
+    }
+
+    // the submission and completion rings share one mapping since 5.4, older
+    // kernels take the blocking path
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring);
+        return false;
+    }
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    size_t mapSize = sqSize > cqSize ? sqSize : cqSize;
+    size_t sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    void* map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (map == MAP_FAILED) {
+        close(ring);
+        return false;
+    }
+    void* sqes = mmap(NULL, sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(map, mapSize);
+        close(ring);
+        return false;
+    }
+
+    // pin the buffer pool so writes skip the per-request page lookup
+    iovec* iovecs = new iovec[service.noBuffers];
+    for (unsigned int i = 0; i < service.noBuffers; i++) {
+        iovecs[i].iov_base = service.buffers[i].data;
+        iovecs[i].iov_len = service.bufferSize;
+    }
+    int registered = ringRegister(ring, IORING_REGISTER_BUFFERS, iovecs, service.noBuffers);
+    delete[] iovecs;
+    if (registered < 0) {
+        munmap(sqes, sqeSize);
+        munmap(map, mapSize);
+        close(ring);
+        return false;
+    }
+
+    unsigned char* base = (unsigned char*)map;
+    service.ring = ring;
+    service.sqEntries = params.sq_entries;
+    service.cqEntries = params.cq_entries;
+    service.sqHead = (unsigned int*)(base + params.sq_off.head);
+    service.sqTail = (unsigned int*)(base + params.sq_off.tail);
+    service.sqMask = (unsigned int*)(base + params.sq_off.ring_mask);
+    service.sqArray = (unsigned int*)(base + params.sq_off.array);
+    service.sqes = sqes;
+    service.cqHead = (unsigned int*)(base + params.cq_off.head);
+    service.cqTail = (unsigned int*)(base + params.cq_off.tail);
+    service.cqMask = (unsigned int*)(base + params.cq_off.ring_mask);
+    service.cqes = base + params.cq_off.cqes;
+    service.ringMap = map;
+    service.ringMapSize = mapSize;
+    service.sqeMapSize = sqeSize;
+    return true;
+}
+
+static void closeRing(IOService& service) {
+    munmap(service.sqes, service.sqeMapSize);
+    munmap(service.ringMap, service.ringMapSize);
+    close(service.ring);
+    service.ring = -1;
+}
+
+// next free submission entry, cleared (submit thread only)
+static io_uring_sqe* nextSqe(IOService& service, unsigned int& tail) {
+    unsigned int idx = tail & *service.sqMask;
+    io_uring_sqe* sqe = (io_uring_sqe*)service.sqes + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    service.sqArray[idx] = idx;
+    tail++;
+    return sqe;
+}
+
+// write the entries of the submission ring the kernel did not take on this thread and
+// take them back out of the ring (submit thread only)
+static void writeUnsubmitted(IOService& service, unsigned int tail) {
+    unsigned int head = __atomic_load_n(service.sqHead, __ATOMIC_ACQUIRE);
+    for (unsigned int t = head; t != tail; t++) {
+        const io_uring_sqe& sqe = ((const io_uring_sqe*)service.sqes)[service.sqArray[t & *service.sqMask]];
+        if (sqe.opcode == IORING_OP_WRITE_FIXED) {
+            IOBuffer& buffer = service.buffers[sqe.user_data];
+            if (writeAt(sqe.fd, buffer.data, buffer.size, sqe.off)) {
+                service.bytesWritten.fetch_add(buffer.size, std::memory_order_relaxed);
+                service.writes.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                service.errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            service.fileWrites[buffer.file].fetch_sub(1, std::memory_order_release);
+            pushQueue(service.freeBuffers, buffer.index);
+        }
+        else if (sqe.opcode == IORING_OP_FSYNC) {
+            // writes of its chain the kernel did take have to land first
+            unsigned int f = (unsigned int)(sqe.user_data & 0xffffffffull);
+            while (service.fileWrites[f].load(std::memory_order_acquire)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            if (syncFile(sqe.fd)) {
+                service.syncs.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                service.errors.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    service.inFlight.fetch_sub(tail - head, std::memory_order_release);
+    __atomic_store_n(service.sqTail, head, __ATOMIC_RELEASE);
+}
+
+// queue writes for a batch of buffers, chaining each file's writes to an fsync if
+// any buffer of the file asked for one, then submit them with one system call
+static void submitBatch(IOService& service, const unsigned int* batch, unsigned int count) {
+    unsigned int tail = *service.sqTail;
+    unsigned int entries = 0;
+
+    for (unsigned int f = 0; f < IO_MAX_FILES; f++) {
+        unsigned int writes = 0;
+        bool sync = false;
+        for (unsigned int i = 0; i < count; i++) {
+            const IOBuffer& buffer = service.buffers[batch[i]];
+            if (buffer.file == f) {
+                writes++;
+                sync = sync || buffer.sync;
+            }
+        }
+        if (!writes) {
+            continue;
+        }
+
+        // the fsync is linked to this batch's writes only, earlier ones of the file
+        // have to land before it runs
+        while (sync && service.fileWrites[f].load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        service.fileWrites[f].fetch_add(writes, std::memory_order_relaxed);
+
+        // queue order is file order, offsets are assigned here
+        for (unsigned int i = 0; i < count; i++) {
+            const IOBuffer& buffer = service.buffers[batch[i]];
+            if (buffer.file != f) {
+                continue;
+            }
+            io_uring_sqe* sqe = nextSqe(service, tail);
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->fd = service.files[f];
+            sqe->addr = (unsigned long long)(size_t)buffer.data;
+            sqe->len = (unsigned int)buffer.size;
+            sqe->off = service.fileEnd[f];
+            sqe->buf_index = (unsigned short)buffer.index;
+            sqe->flags = sync ? IOSQE_IO_LINK : 0;
+            sqe->user_data = buffer.index;
+            service.fileEnd[f] += buffer.size;
+            entries++;
+        }
+
+        if (sync) {
+            // runs after the linked writes, covers every earlier write of the file
+            io_uring_sqe* sqe = nextSqe(service, tail);
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = service.files[f];
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            sqe->user_data = syncTag | f;
+            entries++;
+        }
+    }
+
+    service.inFlight.fetch_add(entries, std::memory_order_relaxed);
+    __atomic_store_n(service.sqTail, tail, __ATOMIC_RELEASE);
+    unsigned int submitted = 0;
+    while (submitted < entries) {
+        int taken = ringEnter(service.ring, entries - submitted, 0, 0);
+        if (taken < 0 && errno == EINTR) {
+            continue;
+        }
+        if (taken <= 0) {
+            // refused (out of memory, completion ring overflowing...): the rest
+            // would never complete, write it here instead
+            writeUnsubmitted(service, tail);
+            break;
+        }
+        submitted += (unsigned int)taken;
+    }
+    service.submits.fetch_add(1, std::memory_order_relaxed);
+}
+
+// wake the completion thread with an entry that does nothing
+static void submitWake(IOService& service) {
+    unsigned int tail = *service.sqTail;
+    io_uring_sqe* sqe = nextSqe(service, tail);
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = wakeTag;
+    service.inFlight.fetch_add(1, std::memory_order_relaxed);
+    __atomic_store_n(service.sqTail, tail, __ATOMIC_RELEASE);
+    ringEnter(service.ring, 1, 0, 0);
+}
+
+static void completionLoop(IOService* service) {
+    for (;;) {
+        // reap what is there
+        unsigned int head = *service->cqHead;
+        unsigned int tail = __atomic_load_n(service->cqTail, __ATOMIC_ACQUIRE);
+        unsigned int reaped = 0;
+        for (; head != tail; head++, reaped++) {
+            const io_uring_cqe& cqe = ((const io_uring_cqe*)service->cqes)[head & *service->cqMask];
+            if (cqe.user_data < syncTag) {
+                IOBuffer& buffer = service->buffers[cqe.user_data];
+                if (cqe.res == (int)buffer.size) {
+                    service->bytesWritten.fetch_add(buffer.size, std::memory_order_relaxed);
+                    service->writes.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    // short, failed or cancelled by a failed write ahead of it in its chain
+                    service->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                service->fileWrites[buffer.file].fetch_sub(1, std::memory_order_release);
+                pushQueue(service->freeBuffers, buffer.index);
+            }
+            else if ((cqe.user_data & ~0xffffffffull) == syncTag) {
+                if (cqe.res < 0) {
+                    service->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    service->syncs.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        __atomic_store_n(service->cqHead, head, __ATOMIC_RELEASE);
+        service->inFlight.fetch_sub(reaped, std::memory_order_release);
+
+        if (service->submitDone.load(std::memory_order_acquire) &&
+            service->inFlight.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+
+        // sleep in the kernel until something completes
+        ringEnter(service->ring, 0, 1, IORING_ENTER_GETEVENTS);
+    }
+}
+
+#endif
+
+/*
+    submit thread
+*/
+
+// write a batch on this thread (no io_uring)
+static void writeBatch(IOService& service, const unsigned int* batch, unsigned int count) {
+    bool sync[IO_MAX_FILES] = {};
+    for (unsigned int i = 0; i < count; i++) {
+        IOBuffer& buffer = service.buffers[batch[i]];
+        if (writeAt(service.files[buffer.file], buffer.data, buffer.size, service.fileEnd[buffer.file])) {
+            service.bytesWritten.fetch_add(buffer.size, std::memory_order_relaxed);
+            service.writes.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            service.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        service.fileEnd[buffer.file] += buffer.size;
+        sync[buffer.file] = sync[buffer.file] || buffer.sync;
+        pushQueue(service.freeBuffers, buffer.index);
+    }
+
+    // one sync per file for the whole batch
+    for (unsigned int f = 0; f < IO_MAX_FILES; f++) {
+        if (sync[f]) {
+            if (syncFile(service.files[f])) {
+                service.syncs.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                service.errors.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    service.submits.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void submitLoop(IOService* service) {
+    unsigned int batch[maxBatch];
+    for (;;) {
+        // leave room for the completions of what is in flight plus an fsync per file
+        unsigned int room = maxBatch;
+#ifdef IO_URING
+        if (service->ring >= 0) {
+            unsigned int used = service->inFlight.load(std::memory_order_acquire) + IO_MAX_FILES + 1;
+            unsigned int free = used < service->cqEntries ? service->cqEntries - used : 0;
+            room = free < room ? free : room;
+        }
+#endif
+
+        unsigned int count = 0;
+        while (count < room && popQueue(service->pending, batch[count])) {
+            count++;
+        }
+
+        if (count) {
+#ifdef IO_URING
+            if (service->ring >= 0) {
+                submitBatch(*service, batch, count);
+                continue;
+            }
+#endif
+            writeBatch(*service, batch, count);
+            continue;
+        }
+
+        // nothing queued (or the ring is full): leave once stopped and drained,
+        // otherwise nap instead of making producers signal
+        if (!service->running.load(std::memory_order_acquire) && room) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+#ifdef IO_URING
+    if (service->ring >= 0) {
+        // the kernel cancels a thread's requests when it exits, stay until they finish
+        while (service->inFlight.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        service->submitDone.store(true, std::memory_order_release);
+        submitWake(*service);
+        return;
+    }
+#endif
+    service->submitDone.store(true, std::memory_order_release);
+}
+
+/*
+    service
+*/
+
+bool startIOService(IOService& service, unsigned int noBuffers, size_t bufferSize) {
+    // page aligned buffers from one block
+    bufferSize = (bufferSize + 4095) & ~(size_t)4095;
+    if (!allocLarge(service.block, noBuffers * bufferSize, ALLOC_PREFAULT | ALLOC_HUGE_PAGES, MEMORY_IO)) {
+        return false;
+    }
+    service.noBuffers = noBuffers;
+    service.bufferSize = bufferSize;
+    service.buffers = new IOBuffer[noBuffers];
+    initQueue(service.freeBuffers, noBuffers);
+    initQueue(service.pending, noBuffers);
+    for (unsigned int i = 0; i < noBuffers; i++) {
+        service.buffers[i].data = (unsigned char*)service.block.ptr + i * bufferSize;
+        service.buffers[i].size = 0;
+        service.buffers[i].file = 0;
+        service.buffers[i].sync = false;
+        service.buffers[i].index = i;
+        pushQueue(service.freeBuffers, i);
+    }
+
+    service.noFiles.store(0);
+    service.running.store(true);
+    service.submitDone.store(false);
+    service.inFlight.store(0);
+    service.bytesWritten.store(0);
+    service.writes.store(0);
+    service.syncs.store(0);
+    service.submits.store(0);
+    service.errors.store(0);
+
+    service.ring = -1;
+#ifdef IO_URING
+    if (openRing(service)) {
+        service.completionThread = std::thread(completionLoop, &service);
+    }
+#endif
+    service.submitThread = std::thread(submitLoop, &service);
+    return true;
+}
+
+void stopIOService(IOService& service) {
+    service.running.store(false, std::memory_order_release);
+    service.submitThread.join();
+    if (service.completionThread.joinable()) {
+        service.completionThread.join();
+    }
+#ifdef IO_URING
+    if (service.ring >= 0) {
+        closeRing(service);
+    }
+#endif
+
+    for (unsigned int f = 0; f < service.noFiles.load(); f++) {
+        closeFile(service.files[f]);
+    }
+    freeQueue(service.freeBuffers);
+    freeQueue(service.pending);
+    delete[] service.buffers;
+    service.buffers = NULL;
+    freeLarge(service.block);
+}
+
+int openIOFile(IOService& service, const char* path) {
+    unsigned int f = service.noFiles.load(std::memory_order_relaxed);
+    if (f >= IO_MAX_FILES) {
+        return -1;
+    }
+    int fd = openFile(path);
+    if (fd < 0) {
+        return -1;
+    }
+    service.files[f] = fd;
+    service.fileEnd[f] = 0;
+    service.fileWrites[f].store(0, std::memory_order_relaxed);
+    service.noFiles.store(f + 1, std::memory_order_release);
+    return (int)f;
+}
+
+IOBuffer* acquireIOBuffer(IOService& service) {
+    unsigned int i;
+    if (!popQueue(service.freeBuffers, i)) {
+        return NULL;
+    }
+    IOBuffer* buffer = &service.buffers[i];
+    buffer->size = 0;
+    buffer->sync = false;
+    return buffer;
+}
+
+void submitIOBuffer(IOService& service, IOBuffer* buffer) {
+    // cannot fail, the queue holds every buffer
+    pushQueue(service.pending, buffer->index);
+}
+
+bool ioUringActive(const IOService& service) {
+    return service.ring >= 0;
+}
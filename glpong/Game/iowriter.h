@@ -0,0 +1,111 @@
+#ifndef IOWRITER_H
+#define IOWRITER_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+#include "largealloc.h"
+
+/*
+    asynchronous writer for replays, telemetry, results and logs
+    producers take a buffer from a fixed pool, fill it and queue it to be appended to a
+    file; neither call blocks or makes a system call
+    a submit thread batches queued buffers into io_uring writes from registered
+    buffers, chaining a file's writes to one fsync when any of them asks for it
+    (group commit), and a completion thread recycles buffers as the kernel finishes
+    a linked fsync only waits for the writes of its own chain, so a batch that syncs a
+    file with earlier writes still in flight waits for those first
+    on other platforms, or when the kernel refuses a batch, the submit thread writes
+    them itself
+*/
+
+const unsigned int IO_MAX_FILES = 16;
+
+// buffer handed between a producer and the service
+struct IOBuffer {
+    unsigned char* data;
+    size_t size;            // bytes filled
+    unsigned int file;      // from openIOFile
+    bool sync;              // make the file durable once this buffer is written
+    unsigned int index;
+};
+
+// bounded lock-free queue of buffer indices (any number of producers and consumers)
+struct IndexQueue {
+    struct Cell {
+        std::atomic<size_t> seq;
+        unsigned int value;
+    };
+    Cell* cells;
+    size_t mask;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+};
+
+struct IOService {
+    // buffer pool, carved from one block and registered with the kernel
+    IOBuffer* buffers;
+    unsigned int noBuffers;
+    size_t bufferSize;
+    LargeBlock block;
+    IndexQueue freeBuffers;
+    IndexQueue pending;
+
+    // files, appended to in queue order
+    int files[IO_MAX_FILES];
+    unsigned long long fileEnd[IO_MAX_FILES];   // submit thread only
+    std::atomic<unsigned int> fileWrites[IO_MAX_FILES];  // submitted to the ring, not completed
+    std::atomic<unsigned int> noFiles;
+
+    std::thread submitThread;
+    std::thread completionThread;
+    std::atomic<bool> running;
+    std::atomic<bool> submitDone;
+    std::atomic<unsigned int> inFlight;
+
+    // counters
+    std::atomic<unsigned long long> bytesWritten;
+    std::atomic<unsigned long long> writes;
+    std::atomic<unsigned long long> syncs;
+    std::atomic<unsigned long long> submits;    // system calls that submitted a batch
+    std::atomic<unsigned long long> errors;
+
+    // io_uring rings (linux)
+    int ring;
+    unsigned int sqEntries;
+    unsigned int cqEntries;
+    unsigned int* sqHead;
+    unsigned int* sqTail;
+    unsigned int* sqMask;
+    unsigned int* sqArray;
+    void* sqes;
+    unsigned int* cqHead;
+    unsigned int* cqTail;
+    unsigned int* cqMask;
+    void* cqes;
+    void* ringMap;
+    size_t ringMapSize;
+    size_t sqeMapSize;
+};
+
+// allocate _noBuffers_ buffers of _bufferSize_ bytes and start the service threads
+bool startIOService(IOService& service, unsigned int noBuffers, size_t bufferSize);
+
+// write everything queued, wait for it and stop the threads
+void stopIOService(IOService& service);
+
+// create or truncate a file to append to, -1 on failure
+// (call from the thread that started the service)
+int openIOFile(IOService& service, const char* path);
+
+// empty buffer from the pool, NULL if every buffer is queued or being written
+IOBuffer* acquireIOBuffer(IOService& service);
+
+// queue a filled buffer to be appended to its file
+void submitIOBuffer(IOService& service, IOBuffer* buffer);
+
+// true if writes go through io_uring
+bool ioUringActive(const IOService& service);
+
+#endif
@@ -0,0 +1,169 @@
+#include "largealloc.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// round _size_ up to a multiple of _alignment_ (power of 2)
+static size_t roundUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+#ifdef _WIN32
+
+static bool mapLarge(LargeBlock& block, size_t size, unsigned int flags) {
+    block.ptr = nullptr;
+    block.size = 0;
+    block.pageMode = PAGES_NORMAL;
+
+    if (flags & ALLOC_HUGE_PAGES) {
+        // large pages require SeLockMemoryPrivilege, so fall back if it is not held
+        size_t largePage = GetLargePageMinimum();
+        if (largePage) {
+            size_t hugeSize = roundUp(size, largePage);
+            block.ptr = VirtualAlloc(NULL, hugeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (block.ptr) {
+                // large pages are always resident
+                block.size = hugeSize;
+                block.pageMode = PAGES_HUGE;
+                return true;
+            }
+        }
+    }
+
+    block.size = roundUp(size, 4096);
+    block.ptr = VirtualAlloc(NULL, block.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!block.ptr) {
+        block.size = 0;
+        return false;
+    }
+
+    if (flags & ALLOC_PREFAULT) {
+        memset(block.ptr, 0, block.size);
+    }
+
+    return true;
+}
+
+static void unmapLarge(LargeBlock& block) {
+    if (block.ptr) {
+        VirtualFree(block.ptr, 0, MEM_RELEASE);
+    }
+    block.ptr = nullptr;
+    block.size = 0;
+}
+
+#else
+
+static bool mapLarge(LargeBlock& block, size_t size, unsigned int flags) {
+    block.ptr = nullptr;
+    block.size = 0;
+    block.pageMode = PAGES_NORMAL;
+
+    int mapFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+    int populateFlag = 0;
+#ifdef MAP_POPULATE
+    if (flags & ALLOC_PREFAULT) {
+        populateFlag = MAP_POPULATE;
+    }
+#endif
+
+#ifdef MAP_HUGETLB
+    if (flags & ALLOC_HUGE_PAGES) {
+        // explicit huge pages only succeed if the pool (vm.nr_hugepages) has room
+        size_t hugeSize = roundUp(size, hugePageSize);
+        void* ptr = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE, mapFlags | populateFlag | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            block.ptr = ptr;
+            block.size = hugeSize;
+            block.pageMode = PAGES_HUGE;
+            return true;
+        }
+    }
+#endif
+
+    if (flags & ALLOC_HUGE_PAGES) {
+        // over-allocate so the block can start on a 2MB boundary for transparent huge pages
+        size_t hugeSize = roundUp(size, hugePageSize);
+        size_t mapSize = hugeSize + hugePageSize;
+        void* ptr = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, mapFlags, -1, 0);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+
+        // trim the unaligned head and tail
+        char* start = (char*)ptr;
+        char* aligned = (char*)roundUp((size_t)start, hugePageSize);
+        if (aligned > start) {
+            munmap(start, aligned - start);
+        }
+        size_t tail = (start + mapSize) - (aligned + hugeSize);
+        if (tail) {
+            munmap(aligned + hugeSize, tail);
+        }
+
+        block.ptr = aligned;
+        block.size = hugeSize;
+        block.pageMode = PAGES_NORMAL;
+#ifdef MADV_HUGEPAGE
+        if (madvise(aligned, hugeSize, MADV_HUGEPAGE) == 0) {
+            block.pageMode = PAGES_TRANSPARENT;
+        }
+#endif
+
+        if (flags & ALLOC_PREFAULT) {
+            // populate after advising so the faults are served with huge pages
+            memset(aligned, 0, hugeSize);
+        }
+
+        return true;
+    }
+
+    block.size = roundUp(size, 4096);
+    void* ptr = mmap(NULL, block.size, PROT_READ | PROT_WRITE, mapFlags | populateFlag, -1, 0);
+    if (ptr == MAP_FAILED) {
+        block.size = 0;
+        return false;
+    }
+    block.ptr = ptr;
+
+    return true;
+}
+
+static void unmapLarge(LargeBlock& block) {
+    if (block.ptr) {
+        munmap(block.ptr, block.size);
+    }
+    block.ptr = nullptr;
+    block.size = 0;
+}
+
+#endif
+
+bool allocLarge(LargeBlock& block, size_t size, unsigned int flags, MemoryCategory category) {
+    block.category = category;
+    if (!mapLarge(block, size, flags)) {
+        return false;
+    }
+    chargeMemory(category, (long long)block.size);
+    return true;
+}
+
+void freeLarge(LargeBlock& block) {
+    if (block.ptr) {
+        chargeMemory(block.category, -(long long)block.size);
+    }
+    unmapLarge(block);
+}
+
+const char* pageModeName(PageMode mode) {
+    switch (mode) {
+    case PAGES_HUGE: return "huge";
+    case PAGES_TRANSPARENT: return "transparent huge";
+    default: return "normal";
+    }
+}
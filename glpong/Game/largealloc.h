@@ -0,0 +1,44 @@
+#ifndef LARGEALLOC_H
+#define LARGEALLOC_H
+
+#include <cstddef>
+
+#include "memstats.h"
+
+/*
+    large block allocation
+    used for contiguous simulation state (match batches, replay and telemetry buffers)
+*/
+
+// size of a huge page
+const size_t hugePageSize = 2 * 1024 * 1024;
+
+// request flags
+const unsigned int ALLOC_HUGE_PAGES = 1; // back the block with 2MB pages
+const unsigned int ALLOC_PREFAULT = 2;   // fault in every page at allocation time
+
+// how the block ended up being backed
+enum PageMode {
+    PAGES_NORMAL,       // regular 4KB pages
+    PAGES_TRANSPARENT,  // regular mapping advised for transparent huge pages
+    PAGES_HUGE          // explicit huge page mapping
+};
+
+// structure for a large block of memory
+struct LargeBlock {
+    void* ptr;
+    size_t size;        // mapped size (rounded up to the page size)
+    PageMode pageMode;
+    MemoryCategory category;    // charged with the mapped size
+};
+
+// allocate a zeroed block of at least _size_ bytes
+bool allocLarge(LargeBlock& block, size_t size, unsigned int flags, MemoryCategory category = MEMORY_OTHER);
+
+// release a block
+void freeLarge(LargeBlock& block);
+
+// name of page mode
+const char* pageModeName(PageMode mode);
+
+#endif
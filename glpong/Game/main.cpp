@@ -1,48 +1,183 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <string>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <ctime>
+
+#include "sim.h"
+#include "bench.h"
+#include "dataset.h"
+#include "drawqueue.h"
+#include "evolve.h"
+#include "glresources.h"
+#include "hitch.h"
+#include "instancefill.h"
+#include "memstats.h"
+#include "profiler.h"
+#include "rawinput.h"
+#include "slotmap.h"
+#include "statehash.h"
+#include "uploader.h"
 
 // settings
 unsigned int scrWidth = 800;
 unsigned int scrHeight = 600;
 const char* title = "Pong";
-GLuint shaderProgram;
-
-// graphics paramters
-const float paddleSpeed = 175.0f;
-const float paddleHeight = 100.0f;
-const float halfPaddleHeight = paddleHeight / 2.0f;
-const float paddleWidth = 10.0f;
-const float halfPaddleWidth = paddleWidth / 2.0f;
-const float ballDiameter = 16.0f;
-const float ballRadius = ballDiameter / 2.0f;
-const float offset = ballRadius;
-const float paddleBoundary = halfPaddleHeight + offset;
 
-/*
-    2d vector structure
-*/
-struct vec2 {
-    float x;
-    float y;
+// buffers and programs, shared by every view (vertex arrays belong to each view)
+GLResources sharedObjects;
+ProgramHandle shaderProgram;
+
+// simulation state (a batch of one match)
+SimParams simParams;
+MatchBatch match;
+StateHash matchHash;    // rolling hash of the match, printed with the score to compare runs
+
+// training data capture (--record <directory>)
+const char* recordDirectory = NULL;
+std::vector<TrainingSample> recording;
+unsigned int recordSession;
+
+// bytes per subsystem and GL object printed at exit (--memory)
+bool memoryReport = false;
+
+// raw evdev input (--evdev, --evdev-record <file>, --evdev-replay <file>)
+bool rawInputWanted = false;
+const char* rawRecordPath = NULL;
+const char* rawReplayPath = NULL;
+RawInput rawInput;
+bool rawInputActive = false;
+unsigned int rawKeys = 0;   // RawKey bits held after the last change taken
+double simClock;            // monotonic time the match has been stepped to
+
+// background uploads (--upload-test <MB> loads that much every 2 seconds,
+// --upload-inline makes the same calls on the render thread to compare)
+Uploader uploader;
+bool uploaderActive = false;
+unsigned int uploadTestMB = 0;
+bool uploadInline = false;
+
+// spectator tiles (--spectate <matches> [threads]): a batch of bot matches drawn as a
+// grid under the game, their instances written by workers straight into a mapped buffer
+unsigned int spectateMatches = 0;
+unsigned int spectateThreads = 0;   // 0 = one per core
+const double spectateTick = 1.0 / 60.0;    // fixed, so the matches play the same at any frame rate
+
+struct Spectators {
+    MatchBatch batch;
+    TileLayout layout;
+    InstanceFiller filler;
+    StreamBuffer stream;            // paddles, then balls, in each region
+    VertexArrayHandle paddleArrays[STREAM_REGIONS];  // first view's context, one per region
+    VertexArrayHandle ballArrays[STREAM_REGIONS];
+    bool ready;                     // the current region holds this frame's instances
+    double pending;                 // seconds of play not stepped yet
+    double fillTime;                // seconds spent mapping, filling and flushing
+    unsigned int frames;
+};
+Spectators spectators;
+
+// heavy load test: a buffer of uploadTestMB and a 2048x2048 RGBA texture at a time
+struct LoadTest {
+    std::vector<unsigned char> data;    // source of every load
+    Upload buffer;
+    Upload texture;
+    bool inFlight;
+    double nextLoad;
+    unsigned int loads;
+    std::vector<float> frameTimes;
 };
+LoadTest loadTest;
+const GLsizei loadTextureSize = 2048;
+
+// slow frame capture (--hitch [directory])
+bool hitchCapture = false;
+const char* hitchDirectory = ".";
+HitchDetector hitchDetector;
+unsigned int tracedInputs = ~0u;    // inputs last written to the profiler
+
+// trained policy driving the right paddle (--policy <file>)
+bool policyLoaded = false;
+float policy[POLICY_PARAMS];
 
 // public offset arrays
 vec2 paddleOffsets[2];
+float paddleAngles[2];
 vec2 ballOffset;
 
-// public velocities
-float paddleVelocities[2];
-vec2 initBallVelocity = { 150.0f, 150.0f };
-vec2 ballVelocity = { 150.0f, 150.0f };
+// sparks thrown off by a paddle hit; they come and go every few frames, so they live
+// in a slot map reserved up front (no allocation per spawn) and are drawn as small
+// balls after the ball, straight from its packed values
+struct Spark {
+    vec2 position;
+    vec2 velocity;
+    float life;                 // seconds left
+    unsigned char palette;
+};
+const unsigned int MAX_SPARKS = 256;
+const unsigned int SPARKS_PER_HIT = 12;
+const float sparkLife = 0.4f;
+SlotMap<Spark> sparks;
+unsigned int sparkSeed = 1;
+
+// ball instances: the ball, then the sparks
+std::vector<vec2> ballOffsets;
+std::vector<vec2> ballSizes;
+std::vector<unsigned char> ballPalettes;
+
+/*
+    palette (matches the Palette block in main.vs)
+*/
+
+// palette entry, laid out as two std140 vec4s
+struct PaletteEntry {
+    float color[4];     // rgba
+    float material[4];  // x = flash (mix toward white), y = glow (brightness boost), z = roundness (0 = box, 1 = circle)
+};
+
+const unsigned int PALETTE_SIZE = 16;
+const unsigned char PALETTE_LEFT = 0;
+const unsigned char PALETTE_RIGHT = 1;
+const unsigned char PALETTE_BALL = 2;
+const unsigned char PALETTE_LEFT_FLASH = 3;
+const unsigned char PALETTE_RIGHT_FLASH = 4;
+const unsigned char PALETTE_LEFT_SPARK = 5;
+const unsigned char PALETTE_RIGHT_SPARK = 6;
+
+PaletteEntry palette[PALETTE_SIZE] = {
+    { { 0.3f, 0.6f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 1.0f, 0.4f, 0.3f, 1.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } },
+    { { 0.3f, 0.6f, 1.0f, 1.0f }, { 0.7f, 0.3f, 0.0f, 0.0f } },
+    { { 1.0f, 0.4f, 0.3f, 1.0f }, { 0.7f, 0.3f, 0.0f, 0.0f } },
+    { { 0.3f, 0.6f, 1.0f, 1.0f }, { 0.5f, 0.6f, 1.0f, 0.0f } },
+    { { 1.0f, 0.4f, 0.3f, 1.0f }, { 0.5f, 0.6f, 1.0f, 0.0f } }
+};
+BufferHandle paletteUBO;
+
+// public palette index arrays (one byte per instance)
+unsigned char paddlePaletteIdx[2] = { PALETTE_LEFT, PALETTE_RIGHT };
+unsigned char ballPaletteIdx = PALETTE_BALL;
+
+// anti-aliasing
+bool msaa = false;          // 4x MSAA with the tessellated ball instead of analytic coverage
+float aaPad = 1.0f;         // pixels added around each quad for edge coverage
+
+// frame timing
+bool frameStats = false;
+
+// seconds of hit flash left on each paddle
+float flashDuration = 0.15f;
+float paddleFlash[2] = { 0.0f, 0.0f };
 
 // game values
-unsigned int leftScore = 0;
-unsigned int rightScore = 0;
 bool isPaused = false;
 bool pauseKeyDown = false;
 float gameSpeed = 1.0f;
@@ -69,8 +204,8 @@ void initGLFW(unsigned int versionMajor, unsigned int versionMinor) {
 // create window
 void createWindow(GLFWwindow*& window, 
     const char* title, unsigned int width, unsigned int height, 
-    GLFWframebuffersizefun framebufferSizeCallback) {
-    window = glfwCreateWindow(width, height, title, NULL, NULL);
+    GLFWframebuffersizefun framebufferSizeCallback, GLFWwindow* share = NULL) {
+    window = glfwCreateWindow(width, height, title, NULL, share);
     if (!window) {
         return;
     }
@@ -189,9 +324,25 @@ void setOrthographicProjection(int shaderProgram,
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, &mat[0][0]);
 }
 
-// delete shader
-void deleteShader(int shaderProgram) {
-    glDeleteProgram(shaderProgram);
+// bind named uniform block of the program to a binding point
+void bindUniformBlock(int shaderProgram, const char* name, GLuint binding) {
+    GLuint blockIdx = glGetUniformBlockIndex(shaderProgram, name);
+    if (blockIdx != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shaderProgram, blockIdx, binding);
+    }
+}
+
+// set anti-aliasing uniforms
+void setAntiAliasing(int shaderProgram, bool analytic, float pad) {
+    bindShader(shaderProgram);
+    glUniform1i(glGetUniformLocation(shaderProgram, "analyticAA"), analytic);
+    glUniform1f(glGetUniformLocation(shaderProgram, "aaPad"), pad);
+}
+
+// set the viewport size the pixel pad is converted with
+void setViewportSize(int shaderProgram, unsigned int width, unsigned int height) {
+    bindShader(shaderProgram);
+    glUniform2f(glGetUniformLocation(shaderProgram, "viewportSize"), (float)std::max(width, 1u), (float)std::max(height, 1u));
 }
 
 /*
@@ -199,50 +350,65 @@ void deleteShader(int shaderProgram) {
 */
 
 // structure for VAO storing Array Object and its Buffer Objects
+// (handles, so replacing or dropping one hands the old object back for deferred deletion)
 struct VAO {
-    GLuint val;
-    GLuint posVBO;
-    GLuint offsetVBO;
-    GLuint sizeVBO;
-    GLuint EBO;
+    VertexArrayHandle val;
+    BufferHandle posVBO;
+    BufferHandle sizeVBO;
+    BufferHandle EBO;
+
+    // per instance, grown and shrunk with the instance count
+    InstanceBuffer offsets;
+    InstanceBuffer sizes;       // ball and sparks (paddles share sizeVBO)
+    InstanceBuffer angles;
+    InstanceBuffer palettes;
 };
 
-// generate VAO
-void genVAO(VAO* vao) {
-    glGenVertexArrays(1, &vao->val);
+// generate VAO in the context that owns _resources_
+void genVAO(VAO* vao, GLResources& resources) {
+    // releases the objects of a previous VAO
+    *vao = VAO();
+    initInstanceBuffer(vao->offsets, sizeof(vec2));
+    initInstanceBuffer(vao->sizes, sizeof(vec2));
+    initInstanceBuffer(vao->angles, sizeof(float));
+    initInstanceBuffer(vao->palettes, sizeof(unsigned char));
+    vao->val = createVertexArray(resources);
     glBindVertexArray(vao->val);
 }
 
-// generate buffer of certain type and set data
+// generate buffer of certain type and set data (from the shared pool)
 template<typename T>
-void genBufferObject(GLuint& bo, GLenum type, GLuint noElements, T* data, GLenum usage) {
-    glGenBuffers(1, &bo);
-    glBindBuffer(type, bo);
-    glBufferData(type, noElements * sizeof(T), data, usage);
+void genBufferObject(BufferHandle& bo, GLenum type, GLuint noElements, T* data, GLenum usage) {
+    bo = createBuffer(sharedObjects, type, noElements * sizeof(T), data, usage);
 }
 
-// update data in a buffer object
+// set attribute pointers
 template<typename T>
-void updateData(GLuint& bo, GLintptr offset, GLuint noElements, T* data) {
+void setAttPointer(GLuint bo, GLuint idx, GLint size, GLenum type, GLuint stride, GLuint offset, GLuint divisor = 0) {
     glBindBuffer(GL_ARRAY_BUFFER, bo);
-    glBufferSubData(GL_ARRAY_BUFFER, offset, noElements * sizeof(T), data);
+    glVertexAttribPointer(idx, size, type, GL_FALSE, stride * sizeof(T), (void*)(offset * sizeof(T)));
+    glEnableVertexAttribArray(idx);
+    if (divisor > 0) {
+        // reset _idx_ attribute every _divisor_ iteration through instances
+        glVertexAttribDivisor(idx, divisor);
+    }
 }
 
-// set attribute pointers
+// set integer attribute pointers (read as int/uint in the shader)
 template<typename T>
-void setAttPointer(GLuint& bo, GLuint idx, GLint size, GLenum type, GLuint stride, GLuint offset, GLuint divisor = 0) {
+void setAttIPointer(GLuint bo, GLuint idx, GLint size, GLenum type, GLuint stride, GLuint offset, GLuint divisor = 0) {
     glBindBuffer(GL_ARRAY_BUFFER, bo);
-    glVertexAttribPointer(idx, size, type, GL_FALSE, stride * sizeof(T), (void*)(offset * sizeof(T)));
+    glVertexAttribIPointer(idx, size, type, stride * sizeof(T), (void*)(offset * sizeof(T)));
     glEnableVertexAttribArray(idx);
     if (divisor > 0) {
-        // reset _idx_ attribute every _divisor_ iteration through instances
         glVertexAttribDivisor(idx, divisor);
     }
 }
 
 // draw VAO
-void draw(VAO vao, GLenum mode, GLuint count, GLenum type, GLint indices, GLuint instanceCount = 1) {
-    glBindVertexArray(vao.val);
+void draw(GLuint vao, GLenum mode, GLuint count, GLenum type, GLint indices, GLuint instanceCount = 1) {
+    PROFILE_GL("glDrawElementsInstanced");
+    glBindVertexArray(vao);
     glDrawElementsInstanced(mode, count, type, (void*)indices, instanceCount);
 }
 
@@ -256,13 +422,108 @@ void unbindVAO() {
     glBindVertexArray(0);
 }
 
-// deallocate VAO/VBO memory
-void cleanup(VAO vao) {
-    glDeleteBuffers(1, &vao.posVBO);
-    glDeleteBuffers(1, &vao.offsetVBO);
-    glDeleteBuffers(1, &vao.sizeVBO);
-    glDeleteBuffers(1, &vao.EBO);
-    glDeleteVertexArrays(1, &vao.val);
+
+/*
+    view methods
+*/
+
+// window of one player
+// buffers and shaders are shared with the first view, vertex arrays and queries are per context
+struct View {
+    GLFWwindow* window;
+    unsigned int width;
+    unsigned int height;
+    GLResources contextObjects;     // vertex arrays of this context
+    unsigned int linkedGeneration;  // instance buffers the vertex arrays point at
+    VAO paddleVAO;
+    VAO ballVAO;
+
+    // frame timing
+    GLuint frameQuery;
+    unsigned int statFrames;
+    double statCPUTime;
+    double statGPUTime;
+};
+
+const unsigned int MAX_VIEWS = 2;
+View views[MAX_VIEWS];
+unsigned int noViews = 1;
+
+// point paddle attributes of _vao_ at the buffers of _src_ (itself for the first view)
+void linkPaddleVAO(VAO& vao, const VAO& src) {
+    glBindVertexArray(vao.val);
+    setAttPointer<float>(src.posVBO, 0, 2, GL_FLOAT, 2, 0);
+    setAttPointer<float>(src.offsets.buffer, 1, 2, GL_FLOAT, 2, 0, 1);
+    setAttPointer<float>(src.sizeVBO, 2, 2, GL_FLOAT, 2, 0, 2);
+    setAttPointer<float>(src.angles.buffer, 3, 1, GL_FLOAT, 1, 0, 1);
+    setAttIPointer<unsigned char>(src.palettes.buffer, 4, 1, GL_UNSIGNED_BYTE, 1, 0, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, src.EBO);
+
+    unbindBuffer(GL_ARRAY_BUFFER);
+    unbindVAO();
+}
+
+// point ball attributes of _vao_ at the buffers of _src_
+// (angle attribute is left disabled, which reads as 0)
+void linkBallVAO(VAO& vao, const VAO& src) {
+    glBindVertexArray(vao.val);
+    setAttPointer<float>(src.posVBO, 0, 2, GL_FLOAT, 2, 0);
+    setAttPointer<float>(src.offsets.buffer, 1, 2, GL_FLOAT, 2, 0, 1);
+    setAttPointer<float>(src.sizes.buffer, 2, 2, GL_FLOAT, 2, 0, 1);
+    setAttIPointer<unsigned char>(src.palettes.buffer, 4, 1, GL_UNSIGNED_BYTE, 1, 0, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, src.EBO);
+
+    unbindBuffer(GL_ARRAY_BUFFER);
+    unbindVAO();
+}
+
+// reallocations of the instance buffers so far, a view linked at another
+// generation points at released buffers
+unsigned int instanceGeneration() {
+    const VAO& paddles = views[0].paddleVAO;
+    const VAO& ball = views[0].ballVAO;
+    return paddles.offsets.generation + paddles.angles.generation + paddles.palettes.generation +
+        ball.offsets.generation + ball.sizes.generation + ball.palettes.generation;
+}
+
+// point a spectator vertex array at the instances _offset_ bytes into _stream_, with
+// the shape of _mesh_ (size attribute is left disabled and set for each draw)
+void linkSpectatorVAO(GLuint vao, const VAO& mesh, GLuint stream, GLuint offset) {
+    GLuint stride = sizeof(SpectatorInstance);
+    glBindVertexArray(vao);
+    setAttPointer<float>(mesh.posVBO, 0, 2, GL_FLOAT, 2, 0);
+    setAttPointer<unsigned char>(stream, 1, 2, GL_FLOAT, stride, offset + offsetof(SpectatorInstance, offset), 1);
+    setAttPointer<unsigned char>(stream, 3, 1, GL_HALF_FLOAT, stride, offset + offsetof(SpectatorInstance, angle), 1);
+    setAttIPointer<unsigned char>(stream, 4, 1, GL_UNSIGNED_BYTE, stride, offset + offsetof(SpectatorInstance, palette), 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+
+    unbindBuffer(GL_ARRAY_BUFFER);
+    unbindVAO();
+}
+
+// new vertex array in the current context for the buffers of another view (the
+// buffer handles stay with that view)
+void shareVAO(VAO& vao, GLResources& resources) {
+    vao = VAO();
+    vao.val = createVertexArray(resources);
+}
+
+// set the state of the current context that is not shared between views
+void initContextState() {
+    // edges are blended by coverage (analytic AA) or resolved from samples (MSAA)
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (msaa) {
+        glEnable(GL_MULTISAMPLE);
+    }
+
+    // uniform buffer binding points belong to the context
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, paletteUBO);
+}
+
+// find the view of a window
+View* getView(GLFWwindow* window) {
+    return (View*)glfwGetWindowUserPointer(window);
 }
 
 // method to generate arrays for circle model
@@ -318,68 +579,115 @@ void gen2DCircleArray(float*& vertices, unsigned int*& indices, unsigned int noT
 
 // callback for window size change
 void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
-    glViewport(0, 0, width, height);
-    scrWidth = width;
-    scrHeight = height;
+    // viewport and projection are set when the view is drawn
+    View* view = getView(window);
+    view->width = width;
+    view->height = height;
+
+    // first view sets the field size (moves right paddle), other views scale it to fit
+    if (view == &views[0]) {
+        scrWidth = width;
+        scrHeight = height;
+        simParams.width = (float)width;
+        simParams.height = (float)height;
+    }
+}
 
-    // update projection matrix
-    setOrthographicProjection(shaderProgram, 0, width, 0, height, 0.0f, 1.0f);
+// bit of a GLFW key in the raw input key set
+unsigned int rawKeyBit(int key) {
+    switch (key) {
+    case GLFW_KEY_W: return 1 << RAW_KEY_W;
+    case GLFW_KEY_S: return 1 << RAW_KEY_S;
+    case GLFW_KEY_A: return 1 << RAW_KEY_A;
+    case GLFW_KEY_D: return 1 << RAW_KEY_D;
+    case GLFW_KEY_UP: return 1 << RAW_KEY_UP;
+    case GLFW_KEY_DOWN: return 1 << RAW_KEY_DOWN;
+    case GLFW_KEY_LEFT: return 1 << RAW_KEY_LEFT;
+    case GLFW_KEY_RIGHT: return 1 << RAW_KEY_RIGHT;
+    case GLFW_KEY_P: return 1 << RAW_KEY_P;
+    case GLFW_KEY_ESCAPE: return 1 << RAW_KEY_ESCAPE;
+    default: return 0;
+    }
+}
+
+// check if a key is held in any view (or on any keyboard with raw input)
+bool keyPressed(int key) {
+    if (rawInputActive) {
+        return (rawKeys & rawKeyBit(key)) != 0;
+    }
+    for (unsigned int i = 0; i < noViews; i++) {
+        if (glfwGetKey(views[i].window, key) == GLFW_PRESS) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    // update right paddle's x positions
-    paddleOffsets[1].x = width - 35.0f;
+// check if every view is still open
+bool viewsOpen() {
+    for (unsigned int i = 0; i < noViews; i++) {
+        if (glfwWindowShouldClose(views[i].window)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // process input
-void processInput(GLFWwindow* window, double dt) {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-        glfwSetWindowShouldClose(window, true);
+void processInput(double dt) {
+    if (keyPressed(GLFW_KEY_ESCAPE)) {
+        glfwSetWindowShouldClose(views[0].window, true);
     }
 
-    paddleVelocities[0] = 0.0f;
-    paddleVelocities[1] = 0.0f;
+    match.input[0][0] = 0;
+    match.input[1][0] = 0;
 
     // left paddle
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        // boundary condition
-        if (paddleOffsets[0].y < scrHeight - paddleBoundary) {
-            paddleVelocities[0] = paddleSpeed;
-        }
-        else {
-            paddleOffsets[0].y = scrHeight - paddleBoundary;
-        }
+    if (keyPressed(GLFW_KEY_W)) {
+        match.input[0][0] = 1;
     }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        if (paddleOffsets[0].y > paddleBoundary) {
-            paddleVelocities[0] = -paddleSpeed;
-        }
-        else {
-            paddleOffsets[0].y = paddleBoundary;
-        }
+    if (keyPressed(GLFW_KEY_S)) {
+        match.input[0][0] = -1;
+    }
+    match.tiltInput[0][0] = 0;
+    if (keyPressed(GLFW_KEY_A)) {
+        match.tiltInput[0][0] = 1;
+    }
+    if (keyPressed(GLFW_KEY_D)) {
+        match.tiltInput[0][0] = -1;
     }
 
     // right paddle
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-        if (paddleOffsets[1].y < scrHeight - paddleBoundary) {
-            paddleVelocities[1] = paddleSpeed;
-        }
-        else {
-            paddleOffsets[1].y = scrHeight - paddleBoundary;
-        }
+    if (keyPressed(GLFW_KEY_UP)) {
+        match.input[1][0] = 1;
     }
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-        if (paddleOffsets[1].y > paddleBoundary) {
-            paddleVelocities[1] = -paddleSpeed;
-        }
-        else {
-            paddleOffsets[1].y = paddleBoundary;
-        }
+    if (keyPressed(GLFW_KEY_DOWN)) {
+        match.input[1][0] = -1;
+    }
+    match.tiltInput[1][0] = 0;
+    if (keyPressed(GLFW_KEY_RIGHT)) {
+        match.tiltInput[1][0] = 1;
+    }
+    if (keyPressed(GLFW_KEY_LEFT)) {
+        match.tiltInput[1][0] = -1;
+    }
+    if (policyLoaded) {
+        policyInputs(match, simParams, policy, 1, 1);
+    }
+
+    // changes of input go to the profiler with the frames around them
+    unsigned int inputs = (unsigned int)(match.input[0][0] + 1) | (unsigned int)(match.input[1][0] + 1) << 2 |
+        (unsigned int)(match.tiltInput[0][0] + 1) << 4 | (unsigned int)(match.tiltInput[1][0] + 1) << 6;
+    if (inputs != tracedInputs) {
+        traceInstant(TRACE_INPUT, "inputs", inputs);
+        tracedInputs = inputs;
     }
 
     // pause key
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE) {
+    if (!keyPressed(GLFW_KEY_P)) {
         pauseKeyDown = false;
     }
-    else if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !pauseKeyDown) {
+    else if (!pauseKeyDown) {
         // key just pressed
         isPaused = !isPaused;
         gameSpeed = isPaused ? 0.0f : 1.0f;
@@ -389,19 +697,387 @@ void processInput(GLFWwindow* window, double dt) {
 
 // clear screen
 void clearScreen() {
+    PROFILE_GL("glClear");
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
-// new frame
-void newFrame(GLFWwindow* window) {
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+// accumulate frame time of a view and report the average every _interval_ frames
+void recordFrameTime(View& view, double cpuTime, double gpuTime, unsigned int interval) {
+    view.statFrames++;
+    view.statCPUTime += cpuTime;
+    view.statGPUTime += gpuTime;
+
+    if (view.statFrames >= interval) {
+        std::cout << "view " << (&view - views) << " (" << (msaa ? "4x MSAA" : "analytic AA") << "): "
+            << view.statCPUTime / view.statFrames * 1e3 << " ms/frame, "
+            << view.statGPUTime / view.statFrames * 1e3 << " ms GPU/frame" << std::endl;
+        view.statFrames = 0;
+        view.statCPUTime = 0.0;
+        view.statGPUTime = 0.0;
+    }
+}
+
+/*
+    draw queue
+    everything a view draws goes through the queue: its key orders it and its item is
+    the index of a renderable; the ball and each spark are renderables of their own,
+    and as their instances follow each other in the ball's buffers the queue merges
+    them into one draw
+*/
+
+// mesh field of the draw keys, one per vertex array setup, in drawing order
+// (the spectator tiles lie under the game)
+enum DrawMesh {
+    MESH_SPECTATOR_PADDLES,
+    MESH_SPECTATOR_BALLS,
+    MESH_PADDLES,
+    MESH_BALL
+};
+
+// material field: the sizes of the spectator instances (constant attributes)
+enum DrawMaterial {
+    MATERIAL_PLAIN,
+    MATERIAL_SPECTATOR_PADDLE,
+    MATERIAL_SPECTATOR_BALL
+};
+
+// instances of one vertex array, drawn with every renderable of its run
+struct Renderable {
+    GLuint vao;
+    GLuint indices;
+    GLuint instances;
+};
+
+DrawQueue drawQueue;
+std::vector<Renderable> renderables;
+std::vector<DrawBatch> drawBatches;
+
+void queueRenderable(DrawMesh mesh, DrawMaterial material, GLuint vao, GLuint indices, GLuint instances) {
+    Renderable renderable = { vao, indices, instances };
+    pushDraw(drawQueue, drawKey(PASS_OPAQUE, 0, mesh, material, 0.0f), (unsigned int)renderables.size());
+    renderables.push_back(renderable);
+}
+
+// queue the spectator tiles from the region filled this frame
+void queueSpectators(unsigned int noBallIndices) {
+    const Spectators& s = spectators;
+    if (!s.ready) {
+        return;
+    }
+    queueRenderable(MESH_SPECTATOR_PADDLES, MATERIAL_SPECTATOR_PADDLE, s.paddleArrays[s.stream.region], 3 * 2, 2 * s.batch.count);
+    queueRenderable(MESH_SPECTATOR_BALLS, MATERIAL_SPECTATOR_BALL, s.ballArrays[s.stream.region], noBallIndices, s.batch.count);
+}
+
+// sort the queued renderables and issue a draw per run, setting the material when
+// it changes
+void submitDraws() {
+    PROFILE_ZONE("submit draws");
+    sortDrawQueue(drawQueue);
+    mergeDraws(drawQueue, drawBatches);
+
+    unsigned int material = ~0u;
+    for (const DrawBatch& batch : drawBatches) {
+        if (drawMaterial(batch.key) != material) {
+            material = drawMaterial(batch.key);
+            const TileLayout& layout = spectators.layout;
+            if (material == MATERIAL_SPECTATOR_PADDLE) {
+                glVertexAttrib2f(2, layout.paddleSize.x, layout.paddleSize.y);
+            }
+            else if (material == MATERIAL_SPECTATOR_BALL) {
+                glVertexAttrib2f(2, layout.ballSize.x, layout.ballSize.y);
+            }
+        }
+        const Renderable& first = renderables[drawQueue.items[batch.first]];
+        GLuint instances = 0;
+        for (unsigned int i = batch.first; i < batch.first + batch.count; i++) {
+            instances += renderables[drawQueue.items[i]].instances;
+        }
+        draw(first.vao, GL_TRIANGLES, first.indices, GL_UNSIGNED_INT, 0, instances);
+    }
+
+    clearDrawQueue(drawQueue);
+    renderables.clear();
+}
+
+// draw the field into a view and present it
+void drawView(View& view, unsigned int noBallIndices, unsigned int noBallInstances) {
+    PROFILE_ZONE("draw view");
+    double renderStart = glfwGetTime();
+    glfwMakeContextCurrent(view.window);
+    if (frameStats) {
+        glBeginQuery(GL_TIME_ELAPSED, view.frameQuery);
+    }
+
+    // attribute pointers only change when an instance buffer was reallocated
+    if (view.linkedGeneration != instanceGeneration()) {
+        linkPaddleVAO(view.paddleVAO, views[0].paddleVAO);
+        linkBallVAO(view.ballVAO, views[0].ballVAO);
+        view.linkedGeneration = instanceGeneration();
+    }
+
+    // fit the field to the window
+    glViewport(0, 0, view.width, view.height);
+    setOrthographicProjection(shaderProgram, 0, simParams.width, 0, simParams.height, 0.0f, 1.0f);
+    setViewportSize(shaderProgram, view.width, view.height);
+
+    // clear screen for new frame
+    clearScreen();
+
+    // render object (spectator tiles only in the first view, the fence of the stream
+    // buffer only covers it)
+    if (spectateMatches && &view == &views[0]) {
+        queueSpectators(noBallIndices);
+    }
+    queueRenderable(MESH_PADDLES, MATERIAL_PLAIN, view.paddleVAO.val, 3 * 2, 2);
+    // the ball, then each spark, in the order of their instances
+    for (unsigned int i = 0; i < noBallInstances; i++) {
+        queueRenderable(MESH_BALL, MATERIAL_PLAIN, view.ballVAO.val, noBallIndices, 1);
+    }
+    submitDraws();
+
+    if (frameStats) {
+        glEndQuery(GL_TIME_ELAPSED);
+        double cpuTime = glfwGetTime() - renderStart;
+
+        // waits for the GPU, so only done when measuring
+        GLuint64 gpuNs = 0;
+        glGetQueryObjectui64v(view.frameQuery, GL_QUERY_RESULT, &gpuNs);
+        recordFrameTime(view, cpuTime, gpuNs * 1e-9, 240);
+    }
+
+    // swap frames (also flushes buffer updates for the next view)
+    {
+        PROFILE_GL("glfwSwapBuffers");
+        glfwSwapBuffers(view.window);
+    }
+
+    // vertex arrays released this frame wait behind a fence of this context, and
+    // shared objects behind one from every view but the first, whose context ends
+    // the shared frame
+    endGLFrame(view.contextObjects);
+    if (&view != &views[0]) {
+        fenceGLFrame(sharedObjects);
+    }
 }
 
 // display score
 void displayScore() {
-    std::cout << leftScore << " - " << rightScore << std::endl;
+    std::cout << match.score[0][0] << " - " << match.score[1][0]
+        << " (state " << std::hex << matchHash.value << std::dec << ")" << std::endl;
+}
+
+// record, step and hash the match for _dt_ seconds, returns the events raised
+unsigned char advance(double dt) {
+    // record the state and the keys that drive this step
+    if (recordDirectory && gameSpeed > 0.0f) {
+        size_t capacity = recording.capacity();
+        recording.push_back(TrainingSample());
+        chargeMemory(MEMORY_RECORDING, (long long)(recording.capacity() - capacity) * sizeof(TrainingSample));
+        captureSample(recording.back(), match, 0, (float)dt * gameSpeed, (unsigned int)recording.size() - 1, recordSession);
+    }
+
+    stepMatches(match, simParams, dt * gameSpeed);
+    updateStateHash(matchHash, match, 0);
+    if (match.events[0] & (EVENT_SCORE_LEFT | EVENT_SCORE_RIGHT)) {
+        displayScore();
+    }
+    return match.events[0];
+}
+
+// start a load when one is due and hand finished ones back, once a frame with the
+// first view's context current
+void runLoadTest(double time, double dt) {
+    loadTest.frameTimes.push_back((float)dt);
+
+    if (!loadTest.inFlight && time >= loadTest.nextLoad) {
+        size_t bufferSize = (size_t)uploadTestMB << 20;
+        size_t textureSize = (size_t)loadTextureSize * loadTextureSize * 4;
+        if (uploaderActive) {
+            Upload& buffer = loadTest.buffer;
+            buffer.target = GL_ARRAY_BUFFER;
+            buffer.data = loadTest.data.data();
+            buffer.size = bufferSize;
+            buffer.usage = GL_STATIC_DRAW;
+
+            Upload& texture = loadTest.texture;
+            texture.target = GL_TEXTURE_2D;
+            texture.data = loadTest.data.data();
+            texture.size = textureSize;
+            texture.width = loadTextureSize;
+            texture.height = loadTextureSize;
+            texture.internalFormat = GL_RGBA8;
+            texture.format = GL_RGBA;
+            texture.type = GL_UNSIGNED_BYTE;
+
+            loadTest.inFlight = queueUpload(uploader, buffer) && queueUpload(uploader, texture);
+        }
+        else {
+            // what the render thread does today, the buffer through the shared
+            // objects like any other (released at once, deleted or pooled after its fence)
+            BufferHandle buffer = createBuffer(sharedObjects, GL_ARRAY_BUFFER, bufferSize, loadTest.data.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            buffer.reset();
+            GLuint tex;
+            glGenTextures(1, &tex);
+            glBindTexture(GL_TEXTURE_2D, tex);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, loadTextureSize, loadTextureSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, loadTest.data.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+            trackGLObject(MEMORY_GL_TEXTURES, tex, textureSize);
+            trackGLObject(MEMORY_GL_TEXTURES, tex, 0);
+            glDeleteTextures(1, &tex);
+            loadTest.loads++;
+            loadTest.nextLoad = time + 2.0;
+        }
+    }
+
+    if (uploaderActive) {
+        pollUploads(uploader);
+        unsigned int bufferState = loadTest.buffer.state.load();
+        unsigned int textureState = loadTest.texture.state.load();
+        if (loadTest.inFlight && bufferState >= UPLOAD_READY && textureState >= UPLOAD_READY) {
+            // nothing draws with them, give them straight back through the loader
+            queueRelease(uploader, loadTest.buffer.name, false);
+            queueRelease(uploader, loadTest.texture.name, true);
+            loadTest.inFlight = false;
+            loadTest.loads++;
+            loadTest.nextLoad = time + 2.0;
+        }
+    }
+}
+
+// print the frame time spread of the load test
+void reportLoadTest() {
+    std::vector<float>& times = loadTest.frameTimes;
+    if (times.empty()) {
+        return;
+    }
+    std::sort(times.begin(), times.end());
+    std::cout << "Load test (" << (uploaderActive ? "loader thread" : "render thread") << "): " << loadTest.loads
+        << " loads of " << uploadTestMB + 16 << " MB, " << times.size() << " frames, median "
+        << times[times.size() / 2] * 1e3f << " ms, largest " << times.back() * 1e3f << " ms" << std::endl;
+    if (uploaderActive) {
+        std::cout << "Loader: " << uploader.bytes.load() / uploader.loaderTime / (1 << 20) << " MB/s in GL calls" << std::endl;
+    }
+}
+
+/*
+    spectators
+*/
+
+// allocate and spread the spectator matches, start the fill workers and set up the
+// stream buffer and its vertex arrays, with the first view's context current
+bool startSpectators(const VAO& paddleMesh, const VAO& ballMesh) {
+    Spectators& s = spectators;
+
+    // stepped every tick, so on huge pages (falling back to transparent or normal ones)
+    // and faulted in now rather than in the first frames
+    if (!allocMatchBatch(s.batch, spectateMatches, ALLOC_HUGE_PAGES | ALLOC_PREFAULT)) {
+        return false;
+    }
+    for (unsigned int m = 0; m < s.batch.count; m++) {
+        // start the balls at different heights and directions so the tiles differ
+        resetMatch(s.batch, simParams, m);
+        float phase = m * 0.618034f - (float)(int)(m * 0.618034f);
+        s.batch.ballY[m] = simParams.ballRadius + phase * (simParams.height - 2.0f * simParams.ballRadius);
+        s.batch.ballVY[m] *= m & 1 ? -1.0f : 1.0f;
+    }
+
+    s.layout = tileLayout(simParams, s.batch.count);
+    s.layout.paddlePalette[0] = PALETTE_LEFT;
+    s.layout.paddlePalette[1] = PALETTE_RIGHT;
+    s.layout.flashPalette[0] = PALETTE_LEFT_FLASH;
+    s.layout.flashPalette[1] = PALETTE_RIGHT_FLASH;
+    s.layout.ballPalette = PALETTE_BALL;
+    startInstanceFiller(s.filler, spectateThreads);
+
+    // a region holds the paddles, then the balls from the next cache line
+    size_t paddleBytes = paddleRegionBytes(s.batch.count);
+    initStreamBuffer(sharedObjects, s.stream, spectatorRegionBytes(s.batch.count));
+    for (unsigned int r = 0; r < STREAM_REGIONS; r++) {
+        GLuint offset = (GLuint)streamRegionOffset(s.stream, r);
+        s.paddleArrays[r] = createVertexArray(views[0].contextObjects);
+        linkSpectatorVAO(s.paddleArrays[r], paddleMesh, s.stream.buffer, offset);
+        s.ballArrays[r] = createVertexArray(views[0].contextObjects);
+        linkSpectatorVAO(s.ballArrays[r], ballMesh, s.stream.buffer, offset + (GLuint)paddleBytes);
+    }
+    s.ready = false;
+    s.pending = 0.0;
+    s.fillTime = 0.0;
+    s.frames = 0;
+    return true;
+}
+
+// step the spectator matches with the bot on both sides, in fixed ticks
+void stepSpectators(double dt) {
+    PROFILE_ZONE("spectator matches");
+    Spectators& s = spectators;
+    s.pending += dt;
+    for (unsigned int ticks = 0; s.pending >= spectateTick && ticks < 8; ticks++) {
+        botInputs(s.batch, simParams);
+        stepMatches(s.batch, simParams, (float)spectateTick);
+        s.pending -= spectateTick;
+    }
+
+    // a frame too slow to catch up on drops the rest
+    s.pending = std::min(s.pending, spectateTick);
+}
+
+// map the next region of the stream buffer, fill it on the workers and hand it back
+void fillSpectators() {
+    PROFILE_ZONE("fill spectators");
+    Spectators& s = spectators;
+    double start = glfwGetTime();
+    s.ready = false;
+    unsigned char* region = (unsigned char*)mapStreamRegion(s.stream);
+    if (!region) {
+        return;
+    }
+
+    fillParallel(s.filler, s.batch, simParams, s.layout,
+        (SpectatorInstance*)region, (SpectatorInstance*)(region + paddleRegionBytes(s.batch.count)));
+    flushStreamRange(s.stream, 0, spectatorRegionBytes(s.batch.count));
+    s.ready = unmapStreamRegion(s.stream);
+    s.fillTime += glfwGetTime() - start;
+    s.frames++;
+}
+
+// with the first view's context current
+void stopSpectators() {
+    Spectators& s = spectators;
+    std::cout << s.batch.count << " spectator matches, " << (s.frames ? s.fillTime / s.frames * 1e3 : 0.0)
+        << " ms per frame to fill on " << s.filler.pool.noThreads << " threads, " << s.stream.waits
+        << " waits for a region" << std::endl;
+    for (unsigned int r = 0; r < STREAM_REGIONS; r++) {
+        s.paddleArrays[r].reset();
+        s.ballArrays[r].reset();
+    }
+    destroyStreamBuffer(s.stream);
+    stopInstanceFiller(s.filler);
+    freeMatchBatch(s.batch);
+}
+
+// print bytes per subsystem and per drawn object, while the GL objects still exist
+void reportMemory() {
+    std::cout.flush();
+    printMemoryStats(stdout);
+
+    // instance data scales with paddles and balls, the rest is fixed per view
+    const VAO& paddles = views[0].paddleVAO;
+    const VAO& ball = views[0].ballVAO;
+    size_t paddleBytes = trackedGLBytes(MEMORY_GL_BUFFERS, paddles.offsets.buffer) +
+        trackedGLBytes(MEMORY_GL_BUFFERS, paddles.angles.buffer) + trackedGLBytes(MEMORY_GL_BUFFERS, paddles.palettes.buffer);
+    size_t ballBytes = trackedGLBytes(MEMORY_GL_BUFFERS, ball.offsets.buffer) +
+        trackedGLBytes(MEMORY_GL_BUFFERS, ball.sizes.buffer) + trackedGLBytes(MEMORY_GL_BUFFERS, ball.palettes.buffer);
+    unsigned long long reallocations = paddles.offsets.reallocations + paddles.angles.reallocations +
+        paddles.palettes.reallocations + ball.offsets.reallocations + ball.sizes.reallocations + ball.palettes.reallocations;
+    std::cout << "GL objects: " << sharedObjects.created << " created, " << sharedObjects.reused << " buffers reused from the pool, "
+        << sharedObjects.trimmed << " trimmed from it after idling, " << sharedObjects.pooledBytes << " bytes pooled, "
+        << sharedObjects.deleted << " deleted, " << sharedObjects.waits << " fence waits, "
+        << reallocations << " instance buffer reallocations" << std::endl;
+    std::cout << "Per match: " << match.block.size / match.count << " bytes of simulation state (" << match.count
+        << " in the batch), per paddle: " << paddleBytes / 2 << " GL bytes, ball and sparks: "
+        << ballBytes << " GL bytes" << std::endl;
 }
 
 /*
@@ -413,24 +1089,202 @@ void cleanup() {
     glfwTerminate();
 }
 
-int main() {
+// copy simulation state into instance offset arrays
+void gatherOffsets() {
+    paddleOffsets[0] = { paddleX(simParams, 0), match.paddleY[0][0] };
+    paddleOffsets[1] = { paddleX(simParams, 1), match.paddleY[1][0] };
+    paddleAngles[0] = match.paddleAngle[0][0];
+    paddleAngles[1] = match.paddleAngle[1][0];
+    ballOffset = { match.ballX[0], match.ballY[0] };
+}
+
+// throw sparks off a paddle hit, move them and let them burn out
+void updateSparks(float dt, unsigned char events) {
+    if (events & EVENT_PADDLE) {
+        // away from the paddle that hit, as the ball goes
+        int hitter = match.ballVX[0] > 0.0f ? 0 : 1;
+        float direction = hitter == 0 ? 1.0f : -1.0f;
+        for (unsigned int i = 0; i < SPARKS_PER_HIT && sparks.values.size() < MAX_SPARKS; i++) {
+            sparkSeed = sparkSeed * 1664525u + 1013904223u;
+            float angle = ((sparkSeed >> 8) * (1.0f / 16777216.0f) - 0.5f) * 2.4f;
+            sparkSeed = sparkSeed * 1664525u + 1013904223u;
+            float speed = 150.0f + (sparkSeed >> 8) * (250.0f / 16777216.0f);
+            Spark spark;
+            spark.position = ballOffset;
+            spark.velocity = { direction * speed * std::cos(angle), speed * std::sin(angle) };
+            spark.life = sparkLife;
+            spark.palette = hitter == 0 ? PALETTE_LEFT_SPARK : PALETTE_RIGHT_SPARK;
+            insertSlot(sparks, spark);
+        }
+    }
+
+    // from the back, so the spark moved into an erased one's place was already updated
+    for (unsigned int d = (unsigned int)sparks.values.size(); d-- > 0;) {
+        Spark& spark = sparks.values[d];
+        spark.life -= dt;
+        if (spark.life <= 0.0f) {
+            eraseSlot(sparks, slotHandleAt(sparks, d));
+            continue;
+        }
+        spark.position.x += spark.velocity.x * dt;
+        spark.position.y += spark.velocity.y * dt;
+    }
+}
+
+// ball instances for this frame: the ball, then every spark shrinking as it burns out
+unsigned int gatherBallInstances() {
+    float diameter = 2.0f * simParams.ballRadius;
+    ballOffsets.resize(1 + sparks.values.size());
+    ballSizes.resize(ballOffsets.size());
+    ballPalettes.resize(ballOffsets.size());
+    ballOffsets[0] = ballOffset;
+    ballSizes[0] = { diameter, diameter };
+    ballPalettes[0] = ballPaletteIdx;
+    for (size_t d = 0; d < sparks.values.size(); d++) {
+        const Spark& spark = sparks.values[d];
+        float size = 0.4f * diameter * spark.life / sparkLife;
+        ballOffsets[1 + d] = spark.position;
+        ballSizes[1 + d] = { size, size };
+        ballPalettes[1 + d] = spark.palette;
+    }
+    return (unsigned int)ballOffsets.size();
+}
+
+// flash a paddle after it hits the ball and pick palette indices
+void updatePalette(float dt, unsigned char events) {
+    if (events & EVENT_PADDLE) {
+        // ball is now moving away from the paddle that hit it
+        paddleFlash[match.ballVX[0] > 0.0f ? 0 : 1] = flashDuration;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        paddleFlash[i] = paddleFlash[i] > dt ? paddleFlash[i] - dt : 0.0f;
+    }
+    paddlePaletteIdx[0] = paddleFlash[0] > 0.0f ? PALETTE_LEFT_FLASH : PALETTE_LEFT;
+    paddlePaletteIdx[1] = paddleFlash[1] > 0.0f ? PALETTE_RIGHT_FLASH : PALETTE_RIGHT;
+}
+
+// train a policy against the bot with evolution strategies and save it
+int trainPolicy(const char* path, unsigned int generations) {
+    Trainer trainer;
+    if (!startTrainer(trainer, defaultSimParams((float)scrWidth, (float)scrHeight), defaultEvolutionParams())) {
+        std::cout << "Could not start trainer" << std::endl;
+        return -1;
+    }
+
+    for (unsigned int g = 0; g < generations; g++) {
+        trainGeneration(trainer);
+        std::cout << "Generation " << trainer.generation << ": mean fitness " << trainer.meanFitness
+            << ", best " << trainer.bestFitness << std::endl;
+    }
+
+    bool ok = savePolicy(path, trainer.policy);
+    std::cout << (ok ? "Saved policy to " : "Could not save policy to ") << path << std::endl;
+    stopTrainer(trainer);
+    return ok ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return runBenchmarks(argc - 2, argv + 2);
+    }
+    if (argc > 2 && strcmp(argv[1], "--train") == 0) {
+        return trainPolicy(argv[2], argc > 3 ? (unsigned int)strtoul(argv[3], NULL, 10) : 200);
+    }
+
     std::cout << "Hello, Atari!" << std::endl;
 
+    // game mode
+    bool rotatedPaddles = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rotated") == 0) {
+            rotatedPaddles = true;
+        }
+        else if (strcmp(argv[i], "--msaa") == 0) {
+            msaa = true;
+        }
+        else if (strcmp(argv[i], "--frametime") == 0) {
+            frameStats = true;
+        }
+        else if (strcmp(argv[i], "--dual") == 0) {
+            noViews = 2;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordDirectory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--evdev") == 0) {
+            rawInputWanted = true;
+        }
+        else if (strcmp(argv[i], "--evdev-record") == 0 && i + 1 < argc) {
+            rawInputWanted = true;
+            rawRecordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--evdev-replay") == 0 && i + 1 < argc) {
+            rawInputWanted = true;
+            rawReplayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--upload-test") == 0 && i + 1 < argc) {
+            uploadTestMB = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--upload-inline") == 0) {
+            uploadInline = true;
+        }
+        else if (strcmp(argv[i], "--hitch") == 0) {
+            hitchCapture = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                hitchDirectory = argv[++i];
+            }
+        }
+        else if (strcmp(argv[i], "--memory") == 0) {
+            memoryReport = true;
+        }
+        else if (strcmp(argv[i], "--spectate") == 0 && i + 1 < argc) {
+            spectateMatches = (unsigned int)strtoul(argv[++i], NULL, 10);
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                spectateThreads = (unsigned int)strtoul(argv[++i], NULL, 10);
+            }
+        }
+        else if (strcmp(argv[i], "--counters") == 0) {
+            profilerCounters = true;
+        }
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            policyLoaded = loadPolicy(argv[++i], policy);
+            if (!policyLoaded) {
+                std::cout << "Could not load policy " << argv[i] << std::endl;
+            }
+        }
+    }
+
     // timing
     double dt = 0.0;
     double lastFrame = 0.0;
 
     // initialization
     initGLFW(3, 3);
+    if (msaa) {
+        glfwWindowHint(GLFW_SAMPLES, 4);
+    }
 
-    // create window
-    GLFWwindow* window = nullptr;
-    createWindow(window, title, scrWidth, scrHeight, framebufferSizeCallback);
-    if (!window) {
-        std::cout << "Could not create window" << std::endl;
-        cleanup();
-        return -1;
+    // create windows, the second shares the first's objects
+    const char* viewTitles[MAX_VIEWS] = { title, "Pong (right player)" };
+    for (unsigned int i = 0; i < noViews; i++) {
+        View& view = views[i];
+        view = {};
+        initGLResources(view.contextObjects);
+        view.width = scrWidth;
+        view.height = scrHeight;
+        createWindow(view.window, viewTitles[i], scrWidth, scrHeight, framebufferSizeCallback,
+            i > 0 ? views[0].window : NULL);
+        if (!view.window) {
+            std::cout << "Could not create window" << std::endl;
+            cleanup();
+            return -1;
+        }
+        glfwSetWindowUserPointer(view.window, &view);
     }
+    glfwMakeContextCurrent(views[0].window);
+
+    initGLResources(sharedObjects);
 
     // load glad
     if (!loadGlad()) {
@@ -439,11 +1293,64 @@ int main() {
         return -1;
     }
 
-    glViewport(0, 0, scrWidth, scrHeight);
+    if (msaa) {
+        aaPad = 0.0f;
+    }
+
+    // loader context, shares the first view's objects like the other views do
+    if (uploadTestMB) {
+        if (!uploadInline) {
+            uploaderActive = startUploader(uploader, views[0].window);
+            if (!uploaderActive) {
+                std::cout << "Could not create loader context, uploading on the render thread" << std::endl;
+            }
+            glfwMakeContextCurrent(views[0].window);
+        }
+        loadTest.data.assign(std::max((size_t)uploadTestMB << 20, (size_t)loadTextureSize * loadTextureSize * 4), 0x5a);
+        loadTest.inFlight = false;
+        loadTest.nextLoad = 2.0;
+        loadTest.loads = 0;
+        loadTest.frameTimes.reserve(1 << 16);
+    }
+
+    // simulation
+    simParams = defaultSimParams((float)scrWidth, (float)scrHeight);
+    simParams.rotatedPaddles = rotatedPaddles;
+    if (!allocMatchBatch(match, 1, 0)) {
+        std::cout << "Could not allocate match" << std::endl;
+        cleanup();
+        return -1;
+    }
+    resetMatch(match, simParams, 0);
+    initStateHash(matchHash, match, 0);
+    recordSession = (unsigned int)time(NULL);
+
+    // profiler rings are always written, the detector only runs when asked for
+    profilerThreadName("render");
+    if (hitchCapture) {
+        HitchParams hitchParams = defaultHitchParams();
+        hitchParams.directory = hitchDirectory;
+        hitchCapture = startHitchDetector(hitchDetector, hitchParams);
+    }
+
+    // raw input, falling back to GLFW polling
+    if (rawInputWanted) {
+        rawInputActive = rawReplayPath ? startInputReplay(rawInput, rawReplayPath) : startRawInput(rawInput, rawRecordPath);
+        if (!rawInputActive) {
+            std::cout << "Could not open evdev input, polling GLFW instead" << std::endl;
+        }
+    }
+    simClock = monotonicTime();
+    gatherOffsets();
 
     // shaders
-    shaderProgram = genShaderProgram("main.vs", "main.fs");
-    setOrthographicProjection(shaderProgram, 0, scrWidth, 0, scrHeight, 0.0f, 1.0f);
+    shaderProgram = adoptProgram(sharedObjects, genShaderProgram("main.vs", "main.fs"));
+    setAntiAliasing(shaderProgram, !msaa, aaPad);
+
+    // palette UBO
+    genBufferObject<PaletteEntry>(paletteUBO, GL_UNIFORM_BUFFER, PALETTE_SIZE, palette, GL_STATIC_DRAW);
+    bindUniformBlock(shaderProgram, "Palette", 0);
+    unbindBuffer(GL_UNIFORM_BUFFER);
 
     /*
         Paddle VAO/BOs
@@ -464,91 +1371,111 @@ int main() {
         2, 3, 0  // bottom right triangle
     };
 
-    // offsets array
-    paddleOffsets[0] = { 35.0f, scrHeight / 2.0f };
-    paddleOffsets[1] = { scrWidth - 35.0f, scrHeight / 2.0f };
-
     // size array
     vec2 paddleSizes[] = {
-        paddleWidth, paddleHeight
+        simParams.paddleWidth, simParams.paddleHeight
     };
 
-    paddleVelocities[0] = 0.0f;
-    paddleVelocities[1] = 0.0f;
-
     // setup VAO
-    VAO paddleVAO;
-    genVAO(&paddleVAO);
+    VAO& paddleVAO = views[0].paddleVAO;
+    genVAO(&paddleVAO, views[0].contextObjects);
 
-    // pos VBO
+    // BOs
     genBufferObject<float>(paddleVAO.posVBO, GL_ARRAY_BUFFER, 2 * 4, paddleVertices, GL_STATIC_DRAW);
-    setAttPointer<float>(paddleVAO.posVBO, 0, 2, GL_FLOAT, 2, 0);
-
-    // offset VBO
-    genBufferObject<vec2>(paddleVAO.offsetVBO, GL_ARRAY_BUFFER, 2, paddleOffsets, GL_DYNAMIC_DRAW);
-    setAttPointer<float>(paddleVAO.offsetVBO, 1, 2, GL_FLOAT, 2, 0, 1);
-
-    // size VBO
+    updateInstances(sharedObjects, paddleVAO.offsets, paddleOffsets, 2);
     genBufferObject<vec2>(paddleVAO.sizeVBO, GL_ARRAY_BUFFER, 1, paddleSizes, GL_STATIC_DRAW);
-    setAttPointer<float>(paddleVAO.sizeVBO, 2, 2, GL_FLOAT, 2, 0, 2);
-
-    // EBO
+    updateInstances(sharedObjects, paddleVAO.angles, paddleAngles, 2);
+    updateInstances(sharedObjects, paddleVAO.palettes, paddlePaletteIdx, 2);
     genBufferObject<GLuint>(paddleVAO.EBO, GL_ELEMENT_ARRAY_BUFFER, 2 * 4, paddleIndices, GL_STATIC_DRAW);
 
-    // unbind VBO and VAO
-    unbindBuffer(GL_ARRAY_BUFFER);
-    unbindVAO();
+    // attributes (unbinds VBO and VAO)
+    linkPaddleVAO(paddleVAO, paddleVAO);
 
     /*
         Ball VAO/BOs
     */
 
     // setup vertex and index data
-    float* ballVertices;
-    unsigned int* ballIndices;
-    unsigned int noTriangles = 50;
-    gen2DCircleArray(ballVertices, ballIndices, noTriangles, 0.5f);
-
-    // offsets array
-    ballOffset = { scrWidth / 2.0f, scrHeight / 2.0f };
+    // analytic AA shades a quad by its distance field,
+    // MSAA needs the tessellated circle so its samples find the edge
+    float* ballVertices = paddleVertices;
+    unsigned int* ballIndices = paddleIndices;
+    unsigned int noBallVertices = 4;
+    unsigned int noBallIndices = 3 * 2;
+    if (msaa) {
+        unsigned int noTriangles = 50;
+        gen2DCircleArray(ballVertices, ballIndices, noTriangles, 0.5f);
+        noBallVertices = noTriangles + 1;
+        noBallIndices = 3 * noTriangles;
+    }
 
-    // size array
-    vec2 ballSizes[] = {
-        ballDiameter, ballDiameter
-    };
+    // instances (ball and sparks, sized per instance)
+    reserveSlots(sparks, MAX_SPARKS);
+    ballOffsets.reserve(1 + MAX_SPARKS);
+    ballSizes.reserve(1 + MAX_SPARKS);
+    ballPalettes.reserve(1 + MAX_SPARKS);
+    unsigned int noBallInstances = gatherBallInstances();
 
     // setup VAO
-    VAO ballVAO;
-    genVAO(&ballVAO);
+    VAO& ballVAO = views[0].ballVAO;
+    genVAO(&ballVAO, views[0].contextObjects);
+
+    // BOs
+    genBufferObject<float>(ballVAO.posVBO, GL_ARRAY_BUFFER, 2 * noBallVertices, ballVertices, GL_STATIC_DRAW);
+    updateInstances(sharedObjects, ballVAO.offsets, ballOffsets.data(), noBallInstances);
+    updateInstances(sharedObjects, ballVAO.sizes, ballSizes.data(), noBallInstances);
+    updateInstances(sharedObjects, ballVAO.palettes, ballPalettes.data(), noBallInstances);
+    genBufferObject<unsigned int>(ballVAO.EBO, GL_ELEMENT_ARRAY_BUFFER, noBallIndices, ballIndices, GL_STATIC_DRAW);
+
+    // attributes (unbinds VBO and VAO)
+    linkBallVAO(ballVAO, ballVAO);
+
+    if (msaa) {
+        delete[] ballVertices;
+        delete[] ballIndices;
+    }
 
-    // pos VBO
-    genBufferObject<float>(ballVAO.posVBO, GL_ARRAY_BUFFER, 2 * (noTriangles + 1), ballVertices, GL_STATIC_DRAW);
-    setAttPointer<float>(ballVAO.posVBO, 0, 2, GL_FLOAT, 2, 0);
+    /*
+        Per-view context state
+    */
 
-    // offset VBO
-    genBufferObject<vec2>(ballVAO.offsetVBO, GL_ARRAY_BUFFER, 1, &ballOffset, GL_DYNAMIC_DRAW);
-    setAttPointer<float>(ballVAO.offsetVBO, 1, 2, GL_FLOAT, 2, 0, 1);
+    for (unsigned int i = 0; i < noViews; i++) {
+        View& view = views[i];
+        glfwMakeContextCurrent(view.window);
+        initContextState();
 
-    // size VBO
-    genBufferObject<vec2>(ballVAO.sizeVBO, GL_ARRAY_BUFFER, 1, ballSizes, GL_STATIC_DRAW);
-    setAttPointer<float>(ballVAO.sizeVBO, 2, 2, GL_FLOAT, 2, 0, 1);
+        if (i > 0) {
+            // only the first view waits for vsync
+            glfwSwapInterval(0);
 
-    // EBO
-    genBufferObject<unsigned int>(ballVAO.EBO, GL_ELEMENT_ARRAY_BUFFER, 3 * noTriangles, ballIndices, GL_STATIC_DRAW);
+            shareVAO(view.paddleVAO, view.contextObjects);
+            linkPaddleVAO(view.paddleVAO, paddleVAO);
+            shareVAO(view.ballVAO, view.contextObjects);
+            linkBallVAO(view.ballVAO, ballVAO);
+        }
+        view.linkedGeneration = instanceGeneration();
 
-    // unbind VBO and VAO
-    unbindBuffer(GL_ARRAY_BUFFER);
-    unbindVAO();
+        // GPU timer
+        if (frameStats) {
+            glGenQueries(1, &view.frameQuery);
+        }
+    }
 
-    // collision check buffer
-    unsigned int framesSinceLastCollision = -1;
-    unsigned int framesThreshold = 10;
+    // spectator tiles, drawn in the first view
+    if (spectateMatches) {
+        glfwMakeContextCurrent(views[0].window);
+        if (!startSpectators(paddleVAO, ballVAO)) {
+            std::cout << "Could not allocate " << spectateMatches << " spectator matches" << std::endl;
+            spectateMatches = 0;
+        }
+    }
 
     displayScore();
 
     // render loop
-    while (!glfwWindowShouldClose(window)) {
+    while (viewsOpen()) {
         // update time
+        unsigned long long frameStart = profilerTime();
         dt = glfwGetTime() - lastFrame;
         lastFrame += dt;
 
@@ -556,146 +1483,140 @@ int main() {
             physics
         */
 
-        // input
-        processInput(window, dt);
-
-        /*
-            collision detection
-        */
-        if (framesSinceLastCollision != -1) {
-            framesSinceLastCollision++;
+        // input and simulation
+        unsigned char frameEvents = 0;
+        {
+            PROFILE_ZONE("simulation");
+            if (rawInputActive) {
+                // key changes carry kernel timestamps, so the step is split at each one
+                // and a key acts from when it was pressed rather than from this frame
+                double frameEnd = monotonicTime();
+                processInput(dt);
+                InputEvent event;
+                while (popInputEvent(rawInput, frameEnd, event)) {
+                    if (event.time > simClock) {
+                        frameEvents |= advance(event.time - simClock);
+                        simClock = event.time;
+                    }
+                    rawKeys = event.keys;
+                    processInput(dt);
+                    recordInputLatency(rawInput, event);
+                }
+                frameEvents |= advance(frameEnd - simClock);
+                simClock = frameEnd;
+            }
+            else {
+                processInput(dt);
+                frameEvents = advance(dt);
+            }
+            gatherOffsets();
+            updatePalette((float)dt, frameEvents);
+            updateSparks((float)dt, frameEvents);
+            if (spectateMatches) {
+                stepSpectators(dt * gameSpeed);
+            }
         }
 
         /*
-            wall collisions (do every frame)
+            graphics
         */
-        if (ballOffset.y - ballRadius <= 0 || ballOffset.y + ballRadius >= scrHeight) {
-            // collision with floor or ceiling
-            ballVelocity.y *= -1;
-        }
 
-        unsigned char reset = 0;
-        if (ballOffset.x - ballRadius <= 0) {
-            // collision with left wall
-            rightScore++;
-            reset = 1;
+        // update data in GPU once, every view reads the same buffers
+        glfwMakeContextCurrent(views[0].window);
+        if (uploadTestMB) {
+            PROFILE_ZONE("load test");
+            runLoadTest(lastFrame, dt);
         }
-        else if (ballOffset.x + ballRadius >= scrWidth) {
-            // collision with right wall
-            leftScore++;
-            reset = 2;
+        updateInstances(sharedObjects, paddleVAO.offsets, paddleOffsets, 2);
+        updateInstances(sharedObjects, paddleVAO.angles, paddleAngles, 2);
+        updateInstances(sharedObjects, paddleVAO.palettes, paddlePaletteIdx, 2);
+        noBallInstances = gatherBallInstances();
+        updateInstances(sharedObjects, ballVAO.offsets, ballOffsets.data(), noBallInstances);
+        updateInstances(sharedObjects, ballVAO.sizes, ballSizes.data(), noBallInstances);
+        updateInstances(sharedObjects, ballVAO.palettes, ballPalettes.data(), noBallInstances);
+        if (spectateMatches) {
+            fillSpectators();
         }
 
-        if (reset) {
-            // put ball in middle
-            ballOffset.x = scrWidth / 2.0f;
-            ballOffset.y = scrHeight / 2.0f;
-
-            // reset velocity to initial
-            ballVelocity.x = reset == 1 ? initBallVelocity.x : -initBallVelocity.x; // go to player that just scores
-            ballVelocity.y = initBallVelocity.y;
-
-            displayScore();
+        // render views
+        for (unsigned int i = 0; i < noViews; i++) {
+            drawView(views[i], noBallIndices, noBallInstances);
         }
 
-        /*
-            paddle collisions
-            do only if it has been a certain amount of frames since the last collision
-        */
-        if (framesSinceLastCollision >= framesThreshold || framesSinceLastCollision == -1) {
-            int i = 0;
-            if (ballOffset.x > scrHeight / 2.0f) {
-                // if ball on right side, check with right paddle
-                i++;
-            }
-
-            // get distance from center of ball to center of paddle
-            vec2 distance = { std::abs(ballOffset.x - paddleOffsets[i].x), std::abs(ballOffset.y - paddleOffsets[i].y) };
-
-            // check if no collision possible
-            if (distance.x <= halfPaddleWidth + ballRadius &&
-                distance.y <= halfPaddleHeight + ballRadius) {
-                bool collision = false;
-                if (distance.x <= halfPaddleWidth && distance.x >= (halfPaddleWidth - ballRadius)) {
-                    // length collision
-                    collision = true;
-                    ballVelocity.x *= -1;
-                }
-                else if (distance.y <= halfPaddleHeight && distance.y >= (halfPaddleHeight - ballRadius)) {
-                    // width collision
-                    collision = true;
-                    ballVelocity.y *= -1;
-                }
-
-                if ((distance.x - halfPaddleWidth) * (distance.x - halfPaddleWidth) +
-                    (distance.y - halfPaddleHeight) * (distance.y - halfPaddleHeight)
-                    <= (ballRadius * ballRadius) &&
-                    !collision) {
-                    // squared distance is less than radius squared
-                    // so distance is less than radius
-                    collision = true;
-                    float signedDifference = paddleOffsets[i].x - ballOffset.x;
-                    if (i == 0) {
-                        // if checking the right paddle, want to reverse difference
-                        // because want to the left of the paddle to be positive
-                        signedDifference *= -1;
-                    }
-
-                    if ((distance.y - halfPaddleHeight) <= (signedDifference - halfPaddleWidth)) {
-                        // if closer to length, treat as length collision
-                        // use signed difference because don't want collision with back side of paddle
-                        ballVelocity.x *= -1;
-                    }
-                    else {
-                        // treat as width collision
-                        ballVelocity.y *= -1;
-                    }
-                }
+        // the shared objects were updated in the first view's context
+        glfwMakeContextCurrent(views[0].window);
+        endGLFrame(sharedObjects);
 
-                if (collision) {
-                    // add to y velocity
-                    float k = 0.5f;
-                    ballVelocity.x *= 1.1f;
-                    ballVelocity.y += k * paddleVelocities[i];
-
-                    // reset frames counter
-                    framesSinceLastCollision = 0;
-                }
-            }
+        {
+            PROFILE_ZONE("glfwPollEvents");
+            glfwPollEvents();
         }
 
-        // update paddle position
-        paddleOffsets[0].y += paddleVelocities[0] * dt * gameSpeed;
-        paddleOffsets[1].y += paddleVelocities[1] * dt * gameSpeed;
-
-        // update ball position
-        ballOffset.x += ballVelocity.x * dt * gameSpeed;
-        ballOffset.y += ballVelocity.y * dt * gameSpeed;
-
-        /*
-            graphics
-        */
-        
-        // clear screen for new frame
-        clearScreen();
-
-        // update data in GPU
-        updateData<vec2>(paddleVAO.offsetVBO, 0, 2, paddleOffsets);
-        updateData<vec2>(ballVAO.offsetVBO, 0, 1, &ballOffset);
-
-        // render object
-        bindShader(shaderProgram);
-        draw(paddleVAO, GL_TRIANGLES, 3 * 2, GL_UNSIGNED_INT, 0, 2);
-        draw(ballVAO, GL_TRIANGLES, 3 * noTriangles, GL_UNSIGNED_INT, 0);
-
-        // swap frames
-        newFrame(window);
+        // a slow frame is written out with the trace around it
+        if (hitchCapture) {
+            endFrame(hitchDetector, frameStart, profilerTime(), match, 0, matchHash.value);
+        }
     }
 
     // cleanup memory
-    cleanup(paddleVAO);
-    cleanup(ballVAO);
-    deleteShader(shaderProgram);
+    for (unsigned int i = noViews; i-- > 0;) {
+        View& view = views[i];
+        glfwMakeContextCurrent(view.window);
+        if (frameStats) {
+            glDeleteQueries(1, &view.frameQuery);
+        }
+        if (i > 0) {
+            // buffers belong to the first view, only the vertex arrays go
+            view.paddleVAO = VAO();
+            view.ballVAO = VAO();
+            destroyGLResources(view.contextObjects);
+        }
+    }
+    if (profilerCounters) {
+        std::cout.flush();
+        printZoneStats(stdout);
+    }
+    if (memoryReport) {
+        reportMemory();
+    }
+    if (hitchCapture) {
+        stopHitchDetector(hitchDetector);
+        std::cout << hitchDetector.hitches << " slow frames, " << hitchDetector.dumps << " traces written to "
+            << hitchDirectory << std::endl;
+    }
+    if (uploadTestMB) {
+        glfwMakeContextCurrent(views[0].window);
+        reportLoadTest();
+        if (uploaderActive) {
+            stopUploader(uploader);
+        }
+    }
+    if (rawInputActive) {
+        stopRawInput(rawInput);
+        std::cout << rawInput.latencyCount << " key changes, event-to-sim latency p50 below "
+            << inputLatencyPercentile(rawInput, 0.5) * 1e3 << " ms, p99 below "
+            << inputLatencyPercentile(rawInput, 0.99) * 1e3 << " ms" << std::endl;
+    }
+    if (recordDirectory) {
+        if (writeDataset(recordDirectory, recording.data(), recording.size(), DATASET_SHARD_SAMPLES, recordSession)) {
+            std::cout << "Wrote " << recording.size() << " samples to " << recordDirectory << std::endl;
+        }
+        else {
+            std::cout << "Could not write samples to " << recordDirectory << std::endl;
+        }
+    }
+
+    glfwMakeContextCurrent(views[0].window);
+    if (spectateMatches) {
+        stopSpectators();
+    }
+    paddleVAO = VAO();
+    ballVAO = VAO();
+    paletteUBO.reset();
+    shaderProgram.reset();
+    destroyGLResources(views[0].contextObjects);
+    destroyGLResources(sharedObjects);
+    freeMatchBatch(match);
     cleanup();
 
     return 0;
@@ -1,7 +1,28 @@
 #version 330 core
 
+in vec2 local;
+flat in vec2 halfSize;
+flat in vec4 baseColor;
+flat in vec4 material;
+
+uniform bool analyticAA;
+
 out vec4 color;
 
 void main() {
-	color = vec4(1.0);
+	// signed distance to the rounded box (negative inside)
+	float r = material.z * min(halfSize.x, halfSize.y);
+	vec2 q = abs(local) - (halfSize - r);
+	float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - r;
+
+	// coverage of the pixel from the distance across it
+	// (with MSAA the samples the geometry covers resolve the edge)
+	float coverage = 1.0;
+	if (analyticAA) {
+		coverage = clamp(0.5 - d / max(fwidth(d), 1e-4), 0.0, 1.0);
+	}
+
+	// flash toward white, then brighten by glow
+	vec3 rgb = mix(baseColor.rgb, vec3(1.0), material.x) * (1.0 + material.y);
+	color = vec4(min(rgb, vec3(1.0)), baseColor.a * coverage);
 }
\ No newline at end of file
@@ -3,9 +3,42 @@
 layout (location = 0) in vec2 pos;
 layout (location = 1) in vec2 offset;
 layout (location = 2) in vec2 size;
+layout (location = 3) in float angle;
+layout (location = 4) in uint paletteIdx;
 
 uniform mat4 projection;
+uniform float aaPad; // pixels to grow each side of a quad so edge coverage has room
+uniform vec2 viewportSize; // pixels
+
+struct PaletteEntry {
+	vec4 color;
+	vec4 material; // x = flash, y = glow, z = roundness (0 = box, 1 = circle)
+};
+
+layout (std140) uniform Palette {
+	PaletteEntry palette[16];
+};
+
+out vec2 local;
+flat out vec2 halfSize;
+flat out vec4 baseColor;
+flat out vec4 material;
 
 void main() {
-	gl_Position = projection * vec4((pos * size) + offset, 0.0, 1.0);
+	// pad from pixels to field units: a pixel is 2 / viewportSize in clip space,
+	// and the projection scales field units into clip space
+	vec2 pad = 2.0 * aaPad / (viewportSize * vec2(projection[0][0], projection[1][1]));
+
+	// scale, then rotate counter-clockwise by angle
+	vec2 scaled = pos * (size + 2.0 * pad);
+	float c = cos(angle);
+	float s = sin(angle);
+	vec2 rotated = vec2(c * scaled.x - s * scaled.y, s * scaled.x + c * scaled.y);
+
+	gl_Position = projection * vec4(rotated + offset, 0.0, 1.0);
+
+	local = scaled;
+	halfSize = 0.5 * size;
+	baseColor = palette[paletteIdx].color;
+	material = palette[paletteIdx].material;
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "memstats.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+struct MemoryCounter {
+    std::atomic<long long> bytes;
+    std::atomic<long long> peak;
+    std::atomic<unsigned long long> allocations;
+};
+
+static MemoryCounter counters[MEMORY_CATEGORIES];
+
+// bytes per GL object, keyed by category and name (buffers and textures have
+// separate names); objects change size rarely, a lock is fine
+static std::unordered_map<unsigned long long, size_t> glObjects;
+static std::mutex glObjectsLock;
+
+void chargeMemory(MemoryCategory category, long long bytes) {
+    MemoryCounter& counter = counters[category];
+    long long now = counter.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (bytes > 0) {
+        counter.allocations.fetch_add(1, std::memory_order_relaxed);
+        long long peak = counter.peak.load(std::memory_order_relaxed);
+        while (now > peak && !counter.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+MemoryStats memoryStats(MemoryCategory category) {
+    MemoryStats stats;
+    stats.bytes = counters[category].bytes.load(std::memory_order_relaxed);
+    stats.peak = counters[category].peak.load(std::memory_order_relaxed);
+    stats.allocations = counters[category].allocations.load(std::memory_order_relaxed);
+    return stats;
+}
+
+const char* memoryCategoryName(MemoryCategory category) {
+    static const char* names[MEMORY_CATEGORIES] = {
+        "other", "sim", "trainer", "experience", "dataset", "recording", "profiler", "io",
+        "gl buffers", "gl textures"
+    };
+    return category < MEMORY_CATEGORIES ? names[category] : "?";
+}
+
+void trackGLObject(MemoryCategory category, unsigned int name, size_t bytes) {
+    if (!name) {
+        return;
+    }
+    unsigned long long key = (unsigned long long)category << 32 | name;
+    long long change;
+    {
+        std::lock_guard<std::mutex> guard(glObjectsLock);
+        size_t& tracked = glObjects[key];
+        change = (long long)bytes - (long long)tracked;
+        tracked = bytes;
+        if (!bytes) {
+            glObjects.erase(key);
+        }
+    }
+    if (change) {
+        chargeMemory(category, change);
+    }
+}
+
+size_t trackedGLBytes(MemoryCategory category, unsigned int name) {
+    std::lock_guard<std::mutex> guard(glObjectsLock);
+    auto found = glObjects.find((unsigned long long)category << 32 | name);
+    return found == glObjects.end() ? 0 : found->second;
+}
+
+void printMemoryStats(FILE* file) {
+    long long total = 0;
+    long long gpu = 0;
+    fprintf(file, "%-12s %12s %12s %10s\n", "memory", "MB", "peak MB", "allocs");
+    for (int c = 0; c < MEMORY_CATEGORIES; c++) {
+        MemoryStats stats = memoryStats((MemoryCategory)c);
+        if (!stats.peak) {
+            continue;
+        }
+        fprintf(file, "%-12s %12.3f %12.3f %10llu\n", memoryCategoryName((MemoryCategory)c),
+            stats.bytes / 1048576.0, stats.peak / 1048576.0, stats.allocations);
+        bool onGPU = c == MEMORY_GL_BUFFERS || c == MEMORY_GL_TEXTURES;
+        (onGPU ? gpu : total) += stats.bytes;
+    }
+    fprintf(file, "%-12s %12.3f\n%-12s %12.3f\n", "host", total / 1048576.0, "gpu", gpu / 1048576.0);
+}
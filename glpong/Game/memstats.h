@@ -0,0 +1,52 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <cstddef>
+#include <cstdio>
+
+/*
+    memory accounting
+    bytes in use and the high-water mark per subsystem, for capacity planning
+    large blocks are charged to the subsystem they were allocated for when mapped and
+    unmapped; GL buffers and textures are charged by name when created, resized and
+    deleted, so the GPU side is known without asking the driver
+    counters are relaxed atomics: any thread may charge or report
+*/
+
+enum MemoryCategory {
+    MEMORY_OTHER,
+    MEMORY_SIM,             // match batches
+    MEMORY_TRAINER,         // evolution noise table
+    MEMORY_EXPERIENCE,      // shared replay buffer
+    MEMORY_DATASET,         // mapped shards
+    MEMORY_RECORDING,       // samples recorded this session
+    MEMORY_PROFILER,        // trace rings, counter tables, hitch captures
+    MEMORY_IO,              // write buffer pool
+    MEMORY_GL_BUFFERS,
+    MEMORY_GL_TEXTURES,
+    MEMORY_CATEGORIES
+};
+
+struct MemoryStats {
+    long long bytes;                // in use
+    long long peak;                 // high-water mark
+    unsigned long long allocations; // charges that added bytes
+};
+
+// add _bytes_ (negative when freed) to a category
+void chargeMemory(MemoryCategory category, long long bytes);
+
+MemoryStats memoryStats(MemoryCategory category);
+
+const char* memoryCategoryName(MemoryCategory category);
+
+// GL object _name_ now holds _bytes_ (0 once deleted); only the difference is charged
+void trackGLObject(MemoryCategory category, unsigned int name, size_t bytes);
+
+// bytes GL object _name_ was last tracked with
+size_t trackedGLBytes(MemoryCategory category, unsigned int name);
+
+// table of bytes and high-water marks per category
+void printMemoryStats(FILE* file);
+
+#endif
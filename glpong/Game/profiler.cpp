@@ -0,0 +1,478 @@
+#include "profiler.h"
+#include "memstats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(TraceRecord) == 32, "two records per cache line");
+
+bool profilerEnabled = true;
+
+// registered rings, never freed (threads may record until the process exits)
+static TraceRing* rings[TRACE_MAX_THREADS];
+static std::atomic<unsigned int> noRings(0);
+static std::mutex registerLock;
+static thread_local TraceRing* localRing = NULL;
+
+unsigned long long profilerTime() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ring of the calling thread, NULL once every slot is taken
+static TraceRing* threadRing() {
+    if (localRing) {
+        return localRing;
+    }
+
+    std::lock_guard<std::mutex> guard(registerLock);
+    unsigned int n = noRings.load();
+    if (n == TRACE_MAX_THREADS) {
+        return NULL;
+    }
+    TraceRing* ring = new TraceRing();
+    chargeMemory(MEMORY_PROFILER, sizeof(TraceRing));
+    ring->written.store(0);
+    ring->thread = n;
+    snprintf(ring->threadName, sizeof(ring->threadName), "thread %u", n);
+    rings[n] = ring;
+    noRings.store(n + 1, std::memory_order_release);
+    localRing = ring;
+    return ring;
+}
+
+void profilerThreadName(const char* name) {
+    TraceRing* ring = threadRing();
+    if (ring) {
+        std::lock_guard<std::mutex> guard(registerLock);
+        snprintf(ring->threadName, sizeof(ring->threadName), "%s", name);
+    }
+}
+
+void traceRecord(TraceKind kind, const char* name, unsigned long long start, unsigned long long duration, unsigned int arg) {
+    TraceRing* ring = threadRing();
+    if (!ring) {
+        return;
+    }
+    unsigned long long w = ring->written.load(std::memory_order_relaxed);
+    TraceRecord& record = ring->records[w % TRACE_RING_SIZE];
+    record.start = start;
+    record.duration = (unsigned int)std::min(duration, 0xffffffffull);
+    record.arg = arg;
+    record.name = name;
+    record.kind = (unsigned char)kind;
+    record.thread = (unsigned char)ring->thread;
+    ring->written.store(w + 1, std::memory_order_release);
+}
+
+/*
+    hardware counters
+*/
+
+bool profilerCounters = false;
+
+struct ZoneTotals {
+    std::atomic<const char*> name;      // NULL for a free slot, set once by the owner
+    std::atomic<unsigned long long> calls;
+    std::atomic<unsigned long long> time;
+    std::atomic<unsigned long long> counters[PROFILE_COUNTERS];
+};
+
+struct ThreadCounters {
+    bool available;                         // the group opened
+    bool rdpmc;                             // every event can be read from user space
+    int fds[PROFILE_COUNTERS];              // -1 for events this CPU does not have
+    int slots[PROFILE_COUNTERS];            // position in a group read
+    void* pages[PROFILE_COUNTERS];          // perf_event_mmap_page of each event
+    ZoneTotals zones[PROFILE_MAX_ZONES];    // open addressing on the name pointer
+};
+
+// like the rings, never freed
+static ThreadCounters* counterThreads[TRACE_MAX_THREADS];
+static std::atomic<unsigned int> noCounterThreads(0);
+static thread_local ThreadCounters* localCounters = NULL;
+
+#ifdef __linux__
+static const unsigned int counterTypes[PROFILE_COUNTERS] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+};
+static const unsigned long long counterConfigs[PROFILE_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_MISSES,     // last level on most CPUs
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// group counting the calling thread in user space; cycles lead and are pinned, so
+// the group is either on the PMU as a whole or not at all (no scaling needed)
+static void openCounters(ThreadCounters& t) {
+    unsigned int noOpen = 0;
+    t.rdpmc = true;
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counterTypes[i];
+        attr.config = counterConfigs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.pinned = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        t.fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, i ? t.fds[0] : -1, 0);
+        if (t.fds[i] < 0) {
+            if (i == 0) {
+                return;
+            }
+            continue;
+        }
+        t.slots[i] = noOpen++;
+
+        // the mapped page tells where the counter is, for rdpmc
+        t.pages[i] = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, t.fds[i], 0);
+        if (t.pages[i] == MAP_FAILED) {
+            t.pages[i] = NULL;
+        }
+        t.rdpmc = t.rdpmc && t.pages[i] && ((perf_event_mmap_page*)t.pages[i])->cap_user_rdpmc;
+    }
+    t.available = true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline unsigned long long rdpmc(unsigned int counter) {
+    unsigned int low, high;
+    __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(counter));
+    return low | ((unsigned long long)high << 32);
+}
+
+// read every event from user space, false if one is not on a counter right now
+static bool readPmc(const ThreadCounters& t, unsigned long long* values) {
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        if (t.fds[i] < 0) {
+            values[i] = 0;
+            continue;
+        }
+
+        // the kernel bumps lock around changes of index and offset
+        volatile perf_event_mmap_page* page = (volatile perf_event_mmap_page*)t.pages[i];
+        unsigned int seq;
+        do {
+            seq = page->lock;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            unsigned int index = page->index;
+            if (!index) {
+                return false;
+            }
+            unsigned int shift = 64 - page->pmc_width;
+            long long count = (long long)(rdpmc(index - 1) << shift) >> shift;
+            values[i] = page->offset + count;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while (page->lock != seq);
+    }
+    return true;
+}
+#endif
+#endif
+
+// counters of the calling thread, NULL once every slot is taken
+static ThreadCounters* threadCounterState() {
+    if (localCounters) {
+        return localCounters;
+    }
+
+    std::lock_guard<std::mutex> guard(registerLock);
+    unsigned int n = noCounterThreads.load();
+    if (n == TRACE_MAX_THREADS) {
+        return NULL;
+    }
+    ThreadCounters* t = new ThreadCounters();
+    chargeMemory(MEMORY_PROFILER, sizeof(ThreadCounters));
+    t->available = false;
+    t->rdpmc = false;
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        t->fds[i] = -1;
+        t->slots[i] = -1;
+        t->pages[i] = NULL;
+    }
+    for (unsigned int z = 0; z < PROFILE_MAX_ZONES; z++) {
+        t->zones[z].name.store(NULL);
+    }
+#ifdef __linux__
+    openCounters(*t);
+#endif
+    counterThreads[n] = t;
+    noCounterThreads.store(n + 1, std::memory_order_release);
+    localCounters = t;
+    return t;
+}
+
+bool threadCounters() {
+    ThreadCounters* t = threadCounterState();
+    return t && t->available;
+}
+
+void readCounters(unsigned long long* values) {
+    ThreadCounters* t = threadCounterState();
+    if (!t || !t->available) {
+        memset(values, 0, PROFILE_COUNTERS * sizeof(unsigned long long));
+        return;
+    }
+#ifdef __linux__
+#if defined(__x86_64__) || defined(__i386__)
+    if (t->rdpmc && readPmc(*t, values)) {
+        return;
+    }
+#endif
+    // one system call for the whole group
+    unsigned long long group[1 + PROFILE_COUNTERS];
+    bool ok = read(t->fds[0], group, sizeof(group)) > 0;
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        values[i] = ok && t->slots[i] >= 0 ? group[1 + t->slots[i]] : 0;
+    }
+#endif
+}
+
+// only the owner thread writes a zone, so a load and a store are enough
+static void addTotal(std::atomic<unsigned long long>& total, unsigned long long value) {
+    total.store(total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void addZoneCounters(const char* name, unsigned long long duration, const unsigned long long* startCounters) {
+    unsigned long long counters[PROFILE_COUNTERS];
+    readCounters(counters);
+    ThreadCounters* t = localCounters;
+    if (!t) {
+        return;
+    }
+
+    // zones are named with string literals, so the pointer is the key
+    unsigned int z = (unsigned int)(((size_t)name >> 3) * 0x9e3779b97f4a7c15ull >> 56) % PROFILE_MAX_ZONES;
+    for (unsigned int probe = 0; probe < PROFILE_MAX_ZONES; probe++, z = (z + 1) % PROFILE_MAX_ZONES) {
+        ZoneTotals& zone = t->zones[z];
+        const char* zoneName = zone.name.load(std::memory_order_relaxed);
+        if (!zoneName) {
+            zone.name.store(name, std::memory_order_release);
+        }
+        else if (zoneName != name) {
+            continue;
+        }
+
+        addTotal(zone.calls, 1);
+        addTotal(zone.time, duration);
+        for (int i = 0; i < PROFILE_COUNTERS; i++) {
+            addTotal(zone.counters[i], counters[i] - startCounters[i]);
+        }
+        return;
+    }
+}
+
+unsigned int collectZoneStats(ZoneStats* stats, unsigned int max) {
+    unsigned int count = 0;
+    unsigned int noThreads = noCounterThreads.load(std::memory_order_acquire);
+    for (unsigned int t = 0; t < noThreads; t++) {
+        for (unsigned int z = 0; z < PROFILE_MAX_ZONES; z++) {
+            const ZoneTotals& zone = counterThreads[t]->zones[z];
+            const char* name = zone.name.load(std::memory_order_acquire);
+            if (!name || !zone.calls.load(std::memory_order_relaxed)) {
+                continue;
+            }
+
+            // the same zone on other threads (or the same text in another file)
+            unsigned int s = 0;
+            while (s < count && strcmp(stats[s].name, name) != 0) {
+                s++;
+            }
+            if (s == count) {
+                if (count == max) {
+                    continue;
+                }
+                memset(&stats[count], 0, sizeof(ZoneStats));
+                stats[count++].name = name;
+            }
+            stats[s].calls += zone.calls.load(std::memory_order_relaxed);
+            stats[s].time += zone.time.load(std::memory_order_relaxed);
+            for (int i = 0; i < PROFILE_COUNTERS; i++) {
+                stats[s].counters[i] += zone.counters[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    std::sort(stats, stats + count, [](const ZoneStats& a, const ZoneStats& b) { return a.time > b.time; });
+    return count;
+}
+
+// totals of zones still running elsewhere may survive in part
+void resetZoneStats() {
+    unsigned int noThreads = noCounterThreads.load(std::memory_order_acquire);
+    for (unsigned int t = 0; t < noThreads; t++) {
+        for (unsigned int z = 0; z < PROFILE_MAX_ZONES; z++) {
+            ZoneTotals& zone = counterThreads[t]->zones[z];
+            zone.calls.store(0, std::memory_order_relaxed);
+            zone.time.store(0, std::memory_order_relaxed);
+            for (int i = 0; i < PROFILE_COUNTERS; i++) {
+                zone.counters[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// events per thousand instructions
+static double perKilo(const ZoneStats& zone, ProfileCounter counter) {
+    return zone.counters[counter] * 1000.0 / zone.counters[COUNTER_INSTRUCTIONS];
+}
+
+void printZoneStats(FILE* file) {
+    std::vector<ZoneStats> stats(PROFILE_MAX_ZONES);
+    unsigned int count = collectZoneStats(stats.data(), PROFILE_MAX_ZONES);
+
+    bool counted = false;
+    for (unsigned int s = 0; s < count; s++) {
+        counted = counted || stats[s].counters[COUNTER_INSTRUCTIONS];
+    }
+    if (!counted) {
+        fputs("hardware counters unavailable, time only\n", file);
+    }
+
+    // misses per thousand instructions: high L1D/LLC with low IPC is memory-bound,
+    // high branch misses with low IPC is branch-bound
+    fprintf(file, "%-24s %10s %10s %9s %6s %8s %8s %8s\n", "zone", "calls", "ms", "us/call", "IPC", "L1D/ki", "LLC/ki", "br/ki");
+    for (unsigned int s = 0; s < count; s++) {
+        const ZoneStats& zone = stats[s];
+        fprintf(file, "%-24.24s %10llu %10.3f %9.3f", zone.name, zone.calls, zone.time * 1e-6,
+            zone.calls ? zone.time * 1e-3 / zone.calls : 0.0);
+        if (zone.counters[COUNTER_INSTRUCTIONS] && zone.counters[COUNTER_CYCLES]) {
+            fprintf(file, " %6.2f %8.2f %8.2f %8.2f\n",
+                (double)zone.counters[COUNTER_INSTRUCTIONS] / zone.counters[COUNTER_CYCLES],
+                perKilo(zone, COUNTER_L1D_MISSES), perKilo(zone, COUNTER_LLC_MISSES), perKilo(zone, COUNTER_BRANCH_MISSES));
+        }
+        else {
+            fprintf(file, " %6s %8s %8s %8s\n", "-", "-", "-", "-");
+        }
+    }
+}
+
+/*
+    capture
+*/
+
+void captureTrace(TraceCapture& capture, unsigned long long since) {
+    capture.count = 0;
+    capture.noThreads = noRings.load(std::memory_order_acquire);
+    if (!capture.noThreads) {
+        return;
+    }
+    size_t share = capture.capacity / capture.noThreads;
+
+    for (unsigned int t = 0; t < capture.noThreads; t++) {
+        TraceRing& ring = *rings[t];
+        {
+            std::lock_guard<std::mutex> guard(registerLock);
+            memcpy(capture.threadNames[t], ring.threadName, sizeof(capture.threadNames[t]));
+        }
+
+        // newest records, up to the ring size or this thread's share
+        unsigned long long end = ring.written.load(std::memory_order_acquire);
+        unsigned long long first = end - std::min(end, (unsigned long long)std::min((size_t)TRACE_RING_SIZE, share));
+        TraceRecord* out = capture.records + capture.count;
+        size_t n = (size_t)(end - first);
+        for (size_t j = 0; j < n; j++) {
+            out[j] = ring.records[(first + j) % TRACE_RING_SIZE];
+        }
+
+        // the writer kept going during the copy: records it may have reused are the
+        // oldest ones, drop them, then drop those older than _since_
+        std::atomic_thread_fence(std::memory_order_acquire);
+        unsigned long long now = ring.written.load(std::memory_order_relaxed);
+        unsigned long long safe = now > TRACE_RING_SIZE ? std::max(first, now - TRACE_RING_SIZE) : first;
+        size_t kept = 0;
+        for (size_t j = (size_t)(std::min(safe, end) - first); j < n; j++) {
+            if (out[j].start + out[j].duration >= since) {
+                out[kept++] = out[j];
+            }
+        }
+        capture.count += kept;
+    }
+}
+
+/*
+    chrome trace
+*/
+
+// write _s_ as a JSON string body
+static void writeEscaped(FILE* file, const char* s) {
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', file);
+        }
+        fputc((unsigned char)*s >= 0x20 ? *s : ' ', file);
+    }
+}
+
+bool writeChromeTrace(const char* path, const TraceCapture& capture, const char* otherData) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    // timestamps in microseconds from the oldest record
+    unsigned long long origin = ~0ull;
+    for (size_t i = 0; i < capture.count; i++) {
+        origin = std::min(origin, capture.records[i].start);
+    }
+
+    fputs("{\"traceEvents\":[\n", file);
+    for (unsigned int t = 0; t < capture.noThreads; t++) {
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", t);
+        writeEscaped(file, capture.threadNames[t]);
+        fputs("\"}},\n", file);
+    }
+
+    static const char* categories[] = { "zone", "gl", "input", "frame" };
+    for (size_t i = 0; i < capture.count; i++) {
+        const TraceRecord& record = capture.records[i];
+        double ts = (record.start - origin) * 1e-3;
+        fputs("{\"name\":\"", file);
+        writeEscaped(file, record.name ? record.name : "?");
+        fprintf(file, "\",\"cat\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,", categories[record.kind & 3], record.thread, ts);
+        if (record.kind == TRACE_INPUT) {
+            fprintf(file, "\"ph\":\"i\",\"s\":\"t\",\"args\":{\"keys\":%u}}", record.arg);
+        }
+        else {
+            fprintf(file, "\"ph\":\"X\",\"dur\":%.3f,\"args\":{\"arg\":%u}}", record.duration * 1e-3, record.arg);
+        }
+        fputs(i + 1 < capture.count ? ",\n" : "\n", file);
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\",\"otherData\":{%s", otherData ? otherData : "");
+
+    // zone totals since the last reset, with the raw counts
+    if (profilerCounters) {
+        std::vector<ZoneStats> stats(PROFILE_MAX_ZONES);
+        unsigned int count = collectZoneStats(stats.data(), PROFILE_MAX_ZONES);
+        fputs(otherData && *otherData ? ",\"zones\":[" : "\"zones\":[", file);
+        for (unsigned int s = 0; s < count; s++) {
+            const ZoneStats& zone = stats[s];
+            fputs(s ? ",{\"name\":\"" : "{\"name\":\"", file);
+            writeEscaped(file, zone.name);
+            fprintf(file, "\",\"calls\":%llu,\"ns\":%llu,\"cycles\":%llu,\"instructions\":%llu,"
+                "\"l1d_misses\":%llu,\"llc_misses\":%llu,\"branch_misses\":%llu}",
+                zone.calls, zone.time, zone.counters[COUNTER_CYCLES], zone.counters[COUNTER_INSTRUCTIONS],
+                zone.counters[COUNTER_L1D_MISSES], zone.counters[COUNTER_LLC_MISSES], zone.counters[COUNTER_BRANCH_MISSES]);
+        }
+        fputs("]", file);
+    }
+    fputs("}}\n", file);
+
+    bool ok = !ferror(file);
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,163 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+
+/*
+    continuous profiler
+    every thread appends fixed-size records to its own ring (one writer, no locks):
+    zones when they end, GL calls, input events and frame boundaries
+    the rings are always on and hold the last several seconds, so when something goes
+    wrong the recent past can be copied out and written as a Chrome trace
+    (chrome://tracing or ui.perfetto.dev)
+*/
+
+enum TraceKind {
+    TRACE_ZONE,
+    TRACE_GL,           // zone around a GL call
+    TRACE_INPUT,        // instant, arg is the held keys
+    TRACE_FRAME         // zone spanning a whole frame
+};
+
+// one record (32 bytes)
+struct TraceRecord {
+    unsigned long long start;   // ns on the profiler clock
+    unsigned int duration;      // ns, 0 for instants
+    unsigned int arg;
+    const char* name;           // static string
+    unsigned char kind;
+    unsigned char thread;
+    unsigned char pad[6];
+};
+
+const unsigned int TRACE_RING_SIZE = 1 << 15;   // records per thread
+const unsigned int TRACE_MAX_THREADS = 16;
+
+struct TraceRing {
+    TraceRecord records[TRACE_RING_SIZE];
+    std::atomic<unsigned long long> written;    // records ever written
+    unsigned int thread;
+    char threadName[32];
+};
+
+// false skips recording (a zone then costs one branch)
+extern bool profilerEnabled;
+
+// ns on the profiler clock
+unsigned long long profilerTime();
+
+// name the calling thread in traces (registers its ring on first use otherwise)
+void profilerThreadName(const char* name);
+
+// append a record to the calling thread's ring
+void traceRecord(TraceKind kind, const char* name, unsigned long long start, unsigned long long duration, unsigned int arg = 0);
+
+// instant event
+inline void traceInstant(TraceKind kind, const char* name, unsigned int arg = 0) {
+    if (profilerEnabled) {
+        traceRecord(kind, name, profilerTime(), 0, arg);
+    }
+}
+
+/*
+    hardware counters
+    with profilerCounters set, every thread opens a perf_event group on its first zone
+    (Linux): cycles leading instructions, L1D read misses, LLC misses and branch misses
+    zones read the group at both ends with rdpmc, without a system call, and add the
+    differences to totals per zone name and thread; IPC and misses per thousand
+    instructions then tell memory-bound zones from branch-bound ones
+    without a usable PMU (Windows, most virtual machines, perf_event_paranoid above 2)
+    the totals still count calls and time
+*/
+
+enum ProfileCounter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    PROFILE_COUNTERS
+};
+
+const unsigned int PROFILE_MAX_ZONES = 256;    // zone names per thread
+
+// totals of one zone
+struct ZoneStats {
+    const char* name;
+    unsigned long long calls;
+    unsigned long long time;                        // ns
+    unsigned long long counters[PROFILE_COUNTERS];  // 0 without counters
+};
+
+// set before the zones to measure start (costs two counter reads per zone)
+extern bool profilerCounters;
+
+// open the calling thread's group if needed, false if its counters cannot be read
+bool threadCounters();
+
+// current counter values of the calling thread, zeros without counters
+void readCounters(unsigned long long* values);
+
+// add a finished zone to the calling thread's totals
+void addZoneCounters(const char* name, unsigned long long duration, const unsigned long long* startCounters);
+
+// totals of every thread merged by name, slowest first; returns the number of zones
+unsigned int collectZoneStats(ZoneStats* stats, unsigned int max);
+
+void resetZoneStats();
+
+// table of calls, time, IPC and miss rates per zone
+void printZoneStats(FILE* file);
+
+// zone from construction to the end of the scope
+struct ProfileZone {
+    const char* name;
+    unsigned long long start;
+    TraceKind kind;
+    unsigned long long counters[PROFILE_COUNTERS];
+
+    ProfileZone(const char* name, TraceKind kind = TRACE_ZONE) : name(name), kind(kind) {
+        start = profilerEnabled ? profilerTime() : 0;
+        if (profilerCounters && start) {
+            readCounters(counters);
+        }
+    }
+    ~ProfileZone() {
+        if (profilerEnabled && start) {
+            unsigned long long duration = profilerTime() - start;
+            if (profilerCounters) {
+                addZoneCounters(name, duration, counters);
+            }
+            traceRecord(kind, name, start, duration);
+        }
+    }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GL(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name, TRACE_GL)
+
+/*
+    capture
+*/
+
+struct TraceCapture {
+    TraceRecord* records;
+    size_t capacity;
+    size_t count;
+    char threadNames[TRACE_MAX_THREADS][32];
+    unsigned int noThreads;
+};
+
+// copy every thread's records that started after _since_ (newest first if they do
+// not all fit), skipping any a writer overwrote during the copy
+void captureTrace(TraceCapture& capture, unsigned long long since);
+
+// write a capture as Chrome trace JSON, with _otherData_ (a JSON object body, may be
+// NULL) under "otherData", and the zone totals there too when counters are on
+bool writeChromeTrace(const char* path, const TraceCapture& capture, const char* otherData);
+
+#endif
@@ -0,0 +1,432 @@
+#include "rans.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define RANS_X64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#endif
+#endif
+
+// probabilities are multiples of 1 / (1 << scaleBits)
+const unsigned int scaleBits = 10;
+const unsigned int scale = 1 << scaleBits;
+
+// lower bound of a normalized state
+const unsigned int stateLow = 1 << 16;
+
+/*
+    stream layout (little endian)
+        u8  alphabet
+        u8  ways
+        u32 symbol count
+        u16 frequencies[alphabet contexts][alphabet symbols]
+        u32 word count
+        u32 states[ways]
+        u16 words[word count], then RANS_WAYS zero words so decoders can read ahead
+*/
+
+static void putU16(std::vector<unsigned char>& out, unsigned int v) {
+    out.push_back(v & 0xff);
+    out.push_back((v >> 8) & 0xff);
+}
+
+static void putU32(std::vector<unsigned char>& out, unsigned int v) {
+    putU16(out, v & 0xffff);
+    putU16(out, v >> 16);
+}
+
+static unsigned int getU16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int getU32(const unsigned char* p) {
+    return getU16(p) | (getU16(p + 2) << 16);
+}
+
+/*
+    frequency tables
+*/
+
+// scale _counts_ to frequencies summing to _scale_, keeping every seen symbol above 0
+static void normalize(const size_t* counts, unsigned int alphabet, unsigned int* freqs) {
+    size_t total = 0;
+    for (unsigned int s = 0; s < alphabet; s++) {
+        total += counts[s];
+    }
+
+    if (!total) {
+        // unused context
+        memset(freqs, 0, alphabet * sizeof(unsigned int));
+        freqs[0] = scale;
+        return;
+    }
+
+    unsigned int sum = 0;
+    for (unsigned int s = 0; s < alphabet; s++) {
+        freqs[s] = counts[s] ? (unsigned int)(counts[s] * scale / total) : 0;
+        if (counts[s] && !freqs[s]) {
+            freqs[s] = 1;
+        }
+        sum += freqs[s];
+    }
+
+    // settle the rounding on the most frequent symbols
+    while (sum != scale) {
+        unsigned int largest = 0;
+        for (unsigned int s = 1; s < alphabet; s++) {
+            if (freqs[s] > freqs[largest]) {
+                largest = s;
+            }
+        }
+        if (sum < scale) {
+            freqs[largest] += scale - sum;
+            sum = scale;
+        }
+        else {
+            unsigned int cut = sum - scale < freqs[largest] - 1 ? sum - scale : freqs[largest] - 1;
+            freqs[largest] -= cut;
+            sum -= cut;
+        }
+    }
+}
+
+// decode table entry for every slot of every context: symbol | freq << 8 | start << 20
+static void buildDecodeTable(const unsigned int* freqs, unsigned int alphabet, unsigned int* table) {
+    for (unsigned int ctx = 0; ctx < alphabet; ctx++) {
+        const unsigned int* f = freqs + ctx * alphabet;
+        unsigned int* entries = table + ctx * scale;
+        unsigned int start = 0;
+        for (unsigned int s = 0; s < alphabet; s++) {
+            for (unsigned int slot = start; slot < start + f[s]; slot++) {
+                entries[slot] = s | (f[s] << 8) | (start << 20);
+            }
+            start += f[s];
+        }
+    }
+}
+
+/*
+    encoding
+*/
+
+void ransEncode(const unsigned char* symbols, size_t count, unsigned int alphabet, std::vector<unsigned char>& out) {
+    size_t steps = (count + RANS_WAYS - 1) / RANS_WAYS;
+
+    // symbol of lane _k_ at step _i_, padding past the end with 0
+    auto symbolAt = [&](size_t i, unsigned int k) -> unsigned int {
+        size_t idx = i * RANS_WAYS + k;
+        return idx < count ? symbols[idx] : 0;
+    };
+
+    // fit a table to each context
+    size_t counts[RANS_MAX_ALPHABET][RANS_MAX_ALPHABET] = {};
+    for (size_t i = 0; i < steps; i++) {
+        for (unsigned int k = 0; k < RANS_WAYS; k++) {
+            unsigned int ctx = i ? symbolAt(i - 1, k) : 0;
+            counts[ctx][symbolAt(i, k)]++;
+        }
+    }
+    unsigned int freqs[RANS_MAX_ALPHABET * RANS_MAX_ALPHABET];
+    unsigned int starts[RANS_MAX_ALPHABET * RANS_MAX_ALPHABET];
+    for (unsigned int ctx = 0; ctx < alphabet; ctx++) {
+        normalize(counts[ctx], alphabet, freqs + ctx * alphabet);
+        unsigned int start = 0;
+        for (unsigned int s = 0; s < alphabet; s++) {
+            starts[ctx * alphabet + s] = start;
+            start += freqs[ctx * alphabet + s];
+        }
+    }
+
+    // code backwards so the decoder runs forwards; lanes go in reverse too, so the
+    // words of a step come out in lane order
+    unsigned int states[RANS_WAYS];
+    for (unsigned int k = 0; k < RANS_WAYS; k++) {
+        states[k] = stateLow;
+    }
+    std::vector<unsigned short> words;
+    words.reserve(count / 4 + 16);
+
+    for (size_t i = steps; i-- > 0;) {
+        for (unsigned int k = RANS_WAYS; k-- > 0;) {
+            unsigned int ctx = i ? symbolAt(i - 1, k) : 0;
+            unsigned int s = symbolAt(i, k);
+            unsigned int freq = freqs[ctx * alphabet + s];
+            unsigned int start = starts[ctx * alphabet + s];
+
+            // renormalize so the state stays below 2^32 after coding
+            unsigned int x = states[k];
+            unsigned long long xMax = (unsigned long long)((stateLow >> scaleBits) << 16) * freq;
+            if (x >= xMax) {
+                words.push_back(x & 0xffff);
+                x >>= 16;
+            }
+
+            states[k] = ((x / freq) << scaleBits) + (x % freq) + start;
+        }
+    }
+
+    // header
+    out.push_back((unsigned char)alphabet);
+    out.push_back((unsigned char)RANS_WAYS);
+    putU32(out, (unsigned int)count);
+    for (unsigned int i = 0; i < alphabet * alphabet; i++) {
+        putU16(out, freqs[i]);
+    }
+    putU32(out, (unsigned int)words.size());
+    for (unsigned int k = 0; k < RANS_WAYS; k++) {
+        putU32(out, states[k]);
+    }
+
+    // words in the order the decoder reads them
+    for (size_t w = words.size(); w-- > 0;) {
+        putU16(out, words[w]);
+    }
+    for (unsigned int k = 0; k < RANS_WAYS; k++) {
+        putU16(out, 0);
+    }
+}
+
+/*
+    decoding
+*/
+
+// parsed header of a stream
+struct RansStream {
+    unsigned int alphabet;
+    size_t count;
+    size_t steps;
+    unsigned int freqs[RANS_MAX_ALPHABET * RANS_MAX_ALPHABET];
+    unsigned int states[RANS_WAYS];
+    const unsigned char* words;
+    size_t noWords;
+    size_t size;    // bytes of the whole stream
+};
+
+static bool readHeader(const unsigned char* data, size_t size, RansStream& stream) {
+    if (size < 6) {
+        return false;
+    }
+    stream.alphabet = data[0];
+    if (!stream.alphabet || stream.alphabet > RANS_MAX_ALPHABET || data[1] != RANS_WAYS) {
+        return false;
+    }
+    stream.count = getU32(data + 2);
+    stream.steps = (stream.count + RANS_WAYS - 1) / RANS_WAYS;
+
+    size_t tableBytes = 2 * stream.alphabet * stream.alphabet;
+    size_t pos = 6;
+    if (size < pos + tableBytes + 4 + 4 * RANS_WAYS) {
+        return false;
+    }
+    for (unsigned int ctx = 0; ctx < stream.alphabet; ctx++) {
+        unsigned int sum = 0;
+        for (unsigned int s = 0; s < stream.alphabet; s++) {
+            unsigned int f = getU16(data + pos);
+            stream.freqs[ctx * stream.alphabet + s] = f;
+            sum += f;
+            pos += 2;
+        }
+        if (sum != scale) {
+            return false;
+        }
+    }
+
+    stream.noWords = getU32(data + pos);
+    pos += 4;
+    for (unsigned int k = 0; k < RANS_WAYS; k++) {
+        stream.states[k] = getU32(data + pos);
+        pos += 4;
+    }
+
+    stream.words = data + pos;
+    stream.size = pos + 2 * (stream.noWords + RANS_WAYS);
+    return size >= stream.size;
+}
+
+size_t ransSymbolCount(const unsigned char* data, size_t size) {
+    return size < 6 ? 0 : getU32(data + 2);
+}
+
+size_t ransDecodeScalar(const unsigned char* data, size_t size, std::vector<unsigned char>& symbols) {
+    RansStream stream;
+    if (!readHeader(data, size, stream)) {
+        return 0;
+    }
+
+    std::vector<unsigned int> table(stream.alphabet * scale);
+    buildDecodeTable(stream.freqs, stream.alphabet, table.data());
+
+    symbols.resize(stream.steps * RANS_WAYS);
+    unsigned char* out = symbols.data();
+    const unsigned char* words = stream.words;
+    const unsigned char* wordsEnd = words + 2 * stream.noWords;
+
+    unsigned int x[RANS_WAYS];
+    unsigned int ctx[RANS_WAYS] = {};
+    memcpy(x, stream.states, sizeof(x));
+
+    for (size_t i = 0; i < stream.steps; i++) {
+        for (unsigned int k = 0; k < RANS_WAYS; k++) {
+            unsigned int slot = x[k] & (scale - 1);
+            unsigned int e = table[(ctx[k] << scaleBits) | slot];
+            unsigned int s = e & 0xff;
+            x[k] = ((e >> 8) & 0xfff) * (x[k] >> scaleBits) + slot - (e >> 20);
+
+            // refill without a branch, the padding words make the read safe
+            unsigned int need = x[k] < stateLow;
+            unsigned int refill = (x[k] << 16) | getU16(words);
+            x[k] = need ? refill : x[k];
+            words += 2 * need;
+
+            out[i * RANS_WAYS + k] = (unsigned char)s;
+            ctx[k] = s;
+        }
+        if (words > wordsEnd) {
+            return 0;
+        }
+    }
+
+    symbols.resize(stream.count);
+    return stream.size;
+}
+
+#ifdef RANS_X64
+
+static bool hasAVX2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] >> 5) & 1;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] >> 27) & 1;
+    return avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+}
+
+static const bool avx2 = hasAVX2();
+
+// for each mask of lanes that need a word, the index of the word each lane takes
+struct WordLanes {
+    int lanes[256][8];
+    WordLanes() {
+        for (int mask = 0; mask < 256; mask++) {
+            int next = 0;
+            for (int k = 0; k < 8; k++) {
+                lanes[mask][k] = (mask >> k) & 1 ? next++ : 0;
+            }
+        }
+    }
+};
+static const WordLanes wordLanes;
+
+// decode one symbol in each of 8 lanes, returns the symbols
+TARGET_AVX2 static inline __m256i decodeLanes(__m256i& x, __m256i ctx, const int* entries) {
+    const __m256i slotMask = _mm256_set1_epi32(scale - 1);
+    const __m256i freqMask = _mm256_set1_epi32(0xfff);
+
+    // look up every lane's slot in its context
+    __m256i slot = _mm256_and_si256(x, slotMask);
+    __m256i e = _mm256_i32gather_epi32(entries, _mm256_or_si256(_mm256_slli_epi32(ctx, scaleBits), slot), 4);
+    __m256i freq = _mm256_and_si256(_mm256_srli_epi32(e, 8), freqMask);
+    __m256i start = _mm256_srli_epi32(e, 20);
+    x = _mm256_sub_epi32(_mm256_add_epi32(_mm256_mullo_epi32(freq, _mm256_srli_epi32(x, scaleBits)), slot), start);
+
+    return _mm256_and_si256(e, _mm256_set1_epi32(0xff));
+}
+
+// lanes below the normalized range take the next words in lane order
+// (no branch, a mask of 0 takes nothing)
+TARGET_AVX2 static inline void refillLanes(__m256i& x, const unsigned char*& words) {
+    __m256i need = _mm256_cmpeq_epi32(_mm256_srli_epi32(x, 16), _mm256_setzero_si256());
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(need));
+    __m256i next = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)words));
+    __m256i lanes = _mm256_loadu_si256((const __m256i*)wordLanes.lanes[mask]);
+    __m256i refill = _mm256_or_si256(_mm256_slli_epi32(x, 16), _mm256_permutevar8x32_epi32(next, lanes));
+    x = _mm256_blendv_epi8(x, refill, need);
+    words += 2 * _mm_popcnt_u32(mask);
+}
+
+TARGET_AVX2 static size_t ransDecodeAVX2(const unsigned char* data, size_t size, std::vector<unsigned char>& symbols) {
+    RansStream stream;
+    if (!readHeader(data, size, stream)) {
+        return 0;
+    }
+
+    std::vector<unsigned int> table(stream.alphabet * scale);
+    buildDecodeTable(stream.freqs, stream.alphabet, table.data());
+
+    symbols.resize(stream.steps * RANS_WAYS);
+    unsigned char* out = symbols.data();
+    const unsigned char* words = stream.words;
+    const unsigned char* wordsEnd = words + 2 * stream.noWords;
+    const int* entries = (const int*)table.data();
+
+    // eight registers of 8 lanes, so the gathers of one step overlap
+    const unsigned int registers = RANS_WAYS / 8;
+    __m256i x[registers];
+    __m256i ctx[registers];
+    for (unsigned int r = 0; r < registers; r++) {
+        x[r] = _mm256_loadu_si256((const __m256i*)(stream.states + 8 * r));
+        ctx[r] = _mm256_setzero_si256();
+    }
+
+    for (size_t i = 0; i < stream.steps; i++) {
+        // gathers first, the refills chain through the word pointer
+        for (unsigned int r = 0; r < registers; r++) {
+            ctx[r] = decodeLanes(x[r], ctx[r], entries);
+        }
+        for (unsigned int r = 0; r < registers; r++) {
+            refillLanes(x[r], words);
+        }
+
+        // a valid stream never reads past its words, the padding covers the read-ahead
+        if (words > wordsEnd) {
+            return 0;
+        }
+
+        // pack the symbols to bytes in lane order, 32 per store
+        for (unsigned int r = 0; r < registers; r += 4) {
+            __m256i lo = _mm256_permute4x64_epi64(_mm256_packus_epi32(ctx[r], ctx[r + 1]), 0xd8);
+            __m256i hi = _mm256_permute4x64_epi64(_mm256_packus_epi32(ctx[r + 2], ctx[r + 3]), 0xd8);
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8);
+            _mm256_storeu_si256((__m256i*)(out + i * RANS_WAYS + 8 * r), packed);
+        }
+    }
+
+    symbols.resize(stream.count);
+    return stream.size;
+}
+
+size_t ransDecode(const unsigned char* data, size_t size, std::vector<unsigned char>& symbols) {
+    return avx2 ? ransDecodeAVX2(data, size, symbols) : ransDecodeScalar(data, size, symbols);
+}
+
+bool ransSIMD() {
+    return avx2;
+}
+
+#else
+
+size_t ransDecode(const unsigned char* data, size_t size, std::vector<unsigned char>& symbols) {
+    return ransDecodeScalar(data, size, symbols);
+}
+
+bool ransSIMD() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef RANS_H
+#define RANS_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+    interleaved rANS coder for replay streams
+    symbols are coded in RANS_WAYS lanes: lane k codes symbols k, k + RANS_WAYS, ...
+    and models each symbol on the previous symbol of its lane, with one frequency
+    table per context fitted to the stream and stored in its header
+    states are 32 bits and renormalize with 16-bit words, so a lane reads at most one
+    word per symbol and the lanes decode together in SIMD
+*/
+
+const unsigned int RANS_WAYS = 64;
+const unsigned int RANS_MAX_ALPHABET = 16;
+
+// compress _count_ symbols (each below _alphabet_) and append the stream to _out_
+void ransEncode(const unsigned char* symbols, size_t count, unsigned int alphabet, std::vector<unsigned char>& out);
+
+// symbols the stream at _data_ decodes to (from its header, so a caller can refuse
+// one before it is allocated), 0 if too short to tell
+size_t ransSymbolCount(const unsigned char* data, size_t size);
+
+// decompress the stream at _data_ into _symbols_
+// returns the bytes read, 0 if the stream is malformed
+size_t ransDecode(const unsigned char* data, size_t size, std::vector<unsigned char>& symbols);
+
+// same, without SIMD
+size_t ransDecodeScalar(const unsigned char* data, size_t size, std::vector<unsigned char>& symbols);
+
+// true if ransDecode runs on AVX2
+bool ransSIMD();
+
+#endif
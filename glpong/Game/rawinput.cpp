@@ -0,0 +1,305 @@
+#include "rawinput.h"
+#include "profiler.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+// timestamp fields of input_event (split on 32 bit with 64 bit time)
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+#endif
+
+double monotonicTime() {
+#ifdef __linux__
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#else
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void resetInput(RawInput& input) {
+    input.head.store(0);
+    input.tail.store(0);
+    input.noDevices = 0;
+    input.wake = -1;
+    input.replay = NULL;
+    input.record = NULL;
+    input.keys = 0;
+    input.running.store(false);
+    input.queued.store(0);
+    input.dropped.store(0);
+    memset(input.latency, 0, sizeof(input.latency));
+    input.latencyCount = 0;
+}
+
+/*
+    queue
+*/
+
+// producer side, drops the change if the simulation has fallen a whole queue behind
+// (later changes carry every held key, so the state recovers with the next one)
+static void pushInputEvent(RawInput& input, double time) {
+    unsigned int tail = input.tail.load(std::memory_order_relaxed);
+    if (tail - input.head.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) {
+        input.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    InputEvent& event = input.events[tail % INPUT_QUEUE_SIZE];
+    event.time = time;
+    event.queued = monotonicTime();
+    event.keys = input.keys;
+    input.tail.store(tail + 1, std::memory_order_release);
+    input.queued.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool popInputEvent(RawInput& input, double before, InputEvent& event) {
+    unsigned int head = input.head.load(std::memory_order_relaxed);
+    if (head == input.tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    const InputEvent& next = input.events[head % INPUT_QUEUE_SIZE];
+    if (next.time > before) {
+        return false;
+    }
+    event = next;
+    input.head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void recordInputLatency(RawInput& input, const InputEvent& event) {
+    double us = (monotonicTime() - event.time) * 1e6;
+    unsigned int bucket = 0;
+    while (bucket + 1 < INPUT_LATENCY_BUCKETS && us >= (double)(2ull << bucket)) {
+        bucket++;
+    }
+    input.latency[bucket]++;
+    input.latencyCount++;
+}
+
+double inputLatencyPercentile(const RawInput& input, double p) {
+    unsigned long long seen = 0;
+    for (unsigned int b = 0; b < INPUT_LATENCY_BUCKETS; b++) {
+        seen += input.latency[b];
+        if (seen && seen >= p * input.latencyCount) {
+            return (double)(2ull << b) * 1e-6;
+        }
+    }
+    return 0.0;
+}
+
+#ifdef __linux__
+
+/*
+    events
+*/
+
+// bit of a key the game reads, 0 for any other key
+static unsigned int keyBit(unsigned short code) {
+    switch (code) {
+    case KEY_W: return 1 << RAW_KEY_W;
+    case KEY_S: return 1 << RAW_KEY_S;
+    case KEY_A: return 1 << RAW_KEY_A;
+    case KEY_D: return 1 << RAW_KEY_D;
+    case KEY_UP: return 1 << RAW_KEY_UP;
+    case KEY_DOWN: return 1 << RAW_KEY_DOWN;
+    case KEY_LEFT: return 1 << RAW_KEY_LEFT;
+    case KEY_RIGHT: return 1 << RAW_KEY_RIGHT;
+    case KEY_P: return 1 << RAW_KEY_P;
+    case KEY_ESC: return 1 << RAW_KEY_ESCAPE;
+    default: return 0;
+    }
+}
+
+// apply one event stamped _time_, queueing a change to the held keys
+static void handleEvent(RawInput& input, const input_event& ev, double time) {
+    if (input.record) {
+        fwrite(&ev, sizeof(ev), 1, input.record);
+    }
+
+    // value 2 is autorepeat, which does not change what is held
+    unsigned int bit = ev.type == EV_KEY ? keyBit(ev.code) : 0;
+    if (!bit || ev.value == 2) {
+        return;
+    }
+    unsigned int keys = ev.value ? input.keys | bit : input.keys & ~bit;
+    if (keys != input.keys) {
+        input.keys = keys;
+        pushInputEvent(input, time);
+        traceInstant(TRACE_INPUT, "evdev keys", keys);
+    }
+}
+
+static void deviceLoop(RawInput& input) {
+    profilerThreadName("evdev");
+    pollfd fds[INPUT_MAX_DEVICES + 1];
+    for (unsigned int d = 0; d < input.noDevices; d++) {
+        fds[d] = { input.devices[d], POLLIN, 0 };
+    }
+    fds[input.noDevices] = { input.wake, POLLIN, 0 };
+
+    input_event evs[64];
+    for (;;) {
+        if (poll(fds, input.noDevices + 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[input.noDevices].revents) {
+            break;
+        }
+        for (unsigned int d = 0; d < input.noDevices; d++) {
+            if (!(fds[d].revents & POLLIN)) {
+                continue;
+            }
+            ssize_t n = read(fds[d].fd, evs, sizeof(evs));
+            for (ssize_t i = 0; i < n / (ssize_t)sizeof(input_event); i++) {
+                // the kernel stamps events on the monotonic clock (set with EVIOCSCLOCKID)
+                handleEvent(input, evs[i], evs[i].input_event_sec + evs[i].input_event_usec * 1e-6);
+            }
+        }
+    }
+    input.running.store(false);
+}
+
+static void replayLoop(RawInput& input) {
+    profilerThreadName("evdev replay");
+    // the recording's first event plays now, later ones at the same spacing
+    double start = monotonicTime();
+    double first = -1.0;
+    pollfd wake = { input.wake, POLLIN, 0 };
+
+    input_event ev;
+    while (fread(&ev, sizeof(ev), 1, input.replay) == 1) {
+        double recorded = ev.input_event_sec + ev.input_event_usec * 1e-6;
+        first = first < 0.0 ? recorded : first;
+        double due = start + (recorded - first);
+
+        // sleep until the event is due, waking early to stop
+        double wait = due - monotonicTime();
+        if (wait > 0.0) {
+            timespec timeout = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+            if (ppoll(&wake, 1, &timeout, NULL) > 0) {
+                break;
+            }
+        }
+
+        // stamped when it was due, as the kernel stamps the key press and not the read
+        handleEvent(input, ev, due);
+    }
+    input.running.store(false);
+}
+
+/*
+    start and stop
+*/
+
+bool startRawInput(RawInput& input, const char* recordPath) {
+    resetInput(input);
+
+    // every device that has the game's keys
+    for (unsigned int i = 0; i < 64 && input.noDevices < INPUT_MAX_DEVICES; i++) {
+        std::string path = "/dev/input/event" + std::to_string(i);
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        unsigned char keys[KEY_MAX / 8 + 1] = {};
+        bool keyboard = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0 &&
+            (keys[KEY_W / 8] & (1 << (KEY_W % 8))) && (keys[KEY_UP / 8] & (1 << (KEY_UP % 8)));
+        int clock = CLOCK_MONOTONIC;
+        if (!keyboard || ioctl(fd, EVIOCSCLOCKID, &clock) < 0) {
+            close(fd);
+            continue;
+        }
+        input.devices[input.noDevices++] = fd;
+    }
+    if (!input.noDevices) {
+        return false;
+    }
+
+    input.wake = eventfd(0, EFD_CLOEXEC);
+    input.record = recordPath ? fopen(recordPath, "wb") : NULL;
+    if (input.wake < 0 || (recordPath && !input.record)) {
+        stopRawInput(input);
+        return false;
+    }
+    input.running.store(true);
+    input.thread = std::thread(deviceLoop, std::ref(input));
+    return true;
+}
+
+bool startInputReplay(RawInput& input, const char* path) {
+    resetInput(input);
+    input.replay = fopen(path, "rb");
+    input.wake = eventfd(0, EFD_CLOEXEC);
+    if (!input.replay || input.wake < 0) {
+        stopRawInput(input);
+        return false;
+    }
+    input.running.store(true);
+    input.thread = std::thread(replayLoop, std::ref(input));
+    return true;
+}
+
+void stopRawInput(RawInput& input) {
+    if (input.thread.joinable()) {
+        // retry an interrupted write; EAGAIN means the counter is already full, so the
+        // eventfd is readable and the thread wakes all the same
+        unsigned long long one = 1;
+        ssize_t written;
+        do {
+            written = write(input.wake, &one, sizeof(one));
+        } while (written < 0 && errno == EINTR);
+        input.thread.join();
+    }
+    for (unsigned int d = 0; d < input.noDevices; d++) {
+        close(input.devices[d]);
+    }
+    input.noDevices = 0;
+    if (input.wake >= 0) {
+        close(input.wake);
+        input.wake = -1;
+    }
+    if (input.replay) {
+        fclose(input.replay);
+        input.replay = NULL;
+    }
+    if (input.record) {
+        fclose(input.record);
+        input.record = NULL;
+    }
+    input.running.store(false);
+}
+
+#else
+
+bool startRawInput(RawInput& input, const char* recordPath) {
+    resetInput(input);
+    return false;
+}
+
+bool startInputReplay(RawInput& input, const char* path) {
+    resetInput(input);
+    return false;
+}
+
+void stopRawInput(RawInput& input) {
+}
+
+#endif
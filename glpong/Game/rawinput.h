@@ -0,0 +1,91 @@
+#ifndef RAWINPUT_H
+#define RAWINPUT_H
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+/*
+    raw keyboard input from evdev (linux)
+    a thread reads /dev/input/event* as keys change, stamps each change with the
+    kernel's monotonic timestamp and queues the held keys for the simulation, so input
+    is no longer sampled once a frame when glfwPollEvents runs
+    the simulation takes queued changes at the start of a frame and splits its step at
+    each timestamp, so a key acts from the moment it was pressed
+    recorded event files (the raw input_event stream of a device, as written by
+    --evdev-record or read from the device node) replay through the same thread with
+    their original timing
+    on other platforms starting fails and the game keeps polling GLFW
+*/
+
+// keys the game reads
+enum RawKey {
+    RAW_KEY_W,
+    RAW_KEY_S,
+    RAW_KEY_A,
+    RAW_KEY_D,
+    RAW_KEY_UP,
+    RAW_KEY_DOWN,
+    RAW_KEY_LEFT,
+    RAW_KEY_RIGHT,
+    RAW_KEY_P,
+    RAW_KEY_ESCAPE,
+    RAW_KEY_COUNT
+};
+
+const unsigned int INPUT_QUEUE_SIZE = 256;
+const unsigned int INPUT_MAX_DEVICES = 16;
+const unsigned int INPUT_LATENCY_BUCKETS = 32;
+
+// keys held after one change
+struct InputEvent {
+    double time;            // seconds on the monotonic clock (monotonicTime)
+    double queued;          // when the thread queued it
+    unsigned int keys;      // bit per RawKey
+};
+
+struct RawInput {
+    // queue from the input thread to the simulation (one producer, one consumer)
+    InputEvent events[INPUT_QUEUE_SIZE];
+    std::atomic<unsigned int> head;     // next to read
+    std::atomic<unsigned int> tail;     // next to write
+
+    int devices[INPUT_MAX_DEVICES];
+    unsigned int noDevices;
+    int wake;               // eventfd that stops the thread
+    FILE* replay;           // recorded events instead of devices
+    FILE* record;           // copy of every key event read
+    unsigned int keys;      // thread only
+
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<unsigned long long> queued;
+    std::atomic<unsigned long long> dropped;    // queue was full
+
+    // event-to-simulation latency (consumer only), bucket b counts 2^b to 2^(b+1) us
+    unsigned long long latency[INPUT_LATENCY_BUCKETS];
+    unsigned long long latencyCount;
+};
+
+// seconds on the clock evdev timestamps use
+double monotonicTime();
+
+// read every keyboard in /dev/input, copying events to _recordPath_ if not NULL
+bool startRawInput(RawInput& input, const char* recordPath);
+
+// replay a recorded event file with its original timing
+bool startInputReplay(RawInput& input, const char* path);
+
+// stop the thread and close everything
+void stopRawInput(RawInput& input);
+
+// next queued change at or before _before_ (consumer only)
+bool popInputEvent(RawInput& input, double before, InputEvent& event);
+
+// count the time from an event's timestamp to now, when the simulation takes it
+void recordInputLatency(RawInput& input, const InputEvent& event);
+
+// latency in seconds below which fraction _p_ of events fall (upper bucket bound)
+double inputLatencyPercentile(const RawInput& input, double p);
+
+#endif
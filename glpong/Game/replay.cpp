@@ -0,0 +1,224 @@
+#include "replay.h"
+#include "rans.h"
+#include "statehash.h"
+
+/*
+    recording
+*/
+
+size_t replaySymbols(unsigned int matches, unsigned int ticks) {
+    // whole groups, the padding matches stay idle (in size_t, so no count wraps)
+    size_t groups = ((size_t)matches + RANS_WAYS - 1) / RANS_WAYS;
+    return groups * RANS_WAYS * ticks;
+}
+
+void initReplayCorpus(ReplayCorpus& corpus, unsigned int matches, unsigned int ticks) {
+    size_t size = replaySymbols(matches, ticks);
+
+    corpus.matches = matches;
+    corpus.ticks = ticks;
+    corpus.stateCRC = 0;
+    corpus.inputs.assign(size, REPLAY_INPUT_SYMBOLS / 2);
+    corpus.tilts.assign(size, REPLAY_INPUT_SYMBOLS / 2);
+    corpus.events.assign(size, 0);
+}
+
+size_t replayIndex(const ReplayCorpus& corpus, unsigned int m, unsigned int tick) {
+    return ((size_t)(m / RANS_WAYS) * corpus.ticks + tick) * RANS_WAYS + m % RANS_WAYS;
+}
+
+void recordTick(ReplayCorpus& corpus, const MatchBatch& batch, unsigned int tick) {
+    unsigned int n = corpus.matches < batch.count ? corpus.matches : batch.count;
+    for (unsigned int m = 0; m < n; m++) {
+        size_t idx = replayIndex(corpus, m, tick);
+        corpus.inputs[idx] = (unsigned char)((batch.input[0][m] + 1) * 3 + batch.input[1][m] + 1);
+        corpus.tilts[idx] = (unsigned char)((batch.tiltInput[0][m] + 1) * 3 + batch.tiltInput[1][m] + 1);
+        corpus.events[idx] = batch.events[m];
+    }
+    if (tick + 1 == corpus.ticks) {
+        corpus.stateCRC = snapshotCRC(batch);
+    }
+}
+
+bool verifyReplay(const ReplayCorpus& corpus, MatchBatch& batch, const SimParams& params, float dt) {
+    if (batch.count != corpus.matches) {
+        return false;
+    }
+    for (unsigned int t = 0; t < corpus.ticks; t++) {
+        for (unsigned int m = 0; m < corpus.matches; m++) {
+            size_t idx = replayIndex(corpus, m, t);
+            batch.input[0][m] = (signed char)(corpus.inputs[idx] / 3 - 1);
+            batch.input[1][m] = (signed char)(corpus.inputs[idx] % 3 - 1);
+            batch.tiltInput[0][m] = (signed char)(corpus.tilts[idx] / 3 - 1);
+            batch.tiltInput[1][m] = (signed char)(corpus.tilts[idx] % 3 - 1);
+        }
+        stepMatches(batch, params, dt);
+        for (unsigned int m = 0; m < corpus.matches; m++) {
+            if (batch.events[m] != corpus.events[replayIndex(corpus, m, t)]) {
+                return false;
+            }
+        }
+    }
+    return snapshotCRC(batch) == corpus.stateCRC;
+}
+
+/*
+    archives
+*/
+
+static void putU32(std::vector<unsigned char>& out, unsigned int v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((v >> (8 * i)) & 0xff);
+    }
+}
+
+static unsigned int getU32(const unsigned char* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int)data[3] << 24);
+}
+
+void writeArchive(const ReplayCorpus& corpus, std::vector<unsigned char>& out) {
+    size_t start = out.size();
+    putU32(out, corpus.matches);
+    putU32(out, corpus.ticks);
+    putU32(out, corpus.stateCRC);
+    ransEncode(corpus.inputs.data(), corpus.inputs.size(), REPLAY_INPUT_SYMBOLS, out);
+    ransEncode(corpus.tilts.data(), corpus.tilts.size(), REPLAY_INPUT_SYMBOLS, out);
+    ransEncode(corpus.events.data(), corpus.events.size(), REPLAY_EVENT_SYMBOLS, out);
+    putU32(out, crc32c(out.data() + start, out.size() - start));
+}
+
+bool readArchive(const unsigned char* data, size_t size, ReplayCorpus& corpus) {
+    // check the whole archive before decoding any of it
+    if (size < REPLAY_HEADER_BYTES + 4) {
+        return false;
+    }
+    size -= 4;
+    if (crc32c(data, size) != getU32(data + size)) {
+        return false;
+    }
+
+    // the CRC only catches damage, the counts are checked before anything is sized
+    unsigned int matches = getU32(data);
+    unsigned int ticks = getU32(data + 4);
+    size_t expected = replaySymbols(matches, ticks);
+    if (!matches || !ticks || ticks > REPLAY_MAX_SYMBOLS || expected > REPLAY_MAX_SYMBOLS) {
+        return false;
+    }
+    corpus.matches = matches;
+    corpus.ticks = ticks;
+    corpus.stateCRC = getU32(data + 8);
+
+    // the decoder sizes the streams
+    size_t pos = REPLAY_HEADER_BYTES;
+    std::vector<unsigned char>* streams[3] = { &corpus.inputs, &corpus.tilts, &corpus.events };
+    for (int s = 0; s < 3; s++) {
+        if (ransSymbolCount(data + pos, size - pos) != expected) {
+            return false;
+        }
+        size_t read = ransDecode(data + pos, size - pos, *streams[s]);
+        if (!read || streams[s]->size() != expected) {
+            return false;
+        }
+        pos += read;
+    }
+    return pos == size;
+}
+
+/*
+    varint baseline
+*/
+
+static void putVarint(std::vector<unsigned char>& out, unsigned int v) {
+    while (v >= 0x80) {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+static bool getVarint(const unsigned char* data, size_t size, size_t& pos, unsigned int& v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= size) {
+            return false;
+        }
+        unsigned char b = data[pos++];
+        v |= (unsigned int)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// runs of match _m_ in one stream
+static void putRuns(const ReplayCorpus& corpus, const unsigned char* symbols, unsigned int m, std::vector<unsigned char>& out) {
+    unsigned int t = 0;
+    while (t < corpus.ticks) {
+        unsigned char symbol = symbols[replayIndex(corpus, m, t)];
+        unsigned int run = 1;
+        while (t + run < corpus.ticks && symbols[replayIndex(corpus, m, t + run)] == symbol) {
+            run++;
+        }
+        putVarint(out, symbol);
+        putVarint(out, run);
+        t += run;
+    }
+}
+
+void writeVarintArchive(const ReplayCorpus& corpus, std::vector<unsigned char>& out) {
+    putVarint(out, corpus.matches);
+    putVarint(out, corpus.ticks);
+
+    const std::vector<unsigned char>* streams[3] = { &corpus.inputs, &corpus.tilts, &corpus.events };
+    for (int s = 0; s < 3; s++) {
+        for (unsigned int m = 0; m < corpus.matches; m++) {
+            putRuns(corpus, streams[s]->data(), m, out);
+        }
+    }
+}
+
+void writeMatchReplay(const ReplayCorpus& corpus, unsigned int m, std::vector<unsigned char>& out) {
+    putVarint(out, 1);
+    putVarint(out, corpus.ticks);
+
+    const std::vector<unsigned char>* streams[3] = { &corpus.inputs, &corpus.tilts, &corpus.events };
+    for (int s = 0; s < 3; s++) {
+        putRuns(corpus, streams[s]->data(), m, out);
+    }
+}
+
+bool readVarintArchive(const unsigned char* data, size_t size, ReplayCorpus& corpus) {
+    size_t pos = 0;
+    unsigned int matches, ticks;
+    if (!getVarint(data, size, pos, matches) || !getVarint(data, size, pos, ticks)) {
+        return false;
+    }
+
+    // every match has at least one run (two bytes) per stream, and the streams are
+    // capped, so a crafted header is refused before the corpus is sized
+    if (!matches || !ticks || (size_t)matches * 3 * 2 > size - pos || ticks > REPLAY_MAX_SYMBOLS ||
+        replaySymbols(matches, ticks) > REPLAY_MAX_SYMBOLS) {
+        return false;
+    }
+    initReplayCorpus(corpus, matches, ticks);
+
+    std::vector<unsigned char>* streams[3] = { &corpus.inputs, &corpus.tilts, &corpus.events };
+    for (int s = 0; s < 3; s++) {
+        unsigned char* symbols = streams[s]->data();
+        for (unsigned int m = 0; m < matches; m++) {
+            unsigned int t = 0;
+            while (t < ticks) {
+                unsigned int symbol, run;
+                if (!getVarint(data, size, pos, symbol) || !getVarint(data, size, pos, run) ||
+                    !run || run > ticks - t) {
+                    return false;
+                }
+                for (unsigned int end = t + run; t < end; t++) {
+                    symbols[replayIndex(corpus, m, t)] = (unsigned char)symbol;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstddef>
+#include <vector>
+
+#include "sim.h"
+
+/*
+    replay recording
+    one symbol per match per tick for the inputs, tilt inputs and events of a batch;
+    matches are stored in groups of RANS_WAYS with their ticks interleaved, so each
+    lane of the rANS coder follows one match
+*/
+
+// symbols in each stream
+const unsigned int REPLAY_INPUT_SYMBOLS = 9;    // (left + 1) * 3 + (right + 1)
+const unsigned int REPLAY_EVENT_SYMBOLS = 16;   // EVENT_* bits
+
+struct ReplayCorpus {
+    unsigned int matches;
+    unsigned int ticks;
+    unsigned int stateCRC;  // snapshotCRC of the batch after the last tick
+    std::vector<unsigned char> inputs;
+    std::vector<unsigned char> tilts;
+    std::vector<unsigned char> events;
+};
+
+// most symbols per stream an archive may hold (1 GB), so a crafted header cannot make
+// the readers allocate without bound
+const size_t REPLAY_MAX_SYMBOLS = (size_t)1 << 30;
+
+// symbols per stream of _ticks_ ticks of _matches_ matches (whole groups of RANS_WAYS)
+size_t replaySymbols(unsigned int matches, unsigned int ticks);
+
+// make room for _ticks_ ticks of _matches_ matches
+void initReplayCorpus(ReplayCorpus& corpus, unsigned int matches, unsigned int ticks);
+
+// position of match _m_ at _tick_ in each stream
+size_t replayIndex(const ReplayCorpus& corpus, unsigned int m, unsigned int tick);
+
+// record the inputs and events of the last step of every match
+// (and the batch's snapshotCRC after the last tick)
+void recordTick(ReplayCorpus& corpus, const MatchBatch& batch, unsigned int tick);
+
+// play the recorded inputs back with stepMatches on _batch_ (the corpus's matches, as
+// they were before the first tick) and check the events of every tick and the
+// snapshotCRC at the end, false at the first difference
+bool verifyReplay(const ReplayCorpus& corpus, MatchBatch& batch, const SimParams& params, float dt);
+
+/*
+    archives
+    a header (matches, ticks, state CRC), then each stream compressed on its own in the
+    order inputs, tilts, events, then the CRC32C of everything before it
+*/
+
+const size_t REPLAY_HEADER_BYTES = 12;
+
+// compress a corpus with the rANS coder
+void writeArchive(const ReplayCorpus& corpus, std::vector<unsigned char>& out);
+
+// decompress an archive written by writeArchive, false if malformed or corrupt
+bool readArchive(const unsigned char* data, size_t size, ReplayCorpus& corpus);
+
+// baseline: each match's ticks in order, runs of equal symbols as (symbol, length) varint pairs
+void writeVarintArchive(const ReplayCorpus& corpus, std::vector<unsigned char>& out);
+bool readVarintArchive(const unsigned char* data, size_t size, ReplayCorpus& corpus);
+
+// replay of match _m_ alone in the baseline format (a one-match archive)
+// matches that play alike give byte-identical prefixes, which the chunk store shares
+void writeMatchReplay(const ReplayCorpus& corpus, unsigned int m, std::vector<unsigned char>& out);
+
+#endif
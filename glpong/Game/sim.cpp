@@ -0,0 +1,734 @@
+#include "sim.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIM_SSE2
+#endif
+
+// alignment of each array in a batch (one cache line)
+const size_t arrayAlignment = 64;
+
+SimParams defaultSimParams(float width, float height) {
+    SimParams params;
+    params.width = width;
+    params.height = height;
+    params.paddleSpeed = 175.0f;
+    params.paddleHeight = 100.0f;
+    params.paddleWidth = 10.0f;
+    params.paddleInset = 35.0f;
+    params.ballRadius = 8.0f;
+    params.initBallVelocity = { 150.0f, 150.0f };
+    params.framesThreshold = 10;
+    params.rotatedPaddles = false;
+    params.tiltSpeed = 2.0f;
+    params.maxTilt = 0.6f;
+    params.spinTransfer = 0.5f;
+    params.magnus = 0.04f;
+    params.spinDamping = 0.3f;
+    params.wallGrip = 0.3f;
+    params.maxSubsteps = 8;
+    params.maxSubstepDistance = params.ballRadius;
+    params.maxSubstepTurn = 0.05f;
+    params.compactContacts = true;
+    return params;
+}
+
+/*
+    batch memory
+*/
+
+// size of one array rounded up to the alignment
+template<typename T>
+size_t arraySize(unsigned int count) {
+    return (count * sizeof(T) + arrayAlignment - 1) & ~(arrayAlignment - 1);
+}
+
+// take the next array out of the block
+template<typename T>
+void carveArray(T*& arr, char*& cursor, unsigned int count) {
+    arr = (T*)cursor;
+    cursor += arraySize<T>(count);
+}
+
+bool allocMatchBatch(MatchBatch& batch, unsigned int count, unsigned int allocFlags) {
+    size_t size =
+        5 * arraySize<float>(count) +           // ball
+        6 * arraySize<float>(count) +           // paddle positions, velocities and angles
+        4 * arraySize<signed char>(count) +     // inputs
+        3 * arraySize<unsigned int>(count) +    // scores and collision counter
+        2 * arraySize<unsigned char>(count) +   // events and substeps
+        arraySize<unsigned int>(count + 3);     // scratch index list
+
+    if (!allocLarge(batch.block, size, allocFlags, MEMORY_SIM)) {
+        batch.count = 0;
+        return false;
+    }
+    batch.count = count;
+
+    char* cursor = (char*)batch.block.ptr;
+    carveArray(batch.ballX, cursor, count);
+    carveArray(batch.ballY, cursor, count);
+    carveArray(batch.ballVX, cursor, count);
+    carveArray(batch.ballVY, cursor, count);
+    carveArray(batch.ballSpin, cursor, count);
+    for (int i = 0; i < 2; i++) {
+        carveArray(batch.paddleY[i], cursor, count);
+        carveArray(batch.paddleV[i], cursor, count);
+        carveArray(batch.input[i], cursor, count);
+        carveArray(batch.paddleAngle[i], cursor, count);
+        carveArray(batch.tiltInput[i], cursor, count);
+        carveArray(batch.score[i], cursor, count);
+    }
+    carveArray(batch.framesSinceLastCollision, cursor, count);
+    carveArray(batch.events, cursor, count);
+    carveArray(batch.substeps, cursor, count);
+    carveArray(batch.scratch, cursor, count + 3);
+    batch.contacts = 0;
+
+    return true;
+}
+
+void freeMatchBatch(MatchBatch& batch) {
+    freeLarge(batch.block);
+    batch.count = 0;
+}
+
+void resetMatch(MatchBatch& batch, const SimParams& params, unsigned int m) {
+    batch.ballX[m] = params.width / 2.0f;
+    batch.ballY[m] = params.height / 2.0f;
+    batch.ballVX[m] = params.initBallVelocity.x;
+    batch.ballVY[m] = params.initBallVelocity.y;
+    batch.ballSpin[m] = 0.0f;
+
+    for (int i = 0; i < 2; i++) {
+        batch.paddleY[i][m] = params.height / 2.0f;
+        batch.paddleV[i][m] = 0.0f;
+        batch.input[i][m] = 0;
+        batch.paddleAngle[i][m] = 0.0f;
+        batch.tiltInput[i][m] = 0;
+        batch.score[i][m] = 0;
+    }
+
+    batch.framesSinceLastCollision[m] = -1;
+    batch.events[m] = 0;
+    batch.substeps[m] = 1;
+}
+
+void botInputs(MatchBatch& batch, const SimParams& params) {
+    // dead zone so the paddle does not jitter around the ball
+    float deadZone = params.paddleHeight / 4.0f;
+
+    for (unsigned int m = 0; m < batch.count; m++) {
+        for (int i = 0; i < 2; i++) {
+            float diff = batch.ballY[m] - batch.paddleY[i][m];
+            batch.input[i][m] = diff > deadZone ? 1 : (diff < -deadZone ? -1 : 0);
+        }
+    }
+}
+
+/*
+    physics
+*/
+
+// cosine and sine of a small angle (paddle tilt, per-substep spin turn)
+// polynomials instead of library calls so the batch loops vectorize,
+// error stays below 1e-5 up to 0.8 radians
+inline float smallCos(float a) {
+    float a2 = a * a;
+    return 1.0f + a2 * (-1.0f / 2.0f + a2 * (1.0f / 24.0f + a2 * (-1.0f / 720.0f)));
+}
+
+inline float smallSin(float a) {
+    float a2 = a * a;
+    return a * (1.0f + a2 * (-1.0f / 6.0f + a2 * (1.0f / 120.0f + a2 * (-1.0f / 5040.0f))));
+}
+
+// clear events and count frames since the last paddle collision
+static void beginTick(MatchBatch& batch) {
+    for (unsigned int m = 0; m < batch.count; m++) {
+        batch.events[m] = 0;
+
+        unsigned int& framesSinceLastCollision = batch.framesSinceLastCollision[m];
+        if (framesSinceLastCollision != (unsigned int)-1) {
+            framesSinceLastCollision++;
+        }
+    }
+}
+
+// turn paddle inputs into velocities and clamp paddles to the field
+static void stepPaddles(MatchBatch& batch, const SimParams& params) {
+    float paddleBoundary = params.paddleHeight / 2.0f + params.ballRadius;
+
+    for (unsigned int m = 0; m < batch.count; m++) {
+        for (int i = 0; i < 2; i++) {
+            float& y = batch.paddleY[i][m];
+            float& v = batch.paddleV[i][m];
+            v = 0.0f;
+
+            if (batch.input[i][m] > 0) {
+                // boundary condition
+                if (y < params.height - paddleBoundary) {
+                    v = params.paddleSpeed;
+                }
+                else {
+                    y = params.height - paddleBoundary;
+                }
+            }
+            else if (batch.input[i][m] < 0) {
+                if (y > paddleBoundary) {
+                    v = -params.paddleSpeed;
+                }
+                else {
+                    y = paddleBoundary;
+                }
+            }
+        }
+    }
+}
+
+/*
+    substeps
+    a match takes enough substeps that its ball moves at most maxSubstepDistance and turns
+    at most maxSubstepTurn radians per substep, so slow balls take one step
+*/
+static unsigned int chooseSubsteps(const SimParams& params, unsigned int count, float dt,
+    const float* __restrict ballVXs, const float* __restrict ballVYs,
+    const float* __restrict spins, unsigned char* __restrict substeps) {
+    float travelScale = dt / params.maxSubstepDistance;
+    float turnScale = std::abs(params.magnus) * dt / params.maxSubstepTurn;
+    float maxSubsteps = (float)params.maxSubsteps;
+    unsigned int multiStep = 0;
+
+    for (unsigned int m = 0; m < count; m++) {
+        float vx = ballVXs[m];
+        float vy = ballVYs[m];
+        float travel = std::sqrt(vx * vx + vy * vy) * travelScale;
+        float turn = std::abs(spins[m]) * turnScale;
+        float n = std::min(std::max(std::ceil(std::max(travel, turn)), 1.0f), maxSubsteps);
+        substeps[m] = (unsigned char)n;
+        multiStep += n > 1.0f ? 1 : 0;
+    }
+
+    return multiStep;
+}
+
+/*
+    wall collisions
+*/
+
+// floor, ceiling and goal collisions for match _m_
+static inline void collideWallsMatch(MatchBatch& batch, const SimParams& params, unsigned int m) {
+    float ballRadius = params.ballRadius;
+    float& ballX = batch.ballX[m];
+    float& ballY = batch.ballY[m];
+    float& ballVX = batch.ballVX[m];
+    float& spin = batch.ballSpin[m];
+
+    bool onFloor = ballY - ballRadius <= 0;
+    if (onFloor || ballY + ballRadius >= params.height) {
+        // collision with floor or ceiling
+        batch.ballVY[m] *= -1;
+        batch.events[m] |= EVENT_WALL;
+
+        // friction removes part of the slip at the contact point, trading it
+        // between horizontal speed (2/7) and spin (5/7) like a solid ball
+        float side = onFloor ? 1.0f : -1.0f;
+        float slip = ballVX + side * spin * ballRadius;
+        float dv = -params.wallGrip * (2.0f / 7.0f) * slip;
+        ballVX += dv;
+        spin += side * 2.5f * dv / ballRadius;
+    }
+
+    unsigned char reset = 0;
+    if (ballX - ballRadius <= 0) {
+        // collision with left wall
+        batch.score[1][m]++;
+        reset = 1;
+        batch.events[m] |= EVENT_SCORE_RIGHT;
+    }
+    else if (ballX + ballRadius >= params.width) {
+        // collision with right wall
+        batch.score[0][m]++;
+        reset = 2;
+        batch.events[m] |= EVENT_SCORE_LEFT;
+    }
+
+    if (reset) {
+        // put ball in middle
+        ballX = params.width / 2.0f;
+        ballY = params.height / 2.0f;
+
+        // reset velocity to initial
+        ballVX = reset == 1 ? params.initBallVelocity.x : -params.initBallVelocity.x; // go to player that just scores
+        batch.ballVY[m] = params.initBallVelocity.y;
+        spin = 0.0f;
+    }
+}
+
+static void collideWalls(MatchBatch& batch, const SimParams& params) {
+    for (unsigned int m = 0; m < batch.count; m++) {
+        collideWallsMatch(batch, params, m);
+    }
+}
+
+/*
+    paddle collisions against axis-aligned paddles
+*/
+
+// paddle collision for match _m_
+static inline void collidePaddleAABB(MatchBatch& batch, const SimParams& params, unsigned int m) {
+    float halfPaddleHeight = params.paddleHeight / 2.0f;
+    float halfPaddleWidth = params.paddleWidth / 2.0f;
+    float ballRadius = params.ballRadius;
+
+    // do only if it has been a certain amount of frames since the last collision
+    unsigned int& framesSinceLastCollision = batch.framesSinceLastCollision[m];
+    if (framesSinceLastCollision < params.framesThreshold && framesSinceLastCollision != (unsigned int)-1) {
+        return;
+    }
+
+    float& ballX = batch.ballX[m];
+    float& ballY = batch.ballY[m];
+    float& ballVX = batch.ballVX[m];
+    float& ballVY = batch.ballVY[m];
+
+    int i = 0;
+    if (ballX > params.width / 2.0f) {
+        // if ball on right side, check with right paddle
+        i++;
+    }
+    float padX = paddleX(params, i);
+    float padY = batch.paddleY[i][m];
+
+    // get distance from center of ball to center of paddle
+    vec2 distance = { std::abs(ballX - padX), std::abs(ballY - padY) };
+
+    // check if no collision possible
+    if (distance.x > halfPaddleWidth + ballRadius ||
+        distance.y > halfPaddleHeight + ballRadius) {
+        return;
+    }
+
+    bool collision = false;
+    if (distance.x <= halfPaddleWidth && distance.x >= (halfPaddleWidth - ballRadius)) {
+        // length collision
+        collision = true;
+        ballVX *= -1;
+    }
+    else if (distance.y <= halfPaddleHeight && distance.y >= (halfPaddleHeight - ballRadius)) {
+        // width collision
+        collision = true;
+        ballVY *= -1;
+    }
+
+    if ((distance.x - halfPaddleWidth) * (distance.x - halfPaddleWidth) +
+        (distance.y - halfPaddleHeight) * (distance.y - halfPaddleHeight)
+        <= (ballRadius * ballRadius) &&
+        !collision) {
+        // squared distance is less than radius squared
+        // so distance is less than radius
+        collision = true;
+        float signedDifference = padX - ballX;
+        if (i == 0) {
+            // if checking the right paddle, want to reverse difference
+            // because want to the left of the paddle to be positive
+            signedDifference *= -1;
+        }
+
+        if ((distance.y - halfPaddleHeight) <= (signedDifference - halfPaddleWidth)) {
+            // if closer to length, treat as length collision
+            // use signed difference because don't want collision with back side of paddle
+            ballVX *= -1;
+        }
+        else {
+            // treat as width collision
+            ballVY *= -1;
+        }
+    }
+
+    if (collision) {
+        // add to y velocity
+        float k = 0.5f;
+        ballVX *= 1.1f;
+        ballVY += k * batch.paddleV[i][m];
+
+        // paddle motion drags the contact side of the ball, spinning it
+        float faceNormalX = i == 0 ? 1.0f : -1.0f;
+        batch.ballSpin[m] -= params.spinTransfer * faceNormalX * batch.paddleV[i][m] / ballRadius;
+
+        // reset frames counter
+        framesSinceLastCollision = 0;
+        batch.events[m] |= EVENT_PADDLE;
+    }
+}
+
+static void collidePaddlesAABB(MatchBatch& batch, const SimParams& params) {
+    for (unsigned int m = 0; m < batch.count; m++) {
+        collidePaddleAABB(batch, params, m);
+    }
+}
+
+/*
+    paddle collisions against rotated paddles (oriented boxes)
+    separating axis test between the ball and the paddle: the box axes plus the axis
+    through the box point closest to the ball center, which is found by clamping
+    the ball center in the paddle's frame
+    written without branches so the loop vectorizes across the batch, and over raw
+    arrays so __restrict can promise the compiler they never overlap
+    the sim is built with strict floating point (/fp:precise, no FMA contraction) so
+    matches and their state hashes agree across machines; GCC and Clang need
+    -fno-trapping-math -fno-math-errno to vectorize the selects, which change no
+    results, but never -ffast-math, and -ffp-contract=off when targeting FMA
+*/
+
+static void collidePaddlesOBB(const SimParams& params, unsigned int count,
+    float* __restrict ballXs, float* __restrict ballYs,
+    float* __restrict ballVXs, float* __restrict ballVYs, float* __restrict spins,
+    const float* __restrict leftYs, const float* __restrict rightYs,
+    const float* __restrict leftVs, const float* __restrict rightVs,
+    const float* __restrict leftAngles, const float* __restrict rightAngles,
+    unsigned int* __restrict frames, unsigned char* __restrict events) {
+    float halfPaddleHeight = params.paddleHeight / 2.0f;
+    float halfPaddleWidth = params.paddleWidth / 2.0f;
+    float ballRadius = params.ballRadius;
+    float sideSplit = params.width / 2.0f;
+    float leftX = paddleX(params, 0);
+    float rightX = paddleX(params, 1);
+    unsigned int framesThreshold = params.framesThreshold;
+    float spinTransfer = params.spinTransfer;
+
+    for (unsigned int m = 0; m < count; m++) {
+        float ballX = ballXs[m];
+        float ballY = ballYs[m];
+        float ballVX = ballVXs[m];
+        float ballVY = ballVYs[m];
+
+        // select paddle on the ball's side
+        // blend rather than branch so both loads stay unconditional
+        float side = ballX > sideSplit ? 1.0f : 0.0f;
+        float padX = leftX + side * (rightX - leftX);
+        float padY = leftYs[m] + side * (rightYs[m] - leftYs[m]);
+        float padV = leftVs[m] + side * (rightVs[m] - leftVs[m]);
+        float angle = leftAngles[m] + side * (rightAngles[m] - leftAngles[m]);
+        float c = smallCos(angle);
+        float s = smallSin(angle);
+
+        // ball center in the paddle's frame
+        float dx = ballX - padX;
+        float dy = ballY - padY;
+        float localX = dx * c + dy * s;
+        float localY = -dx * s + dy * c;
+
+        // closest point on the paddle
+        float closestX = std::min(std::max(localX, -halfPaddleWidth), halfPaddleWidth);
+        float closestY = std::min(std::max(localY, -halfPaddleHeight), halfPaddleHeight);
+        float sepX = localX - closestX;
+        float sepY = localY - closestY;
+        float dist2 = sepX * sepX + sepY * sepY;
+        float dist = std::sqrt(dist2);
+
+        // outside: normal along the separating axis
+        float invDist = 1.0f / std::max(dist, 1e-6f);
+        float normalX = sepX * invDist;
+        float normalY = sepY * invDist;
+        float depth = ballRadius - dist;
+
+        // center inside: push out through the face with least penetration
+        bool inside = dist2 <= 1e-12f;
+        float penX = halfPaddleWidth - std::abs(localX);
+        float penY = halfPaddleHeight - std::abs(localY);
+        bool xFace = penX < penY;
+        float faceNX = xFace ? (localX < 0.0f ? -1.0f : 1.0f) : 0.0f;
+        float faceNY = xFace ? 0.0f : (localY < 0.0f ? -1.0f : 1.0f);
+        float insideBlend = inside ? 1.0f : 0.0f;
+        normalX += insideBlend * (faceNX - normalX);
+        normalY += insideBlend * (faceNY - normalY);
+        depth += insideBlend * (ballRadius + std::min(penX, penY) - depth);
+
+        // contact normal in world space
+        float worldNX = normalX * c - normalY * s;
+        float worldNY = normalX * s + normalY * c;
+
+        // only bounce when overlapping, moving into the paddle and off cooldown
+        unsigned int framesSinceLastCollision = frames[m];
+        bool ready = (framesSinceLastCollision >= framesThreshold) | (framesSinceLastCollision == (unsigned int)-1);
+        float vn = ballVX * worldNX + ballVY * worldNY;
+        bool hit = ready & (dist2 <= ballRadius * ballRadius) & (vn < 0.0f);
+
+        // reflect about the contact normal, then speed up and add paddle velocity
+        float k = 0.5f;
+        float bouncedVX = (ballVX - 2.0f * vn * worldNX) * 1.1f;
+        float bouncedVY = ballVY - 2.0f * vn * worldNY + k * padV;
+
+        // paddle motion drags the contact side of the ball, spinning it
+        float spinKick = -spinTransfer * worldNX * padV / ballRadius;
+
+        // blend the results in for the same reason
+        float blend = hit ? 1.0f : 0.0f;
+        ballVXs[m] = ballVX + blend * (bouncedVX - ballVX);
+        ballVYs[m] = ballVY + blend * (bouncedVY - ballVY);
+        ballXs[m] = ballX + blend * worldNX * depth;
+        ballYs[m] = ballY + blend * worldNY * depth;
+        spins[m] += blend * spinKick;
+        frames[m] = hit ? 0 : framesSinceLastCollision;
+        events[m] |= hit ? EVENT_PADDLE : 0;
+    }
+}
+
+// paddle collision for match _m_ in either paddle mode
+static inline void collidePaddle(MatchBatch& batch, const SimParams& params, unsigned int m) {
+    if (params.rotatedPaddles) {
+        // batch of one starting at match _m_
+        collidePaddlesOBB(params, 1,
+            batch.ballX + m, batch.ballY + m, batch.ballVX + m, batch.ballVY + m, batch.ballSpin + m,
+            batch.paddleY[0] + m, batch.paddleY[1] + m, batch.paddleV[0] + m, batch.paddleV[1] + m,
+            batch.paddleAngle[0] + m, batch.paddleAngle[1] + m,
+            batch.framesSinceLastCollision + m, batch.events + m);
+    }
+    else {
+        collidePaddleAABB(batch, params, m);
+    }
+}
+
+/*
+    contact candidates
+    a match needs collision tests only if its ball overlaps the band along a wall or the
+    box around the paddle on its side, the same bounds the collision tests exit early on
+    (rotated paddles use the box around the paddle at any tilt up to maxTilt)
+    the list is compressed 4 matches at a time: each lane's index is m + lane, so a table
+    of the set lanes for every 4-bit mask gives the indices to store, and the unused tail
+    of the store is overwritten by the next group
+*/
+
+#ifdef SIM_SSE2
+// lanes set in each 4-bit mask, packed to the front
+alignas(16) static const int compressLanes[16][4] = {
+    { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 0, 1, 0, 0 },
+    { 2, 0, 0, 0 }, { 0, 2, 0, 0 }, { 1, 2, 0, 0 }, { 0, 1, 2, 0 },
+    { 3, 0, 0, 0 }, { 0, 3, 0, 0 }, { 1, 3, 0, 0 }, { 0, 1, 3, 0 },
+    { 2, 3, 0, 0 }, { 0, 2, 3, 0 }, { 1, 2, 3, 0 }, { 0, 1, 2, 3 }
+};
+static const unsigned char compressCount[16] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+};
+#endif
+
+// write the indices of matches near a contact to _candidates_ and return how many
+static unsigned int findContacts(const SimParams& params, unsigned int count,
+    const float* __restrict ballXs, const float* __restrict ballYs,
+    const float* __restrict leftYs, const float* __restrict rightYs,
+    unsigned int* __restrict candidates) {
+    float ballRadius = params.ballRadius;
+    float halfPaddleWidth = params.paddleWidth / 2.0f;
+    float halfPaddleHeight = params.paddleHeight / 2.0f;
+    float reachX = halfPaddleWidth + ballRadius;
+    float reachY = halfPaddleHeight + ballRadius;
+    if (params.rotatedPaddles) {
+        // extent of the paddle tilted up to maxTilt, capped by its bounding circle
+        float boundingRadius = std::sqrt(halfPaddleWidth * halfPaddleWidth + halfPaddleHeight * halfPaddleHeight);
+        float sinTilt = std::sin(std::min(std::abs(params.maxTilt), 1.5707964f));
+        float extentX = std::min(halfPaddleWidth + halfPaddleHeight * sinTilt, boundingRadius);
+        float extentY = std::min(halfPaddleHeight + halfPaddleWidth * sinTilt, boundingRadius);
+
+        // slack covers the error of the polynomial rotation in the collision test
+        reachX = (extentX + ballRadius) * 1.001f;
+        reachY = (extentY + ballRadius) * 1.001f;
+    }
+    float width = params.width;
+    float height = params.height;
+    float sideSplit = params.width / 2.0f;
+    float leftX = paddleX(params, 0);
+    float rightX = paddleX(params, 1);
+
+    unsigned int n = 0;
+    unsigned int m = 0;
+
+#ifdef SIM_SSE2
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 vRadius = _mm_set1_ps(ballRadius);
+    const __m128 vWidth = _mm_set1_ps(width);
+    const __m128 vHeight = _mm_set1_ps(height);
+    const __m128 vSideSplit = _mm_set1_ps(sideSplit);
+    const __m128 vLeftX = _mm_set1_ps(leftX);
+    const __m128 vRightX = _mm_set1_ps(rightX);
+    const __m128 vReachX = _mm_set1_ps(reachX);
+    const __m128 vReachY = _mm_set1_ps(reachY);
+
+    for (; m + 4 <= count; m += 4) {
+        __m128 x = _mm_loadu_ps(ballXs + m);
+        __m128 y = _mm_loadu_ps(ballYs + m);
+
+        // walls
+        __m128 near = _mm_or_ps(
+            _mm_or_ps(_mm_cmple_ps(x, vRadius), _mm_cmpge_ps(_mm_add_ps(x, vRadius), vWidth)),
+            _mm_or_ps(_mm_cmple_ps(y, vRadius), _mm_cmpge_ps(_mm_add_ps(y, vRadius), vHeight)));
+
+        // paddle on the ball's side
+        __m128 right = _mm_cmpgt_ps(x, vSideSplit);
+        __m128 padX = _mm_or_ps(_mm_and_ps(right, vRightX), _mm_andnot_ps(right, vLeftX));
+        __m128 padY = _mm_or_ps(_mm_and_ps(right, _mm_loadu_ps(rightYs + m)),
+            _mm_andnot_ps(right, _mm_loadu_ps(leftYs + m)));
+        __m128 dx = _mm_and_ps(_mm_sub_ps(x, padX), absMask);
+        __m128 dy = _mm_and_ps(_mm_sub_ps(y, padY), absMask);
+        near = _mm_or_ps(near, _mm_and_ps(_mm_cmple_ps(dx, vReachX), _mm_cmple_ps(dy, vReachY)));
+
+        // compress
+        int mask = _mm_movemask_ps(near);
+        __m128i lanes = _mm_load_si128((const __m128i*)compressLanes[mask]);
+        _mm_storeu_si128((__m128i*)(candidates + n), _mm_add_epi32(lanes, _mm_set1_epi32((int)m)));
+        n += compressCount[mask];
+    }
+#endif
+
+    for (; m < count; m++) {
+        float x = ballXs[m];
+        float y = ballYs[m];
+        float padX = x > sideSplit ? rightX : leftX;
+        float padY = x > sideSplit ? rightYs[m] : leftYs[m];
+        bool near = x <= ballRadius || x + ballRadius >= width ||
+            y <= ballRadius || y + ballRadius >= height ||
+            (std::abs(x - padX) <= reachX && std::abs(y - padY) <= reachY);
+
+        candidates[n] = m;
+        n += near ? 1 : 0;
+    }
+
+    return n;
+}
+
+/*
+    integration
+*/
+
+// spin left after a substep for each substep count: exact exponential decay,
+// so the spin after a tick does not depend on how it was split
+static void spinDecays(const SimParams& params, float dt, float* decays) {
+    unsigned int maxSubsteps = std::min(std::max(params.maxSubsteps, 1u), 255u);
+    for (unsigned int n = 1; n <= maxSubsteps; n++) {
+        float h = dt / n;
+        decays[n] = std::exp(-params.spinDamping * h);
+    }
+}
+
+// advance balls by one of their substeps
+// magnus force is perpendicular to the velocity, so spin turns the velocity
+static void moveBalls(const SimParams& params, unsigned int count, float dt,
+    float* __restrict ballXs, float* __restrict ballYs,
+    float* __restrict ballVXs, float* __restrict ballVYs,
+    float* __restrict spins, const unsigned char* __restrict substeps,
+    const float* __restrict decays) {
+    float magnus = params.magnus;
+
+    for (unsigned int m = 0; m < count; m++) {
+        float h = dt / substeps[m];
+        float spin = spins[m];
+        float vx = ballVXs[m];
+        float vy = ballVYs[m];
+
+        float turn = magnus * spin * h;
+        float c = smallCos(turn);
+        float s = smallSin(turn);
+        float turnedVX = c * vx - s * vy;
+        float turnedVY = s * vx + c * vy;
+
+        ballVXs[m] = turnedVX;
+        ballVYs[m] = turnedVY;
+        ballXs[m] += turnedVX * h;
+        ballYs[m] += turnedVY * h;
+        spins[m] = spin * decays[substeps[m]];
+    }
+}
+
+// move and tilt paddles
+static void movePaddles(MatchBatch& batch, const SimParams& params, float dt) {
+    for (int i = 0; i < 2; i++) {
+        float* y = batch.paddleY[i];
+        float* v = batch.paddleV[i];
+        for (unsigned int m = 0; m < batch.count; m++) {
+            y[m] += v[m] * dt;
+        }
+    }
+
+    if (params.rotatedPaddles) {
+        // tilt paddles within the allowed range
+        float tiltStep = params.tiltSpeed * dt;
+        for (int i = 0; i < 2; i++) {
+            float* angle = batch.paddleAngle[i];
+            signed char* tilt = batch.tiltInput[i];
+            for (unsigned int m = 0; m < batch.count; m++) {
+                float a = angle[m] + tilt[m] * tiltStep;
+                angle[m] = std::min(std::max(a, -params.maxTilt), params.maxTilt);
+            }
+        }
+    }
+}
+
+void stepMatches(MatchBatch& batch, const SimParams& params, float dt) {
+    beginTick(batch);
+    stepPaddles(batch, params);
+    unsigned int multiStep = chooseSubsteps(params, batch.count, dt,
+        batch.ballVX, batch.ballVY, batch.ballSpin, batch.substeps);
+    float decays[256];
+    spinDecays(params, dt, decays);
+
+    // first substep of every match
+    if (params.compactContacts) {
+        // collision tests only for matches near a contact
+        unsigned int* candidates = batch.scratch;
+        batch.contacts = findContacts(params, batch.count,
+            batch.ballX, batch.ballY, batch.paddleY[0], batch.paddleY[1], candidates);
+        for (unsigned int j = 0; j < batch.contacts; j++) {
+            unsigned int m = candidates[j];
+            collideWallsMatch(batch, params, m);
+            collidePaddle(batch, params, m);
+        }
+    }
+    else {
+        batch.contacts = batch.count;
+        collideWalls(batch, params);
+        if (params.rotatedPaddles) {
+            collidePaddlesOBB(params, batch.count,
+                batch.ballX, batch.ballY, batch.ballVX, batch.ballVY, batch.ballSpin,
+                batch.paddleY[0], batch.paddleY[1], batch.paddleV[0], batch.paddleV[1],
+                batch.paddleAngle[0], batch.paddleAngle[1],
+                batch.framesSinceLastCollision, batch.events);
+        }
+        else {
+            collidePaddlesAABB(batch, params);
+        }
+    }
+    moveBalls(params, batch.count, dt,
+        batch.ballX, batch.ballY, batch.ballVX, batch.ballVY, batch.ballSpin, batch.substeps, decays);
+
+    // remaining substeps, only for the matches that need them
+    if (multiStep) {
+        unsigned int* active = batch.scratch;
+        unsigned int noActive = 0;
+        for (unsigned int m = 0; m < batch.count; m++) {
+            active[noActive] = m;
+            noActive += batch.substeps[m] > 1 ? 1 : 0;
+        }
+
+        for (unsigned int sub = 1; noActive; sub++) {
+            unsigned int stillActive = 0;
+            for (unsigned int j = 0; j < noActive; j++) {
+                unsigned int m = active[j];
+                collideWallsMatch(batch, params, m);
+                collidePaddle(batch, params, m);
+                moveBalls(params, 1, dt,
+                    batch.ballX + m, batch.ballY + m, batch.ballVX + m, batch.ballVY + m,
+                    batch.ballSpin + m, batch.substeps + m, decays);
+
+                // keep the match if it has more substeps to take
+                active[stillActive] = m;
+                stillActive += batch.substeps[m] > sub + 1 ? 1 : 0;
+            }
+            noActive = stillActive;
+        }
+    }
+
+    movePaddles(batch, params, dt);
+}
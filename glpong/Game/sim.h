@@ -0,0 +1,111 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "largealloc.h"
+
+/*
+    2d vector structure
+*/
+struct vec2 {
+    float x;
+    float y;
+};
+
+/*
+    parameters shared by every match in a batch
+*/
+struct SimParams {
+    float width;
+    float height;
+    float paddleSpeed;
+    float paddleHeight;
+    float paddleWidth;
+    float paddleInset;      // distance from each side wall to the paddle center
+    float ballRadius;
+    vec2 initBallVelocity;
+    unsigned int framesThreshold;
+
+    // rotated paddle mode
+    bool rotatedPaddles;
+    float tiltSpeed;        // radians per second
+    float maxTilt;          // radians either way
+
+    // spin
+    float spinTransfer;     // fraction of paddle speed turned into surface speed on a hit
+    float magnus;           // radians the velocity turns per radian of spin
+    float spinDamping;      // decay rate of spin per second (spin falls by exp(-spinDamping * t))
+    float wallGrip;         // fraction of contact slip removed on a wall bounce (0 to 1)
+
+    // substeps
+    unsigned int maxSubsteps;
+    float maxSubstepDistance;   // furthest the ball moves in one substep
+    float maxSubstepTurn;       // most the velocity turns in one substep (radians)
+
+    // run collision tests only on matches whose ball is near a wall or paddle
+    bool compactContacts;
+};
+
+// parameters used by the game for a field of the given size
+SimParams defaultSimParams(float width, float height);
+
+// events raised by a match during a tick
+const unsigned char EVENT_WALL = 1;
+const unsigned char EVENT_PADDLE = 2;
+const unsigned char EVENT_SCORE_LEFT = 4;
+const unsigned char EVENT_SCORE_RIGHT = 8;
+
+/*
+    batch of matches stored as parallel arrays
+    every array holds one element per match, all carved from one large block
+*/
+struct MatchBatch {
+    unsigned int count;
+
+    // ball
+    float* ballX;
+    float* ballY;
+    float* ballVX;
+    float* ballVY;
+    float* ballSpin;        // counter-clockwise angular velocity in radians per second
+
+    // paddles (0 = left, 1 = right)
+    float* paddleY[2];
+    float* paddleV[2];
+    signed char* input[2];  // 1 = up, -1 = down, 0 = idle
+    float* paddleAngle[2];  // counter-clockwise tilt in radians
+    signed char* tiltInput[2]; // 1 = counter-clockwise, -1 = clockwise, 0 = idle
+
+    // game values
+    unsigned int* score[2];
+    unsigned int* framesSinceLastCollision;
+    unsigned char* events;  // EVENT_* raised during the last step
+
+    // per-step working state
+    unsigned char* substeps;
+    unsigned int* scratch;  // index list (count + 3 long so vector stores can overrun)
+    unsigned int contacts;  // matches sent to collision tests in the last step
+
+    LargeBlock block;
+};
+
+// allocate arrays for _count_ matches (flags from largealloc.h)
+bool allocMatchBatch(MatchBatch& batch, unsigned int count, unsigned int allocFlags);
+
+// free batch memory
+void freeMatchBatch(MatchBatch& batch);
+
+// put match _m_ in its starting state
+void resetMatch(MatchBatch& batch, const SimParams& params, unsigned int m);
+
+// set inputs so each paddle follows the ball
+void botInputs(MatchBatch& batch, const SimParams& params);
+
+// advance every match by _dt_ seconds
+void stepMatches(MatchBatch& batch, const SimParams& params, float dt);
+
+// x position of a paddle
+inline float paddleX(const SimParams& params, int i) {
+    return i == 0 ? params.paddleInset : params.width - params.paddleInset;
+}
+
+#endif
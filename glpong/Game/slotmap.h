@@ -0,0 +1,135 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <utility>
+#include <vector>
+
+/*
+    slot map
+    storage for objects that come and go (extra balls, pickups, particles,
+    obstacles): values are packed in one array for iteration, and found through
+    handles that stay valid however the array moves
+    a handle names a slot and the generation the slot had when the value went in;
+    erasing moves the last value into the hole and bumps the slot's generation, so
+    an old handle finds nothing instead of whatever reuses the slot
+    erased slots form a free list reused by later inserts, so with the capacity
+    reserved up front spawning and despawning never allocate
+*/
+
+const unsigned int SLOT_NONE = ~0u;
+
+// generation 0 is never issued, so a default handle is always empty
+struct SlotHandle {
+    unsigned int index;
+    unsigned int generation;
+
+    SlotHandle() : index(SLOT_NONE), generation(0) {}
+    SlotHandle(unsigned int index, unsigned int generation) : index(index), generation(generation) {}
+
+    bool operator==(const SlotHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const SlotHandle& other) const {
+        return !(*this == other);
+    }
+};
+
+struct Slot {
+    unsigned int dense;         // index of the value, or of the next free slot
+    unsigned int generation;    // of the value in it, or of the next one when free
+};
+
+template<typename T>
+struct SlotMap {
+    std::vector<T> values;              // packed, in no particular order
+    std::vector<unsigned int> owners;   // slot of each value
+    std::vector<Slot> slots;
+    unsigned int freeHead;              // first free slot, SLOT_NONE if none
+
+    SlotMap() : freeHead(SLOT_NONE) {}
+};
+
+// room for _capacity_ values without allocating
+template<typename T>
+void reserveSlots(SlotMap<T>& map, unsigned int capacity) {
+    map.values.reserve(capacity);
+    map.owners.reserve(capacity);
+    map.slots.reserve(capacity);
+}
+
+template<typename T>
+SlotHandle insertSlot(SlotMap<T>& map, const T& value) {
+    unsigned int index = map.freeHead;
+    if (index == SLOT_NONE) {
+        index = (unsigned int)map.slots.size();
+        Slot slot = { 0, 1 };
+        map.slots.push_back(slot);
+    }
+    else {
+        map.freeHead = map.slots[index].dense;
+    }
+
+    Slot& slot = map.slots[index];
+    slot.dense = (unsigned int)map.values.size();
+    map.values.push_back(value);
+    map.owners.push_back(index);
+    return SlotHandle(index, slot.generation);
+}
+
+// value of _handle_, NULL if it was erased
+template<typename T>
+T* getSlot(SlotMap<T>& map, SlotHandle handle) {
+    if (handle.index >= map.slots.size() || map.slots[handle.index].generation != handle.generation) {
+        return NULL;
+    }
+    return &map.values[map.slots[handle.index].dense];
+}
+
+template<typename T>
+const T* getSlot(const SlotMap<T>& map, SlotHandle handle) {
+    return getSlot(const_cast<SlotMap<T>&>(map), handle);
+}
+
+// false if _handle_ was already erased
+template<typename T>
+bool eraseSlot(SlotMap<T>& map, SlotHandle handle) {
+    if (handle.index >= map.slots.size() || map.slots[handle.index].generation != handle.generation) {
+        return false;
+    }
+
+    // the last value fills the hole
+    Slot& slot = map.slots[handle.index];
+    unsigned int last = (unsigned int)map.values.size() - 1;
+    if (slot.dense != last) {
+        map.values[slot.dense] = std::move(map.values[last]);
+        map.owners[slot.dense] = map.owners[last];
+        map.slots[map.owners[last]].dense = slot.dense;
+    }
+    map.values.pop_back();
+    map.owners.pop_back();
+
+    // a slot reused 2^32 times could answer a handle from its first use; skipping 0
+    // keeps default handles empty
+    slot.generation = slot.generation + 1 ? slot.generation + 1 : 1;
+    slot.dense = map.freeHead;
+    map.freeHead = handle.index;
+    return true;
+}
+
+// handle of the value at _dense_; erasing while iterating the values goes from the
+// back, so the value moved into the hole was already visited
+template<typename T>
+SlotHandle slotHandleAt(const SlotMap<T>& map, unsigned int dense) {
+    unsigned int index = map.owners[dense];
+    return SlotHandle(index, map.slots[index].generation);
+}
+
+// erase everything, handles given out so far stay invalid
+template<typename T>
+void clearSlotMap(SlotMap<T>& map) {
+    for (unsigned int dense = (unsigned int)map.values.size(); dense-- > 0;) {
+        eraseSlot(map, slotHandleAt(map, dense));
+    }
+}
+
+#endif
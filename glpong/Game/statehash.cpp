@@ -0,0 +1,257 @@
+#include "statehash.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32C_X64
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE42
+#else
+#include <cpuid.h>
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+/*
+    tables
+*/
+
+// zobrist keys of each set of bits in each byte of each field's quantized value
+// (entry b of table [f][i] is the xor of the keys of the bits set in byte i == b),
+// drawn independently for every field
+static unsigned long long hashTables[HASH_FIELDS][4][256];
+
+// CRC32C remainders of each byte (reflected polynomial)
+static unsigned int crcTable[256];
+const unsigned int crcPolynomial = 0x82f63b78;
+
+// fixed seed so hashes match across runs and machines
+static bool initTables() {
+    // one splitmix64 key per bit of every field
+    unsigned long long state = 0x9e3779b97f4a7c15ull;
+    for (int f = 0; f < HASH_FIELDS; f++) {
+        for (int i = 0; i < 4; i++) {
+            unsigned long long keys[8];
+            for (int j = 0; j < 8; j++) {
+                unsigned long long z = (state += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                keys[j] = z ^ (z >> 31);
+            }
+
+            for (int b = 0; b < 256; b++) {
+                unsigned long long h = 0;
+                for (int j = 0; j < 8; j++) {
+                    h ^= (b >> j) & 1 ? keys[j] : 0;
+                }
+                hashTables[f][i][b] = h;
+            }
+        }
+    }
+
+    for (unsigned int b = 0; b < 256; b++) {
+        unsigned int crc = b;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (crc & 1 ? crcPolynomial : 0);
+        }
+        crcTable[b] = crc;
+    }
+
+    return true;
+}
+
+static bool tablesReady = initTables();
+
+/*
+    state hash
+*/
+
+// xor of the keys of the bits set in _q_ for field _f_
+// xor-linear, so fieldHash(f, a) ^ fieldHash(f, b) == fieldHash(f, a ^ b)
+static inline unsigned long long fieldHash(int f, int q) {
+    unsigned int u = (unsigned int)q;
+    const unsigned long long (*tables)[256] = hashTables[f];
+    unsigned long long h = tables[0][u & 0xff] ^ tables[1][(u >> 8) & 0xff];
+    if (u >> 16) {
+        // deltas between ticks rarely reach the upper bytes
+        h ^= tables[2][(u >> 16) & 0xff] ^ tables[3][u >> 24];
+    }
+    return h;
+}
+
+// truncating toward zero is enough, it only has to be the same everywhere
+// clamped first: converting a float out of int range (or NaN) is undefined
+static inline int quantize(float value, float scale) {
+    float scaled = value * scale;
+    scaled = scaled == scaled ? scaled : 0.0f;
+    return (int)std::min(std::max(scaled, -2147483648.0f), 2147483520.0f);
+}
+
+// quantized fields of match _m_
+static inline void quantizeMatch(const MatchBatch& batch, unsigned int m, int* fields) {
+    float positionScale = 1.0f / hashPositionStep;
+    float velocityScale = 1.0f / hashVelocityStep;
+    fields[HASH_BALL_X] = quantize(batch.ballX[m], positionScale);
+    fields[HASH_BALL_Y] = quantize(batch.ballY[m], positionScale);
+    fields[HASH_BALL_VX] = quantize(batch.ballVX[m], velocityScale);
+    fields[HASH_BALL_VY] = quantize(batch.ballVY[m], velocityScale);
+    fields[HASH_LEFT_PADDLE_Y] = quantize(batch.paddleY[0][m], positionScale);
+    fields[HASH_RIGHT_PADDLE_Y] = quantize(batch.paddleY[1][m], positionScale);
+    fields[HASH_LEFT_SCORE] = (int)batch.score[0][m];
+    fields[HASH_RIGHT_SCORE] = (int)batch.score[1][m];
+}
+
+void initStateHash(StateHash& hash, const MatchBatch& batch, unsigned int m) {
+    quantizeMatch(batch, m, hash.fields);
+    hash.value = 0;
+    for (int f = 0; f < HASH_FIELDS; f++) {
+        hash.value ^= fieldHash(f, hash.fields[f]);
+    }
+}
+
+// flip the keys of the bits of field _f_ that changed, if any did
+static inline void updateField(StateHash& hash, int f, int q) {
+    int delta = q ^ hash.fields[f];
+    if (delta) {
+        hash.value ^= fieldHash(f, delta);
+        hash.fields[f] = q;
+    }
+}
+
+void updateStateHash(StateHash& hash, const MatchBatch& batch, unsigned int m) {
+    int fields[HASH_FIELDS];
+    quantizeMatch(batch, m, fields);
+    for (int f = 0; f < HASH_FIELDS; f++) {
+        updateField(hash, f, fields[f]);
+    }
+}
+
+// matches quantized at once by updateStateHashes
+const unsigned int hashBlock = 64;
+
+// one float field of _count_ matches
+static void quantizeField(unsigned int count, const float* __restrict values, float scale, int* __restrict fields) {
+    for (unsigned int m = 0; m < count; m++) {
+        fields[m] = quantize(values[m], scale);
+    }
+}
+
+void updateStateHashes(StateHash* hashes, const MatchBatch& batch) {
+    float positionScale = 1.0f / hashPositionStep;
+    float velocityScale = 1.0f / hashVelocityStep;
+
+    // quantize a block one field at a time (these loops vectorize), then update
+    // each match from its row
+    int fields[HASH_FIELDS][hashBlock];
+    for (unsigned int first = 0; first < batch.count; first += hashBlock) {
+        unsigned int n = std::min(batch.count - first, hashBlock);
+        quantizeField(n, batch.ballX + first, positionScale, fields[HASH_BALL_X]);
+        quantizeField(n, batch.ballY + first, positionScale, fields[HASH_BALL_Y]);
+        quantizeField(n, batch.ballVX + first, velocityScale, fields[HASH_BALL_VX]);
+        quantizeField(n, batch.ballVY + first, velocityScale, fields[HASH_BALL_VY]);
+        quantizeField(n, batch.paddleY[0] + first, positionScale, fields[HASH_LEFT_PADDLE_Y]);
+        quantizeField(n, batch.paddleY[1] + first, positionScale, fields[HASH_RIGHT_PADDLE_Y]);
+        for (unsigned int j = 0; j < n; j++) {
+            fields[HASH_LEFT_SCORE][j] = (int)batch.score[0][first + j];
+            fields[HASH_RIGHT_SCORE][j] = (int)batch.score[1][first + j];
+        }
+
+        for (unsigned int j = 0; j < n; j++) {
+            StateHash& hash = hashes[first + j];
+            for (int f = 0; f < HASH_FIELDS; f++) {
+                updateField(hash, f, fields[f][j]);
+            }
+        }
+    }
+}
+
+/*
+    CRC32C
+*/
+
+unsigned int crc32cSoftware(const void* data, size_t size, unsigned int crc) {
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    while (size--) {
+        crc = (crc >> 8) ^ crcTable[(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+}
+
+#ifdef CRC32C_X64
+
+static bool hasSSE42() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] >> 20) & 1;
+#else
+    unsigned int a, b, c, d;
+    return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_2);
+#endif
+}
+
+static const bool sse42 = hasSSE42();
+
+TARGET_SSE42 static unsigned int crc32cSSE42(const void* data, size_t size, unsigned int crc) {
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned long long c = ~crc;
+
+    // bytes up to 8-byte alignment, then 8 bytes per instruction
+    for (; size && ((size_t)p & 7); size--) {
+        c = _mm_crc32_u8((unsigned int)c, *p++);
+    }
+    for (; size >= 8; size -= 8, p += 8) {
+        unsigned long long v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    for (; size; size--) {
+        c = _mm_crc32_u8((unsigned int)c, *p++);
+    }
+
+    return ~(unsigned int)c;
+}
+
+unsigned int crc32c(const void* data, size_t size, unsigned int crc) {
+    return sse42 ? crc32cSSE42(data, size, crc) : crc32cSoftware(data, size, crc);
+}
+
+bool crc32cHardware() {
+    return sse42;
+}
+
+#else
+
+unsigned int crc32c(const void* data, size_t size, unsigned int crc) {
+    return crc32cSoftware(data, size, crc);
+}
+
+bool crc32cHardware() {
+    return false;
+}
+
+#endif
+
+unsigned int snapshotCRC(const MatchBatch& batch) {
+    unsigned int n = batch.count;
+    unsigned int crc = 0;
+    crc = crc32c(batch.ballX, n * sizeof(float), crc);
+    crc = crc32c(batch.ballY, n * sizeof(float), crc);
+    crc = crc32c(batch.ballVX, n * sizeof(float), crc);
+    crc = crc32c(batch.ballVY, n * sizeof(float), crc);
+    crc = crc32c(batch.ballSpin, n * sizeof(float), crc);
+    for (int i = 0; i < 2; i++) {
+        crc = crc32c(batch.paddleY[i], n * sizeof(float), crc);
+        crc = crc32c(batch.paddleV[i], n * sizeof(float), crc);
+        crc = crc32c(batch.input[i], n * sizeof(signed char), crc);
+        crc = crc32c(batch.paddleAngle[i], n * sizeof(float), crc);
+        crc = crc32c(batch.tiltInput[i], n * sizeof(signed char), crc);
+        crc = crc32c(batch.score[i], n * sizeof(unsigned int), crc);
+    }
+    crc = crc32c(batch.framesSinceLastCollision, n * sizeof(unsigned int), crc);
+    return crc;
+}
@@ -0,0 +1,65 @@
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <cstddef>
+
+#include "sim.h"
+
+/*
+    rolling state hash
+    zobrist hash over the bits of the quantized fields: a random 64-bit key per bit of
+    every field, drawn independently for each field, and the state hash is the xor of
+    the keys of every set bit; a changed field flips the keys of the bits in
+    old ^ new (one table lookup per byte), and unchanged fields cost one compare
+*/
+
+// fields covered by the state hash
+enum HashField {
+    HASH_BALL_X,
+    HASH_BALL_Y,
+    HASH_BALL_VX,
+    HASH_BALL_VY,
+    HASH_LEFT_PADDLE_Y,
+    HASH_RIGHT_PADDLE_Y,
+    HASH_LEFT_SCORE,
+    HASH_RIGHT_SCORE,
+    HASH_FIELDS
+};
+
+// quantization steps (positions in pixels, velocities in pixels per second)
+const float hashPositionStep = 1.0f / 64.0f;
+const float hashVelocityStep = 1.0f / 64.0f;
+
+// state hash of one match with the quantized values it was built from
+struct StateHash {
+    unsigned long long value;
+    int fields[HASH_FIELDS];
+};
+
+// hash match _m_ from scratch
+void initStateHash(StateHash& hash, const MatchBatch& batch, unsigned int m);
+
+// update the hash with the fields of match _m_ that changed since the last update
+void updateStateHash(StateHash& hash, const MatchBatch& batch, unsigned int m);
+
+// updateStateHash for every match of the batch, one field at a time
+void updateStateHashes(StateHash* hashes, const MatchBatch& batch);
+
+/*
+    CRC32C (Castagnoli) for bulk verification
+    uses the SSE4.2 crc32 instruction when the CPU has it
+*/
+
+// continue _crc_ (0 to start) over _size_ bytes
+unsigned int crc32c(const void* data, size_t size, unsigned int crc = 0);
+
+// table-driven version, used when the instruction is missing
+unsigned int crc32cSoftware(const void* data, size_t size, unsigned int crc = 0);
+
+// true if crc32c runs on the crc32 instruction
+bool crc32cHardware();
+
+// CRC32C of the match state arrays of a batch (not the per-step working state)
+unsigned int snapshotCRC(const MatchBatch& batch);
+
+#endif
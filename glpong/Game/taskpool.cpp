@@ -0,0 +1,81 @@
+#include "taskpool.h"
+
+#include <algorithm>
+#include <cstddef>
+
+// take tasks until there are none left
+static void takeTasks(TaskPool& pool, unsigned int w) {
+    unsigned int task;
+    while ((task = pool.nextTask.fetch_add(1)) < pool.noTasks) {
+        pool.function(pool.context, w, task);
+    }
+}
+
+static void workerLoop(TaskPool& pool, unsigned int w) {
+    unsigned int seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(pool.lock);
+            pool.wake.wait(guard, [&]() { return pool.stopping || pool.round != seen; });
+            if (pool.stopping) {
+                return;
+            }
+            seen = pool.round;
+        }
+
+        takeTasks(pool, w);
+
+        std::lock_guard<std::mutex> guard(pool.lock);
+        if (--pool.busy == 0) {
+            pool.finished.notify_one();
+        }
+    }
+}
+
+void startTaskPool(TaskPool& pool, unsigned int threads) {
+    pool.noThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    pool.round = 0;
+    pool.busy = 0;
+    pool.stopping = false;
+    pool.nextTask.store(0);
+    pool.function = NULL;
+    pool.context = NULL;
+    pool.noTasks = 0;
+
+    // worker 0 is the calling thread
+    pool.threads = new std::thread[pool.noThreads];
+    for (unsigned int w = 1; w < pool.noThreads; w++) {
+        pool.threads[w] = std::thread(workerLoop, std::ref(pool), w);
+    }
+}
+
+void stopTaskPool(TaskPool& pool) {
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (unsigned int w = 1; w < pool.noThreads; w++) {
+        pool.threads[w].join();
+    }
+    delete[] pool.threads;
+    pool.threads = NULL;
+}
+
+void runTasks(TaskPool& pool, unsigned int noTasks, TaskFunction function, void* context) {
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.function = function;
+        pool.context = context;
+        pool.noTasks = noTasks;
+        pool.nextTask.store(0);
+        pool.busy = pool.noThreads - 1;
+        pool.round++;
+    }
+    pool.wake.notify_all();
+
+    takeTasks(pool, 0);
+
+    std::unique_lock<std::mutex> guard(pool.lock);
+    pool.finished.wait(guard, [&]() { return pool.busy == 0; });
+}
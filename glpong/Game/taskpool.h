@@ -0,0 +1,45 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+    task pool
+    a few workers that sleep between rounds; a round hands out tasks 0 to noTasks - 1
+    through an atomic counter, so uneven tasks balance out, and the calling thread
+    works as worker 0 until every task is taken, then waits for the others to finish
+    one round at a time, from one thread
+*/
+
+// run task _task_ on worker _worker_ (0 is the thread that started the round)
+typedef void (*TaskFunction)(void* context, unsigned int worker, unsigned int task);
+
+struct TaskPool {
+    unsigned int noThreads;     // workers, the calling thread included
+    std::thread* threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    unsigned int round;         // bumped to start a round of tasks
+    unsigned int busy;          // workers still in the round
+    bool stopping;
+    std::atomic<unsigned int> nextTask;
+
+    // current round
+    TaskFunction function;
+    void* context;
+    unsigned int noTasks;
+};
+
+// start _threads_ - 1 workers (0 = one per core)
+void startTaskPool(TaskPool& pool, unsigned int threads);
+
+void stopTaskPool(TaskPool& pool);
+
+// run _noTasks_ tasks of _function_ on every worker, returns once all are done
+void runTasks(TaskPool& pool, unsigned int noTasks, TaskFunction function, void* context);
+
+#endif
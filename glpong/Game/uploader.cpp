@@ -0,0 +1,222 @@
+#include "uploader.h"
+#include "memstats.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+/*
+    loader thread
+*/
+
+// create the object and copy the data in chunks
+static bool performUpload(Upload& upload) {
+    PROFILE_GL(upload.target == GL_TEXTURE_2D ? "upload texture" : "upload buffer");
+    const unsigned char* data = (const unsigned char*)upload.data;
+
+    if (upload.target == GL_TEXTURE_2D) {
+        glGenTextures(1, &upload.name);
+        glBindTexture(GL_TEXTURE_2D, upload.name);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, upload.internalFormat, upload.width, upload.height, 0,
+            upload.format, upload.type, NULL);
+
+        // bands of rows
+        size_t rowSize = upload.height ? upload.size / upload.height : 0;
+        GLsizei rows = rowSize ? (GLsizei)std::max((size_t)1, UPLOAD_CHUNK / rowSize) : upload.height;
+        for (GLsizei y = 0; data && y < upload.height; y += rows) {
+            GLsizei n = std::min(rows, upload.height - y);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, upload.width, n, upload.format, upload.type, data + y * rowSize);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    else {
+        glGenBuffers(1, &upload.name);
+        glBindBuffer(upload.target, upload.name);
+        glBufferData(upload.target, upload.size, NULL, upload.usage);
+        for (size_t offset = 0; data && offset < upload.size; offset += UPLOAD_CHUNK) {
+            glBufferSubData(upload.target, offset, std::min(UPLOAD_CHUNK, upload.size - offset), data + offset);
+        }
+        glBindBuffer(upload.target, 0);
+    }
+
+    // a failed upload (out of memory, bad format...) leaves no object behind
+    MemoryCategory category = upload.target == GL_TEXTURE_2D ? MEMORY_GL_TEXTURES : MEMORY_GL_BUFFERS;
+    if (glGetError() != GL_NO_ERROR) {
+        trackGLObject(category, upload.name, 0);
+        if (upload.target == GL_TEXTURE_2D) {
+            glDeleteTextures(1, &upload.name);
+        }
+        else {
+            glDeleteBuffers(1, &upload.name);
+        }
+        upload.name = 0;
+        return false;
+    }
+    trackGLObject(category, upload.name, upload.size);
+    return true;
+}
+
+static void loaderLoop(Uploader& uploader) {
+    profilerThreadName("loader");
+    glfwMakeContextCurrent(uploader.context);
+
+    // rows of any width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (;;) {
+        Upload* upload = NULL;
+        GLuint release = 0;
+        bool texture = false;
+        {
+            std::unique_lock<std::mutex> guard(uploader.lock);
+            uploader.wake.wait(guard, [&]() {
+                return uploader.stopping || uploader.queueHead != uploader.queueTail ||
+                    uploader.releaseHead != uploader.releaseTail;
+            });
+
+            // releases first, they are quick and free memory for the uploads
+            if (uploader.releaseHead != uploader.releaseTail) {
+                unsigned int r = uploader.releaseHead++ % UPLOAD_QUEUE_SIZE;
+                release = uploader.releases[r];
+                texture = uploader.releaseTexture[r];
+            }
+            else if (uploader.queueHead != uploader.queueTail) {
+                upload = uploader.queue[uploader.queueHead++ % UPLOAD_QUEUE_SIZE];
+            }
+            else {
+                break;
+            }
+        }
+
+        double start = glfwGetTime();
+        if (release) {
+            trackGLObject(texture ? MEMORY_GL_TEXTURES : MEMORY_GL_BUFFERS, release, 0);
+            if (texture) {
+                glDeleteTextures(1, &release);
+            }
+            else {
+                glDeleteBuffers(1, &release);
+            }
+        }
+        else {
+            bool ok = performUpload(*upload);
+
+            // flush so the fence reaches the GPU and the render context can see it
+            upload->fence = ok ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+            glFlush();
+            uploader.bytes.fetch_add(upload->size, std::memory_order_relaxed);
+            uploader.uploads.fetch_add(1, std::memory_order_relaxed);
+            upload->state.store(ok ? UPLOAD_FENCED : UPLOAD_FAILED, std::memory_order_release);
+        }
+        uploader.loaderTime += glfwGetTime() - start;
+    }
+
+    // nothing queued is left; make sure deletes have reached the driver
+    glFinish();
+    glfwMakeContextCurrent(NULL);
+}
+
+/*
+    render thread
+*/
+
+bool startUploader(Uploader& uploader, GLFWwindow* share) {
+    // the loader only needs a context, so its window is never shown
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    uploader.context = glfwCreateWindow(1, 1, "loader", NULL, share);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!uploader.context) {
+        return false;
+    }
+
+    uploader.stopping = false;
+    uploader.queueHead = uploader.queueTail = 0;
+    uploader.releaseHead = uploader.releaseTail = 0;
+    uploader.noPending = 0;
+    uploader.bytes.store(0);
+    uploader.uploads.store(0);
+    uploader.loaderTime = 0.0;
+    uploader.thread = std::thread(loaderLoop, std::ref(uploader));
+    return true;
+}
+
+void stopUploader(Uploader& uploader) {
+    {
+        std::lock_guard<std::mutex> guard(uploader.lock);
+        uploader.stopping = true;
+    }
+    uploader.wake.notify_one();
+    uploader.thread.join();
+
+    // fences of uploads nobody collected
+    for (unsigned int i = 0; i < uploader.noPending; i++) {
+        if (uploader.pending[i]->fence) {
+            glDeleteSync(uploader.pending[i]->fence);
+        }
+    }
+    uploader.noPending = 0;
+    glfwDestroyWindow(uploader.context);
+    uploader.context = NULL;
+}
+
+bool queueUpload(Uploader& uploader, Upload& upload) {
+    if (uploader.noPending == UPLOAD_QUEUE_SIZE) {
+        return false;
+    }
+    upload.name = 0;
+    upload.fence = 0;
+    upload.state.store(UPLOAD_QUEUED);
+    upload.queuedAt = glfwGetTime();
+    upload.readyAt = 0.0;
+    {
+        std::lock_guard<std::mutex> guard(uploader.lock);
+        uploader.queue[uploader.queueTail++ % UPLOAD_QUEUE_SIZE] = &upload;
+    }
+    uploader.pending[uploader.noPending++] = &upload;
+    uploader.wake.notify_one();
+    return true;
+}
+
+bool queueRelease(Uploader& uploader, GLuint name, bool texture) {
+    {
+        std::lock_guard<std::mutex> guard(uploader.lock);
+        if (uploader.releaseTail - uploader.releaseHead == UPLOAD_QUEUE_SIZE) {
+            return false;
+        }
+        unsigned int r = uploader.releaseTail++ % UPLOAD_QUEUE_SIZE;
+        uploader.releases[r] = name;
+        uploader.releaseTexture[r] = texture;
+    }
+    uploader.wake.notify_one();
+    return true;
+}
+
+unsigned int pollUploads(Uploader& uploader) {
+    unsigned int ready = 0;
+    for (unsigned int i = 0; i < uploader.noPending;) {
+        Upload& upload = *uploader.pending[i];
+        unsigned int state = upload.state.load(std::memory_order_acquire);
+        bool done = state == UPLOAD_FAILED;
+        if (state == UPLOAD_FENCED) {
+            // zero timeout: ask, never wait
+            GLenum status = glClientWaitSync(upload.fence, 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                glDeleteSync(upload.fence);
+                upload.fence = 0;
+                upload.readyAt = glfwGetTime();
+                upload.state.store(UPLOAD_READY, std::memory_order_release);
+                ready++;
+                done = true;
+            }
+        }
+
+        if (done) {
+            uploader.pending[i] = uploader.pending[--uploader.noPending];
+        }
+        else {
+            i++;
+        }
+    }
+    return ready;
+}
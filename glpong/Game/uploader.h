@@ -0,0 +1,104 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+/*
+    background uploads on a second GL context
+    a loader thread owns a hidden window whose context shares objects with the render
+    context, creates buffers and textures there, copies their data in chunks and
+    inserts a fence after each one
+    the render thread queues uploads without touching GL, and each frame checks the
+    fences of its uploads with a zero timeout, so a resource is handed over once the
+    GPU has it and the render thread never waits
+    deletes can go through the loader too, so freeing a large object does not stall
+    a frame either
+*/
+
+const unsigned int UPLOAD_QUEUE_SIZE = 64;
+
+// bytes copied per call, so a release queued behind a large upload waits for one
+// chunk rather than the whole copy
+const size_t UPLOAD_CHUNK = 4 << 20;
+
+enum UploadState {
+    UPLOAD_QUEUED,
+    UPLOAD_FENCED,      // copied on the loader, GPU may still be reading the data
+    UPLOAD_READY,       // render thread may use the object
+    UPLOAD_FAILED
+};
+
+// one buffer or texture, owned by the caller until it is ready
+// (the data has to stay valid until then)
+struct Upload {
+    // buffer: target (GL_ARRAY_BUFFER, ...), size and usage
+    // texture: target GL_TEXTURE_2D, size of one level, formats
+    GLenum target;
+    const void* data;
+    size_t size;
+    GLenum usage;
+    GLsizei width;
+    GLsizei height;
+    GLint internalFormat;
+    GLenum format;
+    GLenum type;
+
+    // results
+    GLuint name;
+    GLsync fence;
+    std::atomic<unsigned int> state;
+    double queuedAt;        // glfwGetTime
+    double readyAt;
+};
+
+struct Uploader {
+    GLFWwindow* context;    // hidden window sharing the render context's objects
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+
+    // requests from the render thread
+    Upload* queue[UPLOAD_QUEUE_SIZE];
+    unsigned int queueHead;
+    unsigned int queueTail;
+    GLuint releases[UPLOAD_QUEUE_SIZE];
+    bool releaseTexture[UPLOAD_QUEUE_SIZE];
+    unsigned int releaseHead;
+    unsigned int releaseTail;
+
+    // queued uploads whose fences the render thread still checks
+    Upload* pending[UPLOAD_QUEUE_SIZE];
+    unsigned int noPending;
+
+    // counters
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long long> uploads;
+    double loaderTime;      // seconds the loader spent in GL calls (loader thread)
+};
+
+// create the loader context sharing _share_'s objects and start the thread
+// (call from the main thread, GLFW creates windows only there)
+bool startUploader(Uploader& uploader, GLFWwindow* share);
+
+// finish queued work and destroy the loader context
+void stopUploader(Uploader& uploader);
+
+// queue an upload, false if the queue is full
+bool queueUpload(Uploader& uploader, Upload& upload);
+
+// delete a buffer or texture on the loader
+bool queueRelease(Uploader& uploader, GLuint name, bool texture);
+
+// render thread, once a frame: mark uploads whose fences have passed as ready
+// without waiting, returns how many became ready
+unsigned int pollUploads(Uploader& uploader);
+
+#endif